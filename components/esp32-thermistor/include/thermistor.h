@@ -59,6 +59,24 @@ extern "C" {
 #include "esp_adc/adc_oneshot.h"
 #include "freertos/portmacro.h"
 
+#define THERMISTOR_LUT_STEP_MV  16  /**< Conversion table step, entries are interpolated.*/
+#define THERMISTOR_LUT_MAX      4   /**< Distinct thermistor definitions with a table.*/
+
+/**
+ * @brief Conversion table shared by thermistors with the same parameters.
+ */
+typedef struct
+{
+    float serial_resistance;
+    float nominal_resistance;
+    float nominal_temperature;
+    float beta_val;
+    float vsource;
+    uint16_t cnt;
+    uint16_t users;                 /**< Thermistors bound to the table, freed with the last one.*/
+    int16_t *centi;                 /**< Temperature in 1/100 degrees Celsius at i*THERMISTOR_LUT_STEP_MV.*/
+} thermistor_lut_t;
+
 /**
  * @brief Structure to storing the thermistor instance.
  *
@@ -79,8 +97,25 @@ typedef struct
     uint32_t vmedian;
     float celsius;
     time_t time;
+    const thermistor_lut_t *lut;    /**< Conversion table, NULL to compute.*/
 } thermistor_handle_t;
 
+#define THERMISTOR_BIN      20      /**< Histogram bin width in raw ADC codes.*/
+#define THERMISTOR_NEAR     10      /**< Distance from median of samples kept by filter.*/
+#define THERMISTOR_BIN_MIN  10      /**< Samples per 64 needed for bin to count.*/
+
+/**
+ * @brief Result of filtering raw ADC samples.
+ */
+typedef struct
+{
+    int median;                     /**< Median of samples.*/
+    int dominant;                   /**< Start of most populated histogram bin.*/
+    int near;                       /**< Samples near median (or previous result).*/
+    int outliers;                   /**< Samples in bins below THERMISTOR_BIN_MIN.*/
+    uint32_t reading;               /**< Filtered raw ADC reading.*/
+} thermistor_filter_t;
+
 /**
  * @brief Initialice the thermistor driver.
  *
@@ -116,10 +151,46 @@ esp_err_t thermistor_init(thermistor_handle_t* th, int gpio, int adc_unit,
  */
 uint32_t thermistor_read_vout(thermistor_handle_t* th);
 
+/**
+ * @brief Filter outliers from raw ADC samples in linear time.
+ *
+ * Median is found by selection, one pass builds a histogram (from lowest
+ * sample, THERMISTOR_BIN wide bins) and averages samples near the median,
+ * another pass averages samples of populated bins.  Values are reordered.
+ *
+ * @param   th  Pointer of the driver information, vmedian is updated.
+ * @param   values Raw 12-bit ADC samples.
+ * @param   cnt Number of samples (at most 255).
+ * @param   f Filter result.
+ */
+void thermistor_filter(thermistor_handle_t* th, int *values, int cnt, thermistor_filter_t *f);
+
+/**
+ * @brief Read all ADC1 thermistors at once in continuous (DMA) mode.
+ *
+ * Channels are scanned round-robin until each has the same number of
+ * samples as thermistor_read_vout takes, then they are filtered the same
+ * way.  Sets vout, t_resistance and celsius, ADC2 thermistors are skipped.
+ * Channels the pattern can't take (second thermistor on the same channel,
+ * more than pattern length) are skipped too.
+ *
+ * @param   ths Thermistors.
+ * @param   cnt Number of thermistors.
+ * @param   scanned Set to 1 for thermistors which were read, 0 for the rest
+ *                  which need oneshot (cnt items).
+ *
+ * @return
+ *      - ESP_OK: scanned thermistors were read.
+ *      - ESP_ERR_NOT_SUPPORTED: CONFIG_THERMISTOR_ADC_CONTINUOUS is off, use oneshot.
+ *      - Other driver errors, use oneshot.
+ */
+esp_err_t thermistor_scan(thermistor_handle_t* ths, int cnt, uint8_t *scanned);
+
 /**
  * @brief Converts the output voltage of the divider to degrees Celsius.
  *
- * To linearize the thermistor output use the simplified Steniarth equation.
+ * To linearize the thermistor output use the simplified Steniarth equation,
+ * or interpolate conversion table if thermistor has one.
  *
  * @param   th  Pointer of the driver information.
  * @param   vout Output voltage of the resistive divider in mV.
@@ -129,6 +200,51 @@ uint32_t thermistor_read_vout(thermistor_handle_t* th);
  */
 float thermistor_vout_to_celsius(thermistor_handle_t* th, uint32_t vout);
 
+/**
+ * @brief Converts the output voltage of the divider to 1/100 degrees Celsius.
+ *
+ * With a conversion table this is integer only (linear interpolation
+ * between table entries), otherwise it is rounded thermistor_vout_to_celsius.
+ *
+ * @param   th  Pointer of the driver information.
+ * @param   vout Output voltage of the resistive divider in mV.
+ *
+ * @return
+ *      - Temperature in 1/100 degrees Celsius.
+ */
+int thermistor_vout_to_centi(thermistor_handle_t* th, uint32_t vout);
+
+/**
+ * @brief Find or build conversion table for thermistor parameters.
+ *
+ * Tables are shared by all thermistors with the same parameters, they are
+ * built at thermistor_init with CONFIG_THERMISTOR_LUT.  When parameters of
+ * a thermistor change (e.g. serial_resistance), conversion binds it to
+ * a matching table and releases the old one.
+ *
+ * @param   th  Pointer of the driver information.
+ *
+ * @return
+ *      - Table (caller is counted as user) or NULL if there are too many
+ *        definitions or no memory.
+ */
+const thermistor_lut_t *thermistor_lut(thermistor_handle_t* th);
+
+/**
+ * @brief Release table from thermistor_lut, it is freed with the last user.
+ *
+ * @param   lut Table or NULL.
+ */
+void thermistor_lut_release(const thermistor_lut_t *lut);
+
+/**
+ * @brief Memory used by all conversion tables.
+ *
+ * @return
+ *      - Bytes.
+ */
+size_t thermistor_lut_bytes();
+
 /**
  * @brief Get temperature in degrees Celsius from the thermistor.
  *
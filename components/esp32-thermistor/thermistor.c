@@ -30,12 +30,15 @@
 
 #include "thermistor.h"
 
-#include <stdlib.h>
 #include <inttypes.h>
+#include <string.h>
 #include "driver/gpio.h"
 #include "esp_adc/adc_cali_scheme.h"
 #include "adc_cali_schemes.h"
 #include "esp_adc/adc_oneshot.h"
+#if CONFIG_THERMISTOR_ADC_CONTINUOUS
+#include "esp_adc/adc_continuous.h"
+#endif
 #include "hal/efuse_ll.h"
 #include "esp_err.h"
 #include "math.h"
@@ -235,37 +238,17 @@ esp_err_t thermistor_init(thermistor_handle_t* th, int gpio, int adc_unit,
         th->beta_val = beta_val;
         th->vsource = vsource;
         th->t_resistance = 0;
+        th->lut = NULL;
+#if CONFIG_THERMISTOR_LUT
+        th->lut = thermistor_lut(th);
+#endif
     }
 
     return ESP_OK;
 }
 
-float thermistor_vout_to_celsius(thermistor_handle_t* th, uint32_t vout)
-{
-    float steinhart;
-
-    // Rt = R1 * Vout / (Vs - Vout);
-    th->t_resistance =  (th->serial_resistance * vout) / (th->vsource - vout);
-
-    steinhart = th->t_resistance / th->nominal_resistance;  // (R/Ro)
-    steinhart = log(steinhart);                             // ln(R/Ro)
-    steinhart /= th->beta_val;                              // 1/B * ln(R/Ro)
-    steinhart += 1.0 / (th->nominal_temperature + 273.15);  // + (1/To)
-    steinhart = 1.0 / steinhart;                            // Invert
-    steinhart -= 273.15;                                    // convert to C
-
-    return steinhart;
-}
-
-static int compar(const void *a, const void *b)
-{
-  return (*(int *)a - *(int *)b);
-}
-
 uint32_t thermistor_read_vout(thermistor_handle_t* th)
 {
-    uint32_t adc_reading = 0;
-    uint32_t avg_reading = 0;
     int value;
     adc_oneshot_unit_handle_t unit = (th->adc_unit == ADC_UNIT_1)? unit1 : unit2;
     adc_cali_handle_t cali = (th->adc_unit == ADC_UNIT_1)? cali_unit1 : cali_unit2;
@@ -276,123 +259,141 @@ uint32_t thermistor_read_vout(thermistor_handle_t* th)
     // Use multiple samples to stabilize the measured value.
     for (int i = 0; i < NO_OF_SAMPLES; i++) {
         if (adc_oneshot_read(unit, th->channel, &value) == ESP_OK) {
-            avg_reading += value;
             values[i] = value;
             //ESP_LOGI(TAG, "%d", value);
         } else // again
             i -= 1;
     }
-    avg_reading /= NO_OF_SAMPLES;
-
-    // average can jump, there are outliers
-    qsort(values, NO_OF_SAMPLES, sizeof(value), compar);
-    int median = values[NO_OF_SAMPLES/2];
-    // histogram
-    int start_max = values[0];
-    int start_c = 0;
-    for (int start=values[0], i=0, c=0; start <= values[NO_OF_SAMPLES-1]; start+=20) {
-        while (values[i] < start+20) {
-            c += 1;
-            i += 1;
-        }
-        //ESP_LOGI(TAG, "%d: %d", start, c);
-        if (c > start_c) {
-            start_c = c;
-            start_max = start;
-        }
-        c = 0;
-    }
-    // if this is not precise enough we need to remove outliers or do
-    // another run with outlier filtering
 
-    // there is a risk of infinite cycle - not enough "correct" samples
-    /*
-    for (int i = 0; i < NO_OF_SAMPLES; i++) {
-        if (adc_oneshot_read(unit, th->channel, &value) == ESP_OK) {
-            if (abs(median - value) < 50)
-                adc_reading += value;
-            else
-                i -= 1;
-        } else // again
-            i -= 1;
+    thermistor_filter_t f;
+    thermistor_filter(th, values, NO_OF_SAMPLES, &f);
+
+    int voltage;
+    ESP_ERROR_CHECK(adc_cali_raw_to_voltage(cali, f.reading, &voltage));
+    return voltage;
+}
+
+#if CONFIG_THERMISTOR_ADC_CONTINUOUS
+#if CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S2
+#define SCAN_FORMAT         ADC_DIGI_OUTPUT_FORMAT_TYPE1
+#define SCAN_CHANNEL(p)     ((p)->type1.channel)
+#define SCAN_DATA(p)        ((p)->type1.data)
+#else
+#define SCAN_FORMAT         ADC_DIGI_OUTPUT_FORMAT_TYPE2
+#define SCAN_CHANNEL(p)     ((p)->type2.channel)
+#define SCAN_DATA(p)        ((p)->type2.data)
+#endif
+#define SCAN_CHANNELS       SOC_ADC_CHANNEL_NUM(ADC_UNIT_1)
+// 64 conversions per frame
+#define SCAN_FRAME          (64 * SOC_ADC_DIGI_RESULT_BYTES)
+#define SCAN_TIMEOUT_MS     100
+
+static adc_continuous_handle_t scan = NULL;
+// static, temp task stack is small
+static uint8_t scan_frame[SCAN_FRAME];
+static uint16_t scan_values[SCAN_CHANNELS][NO_OF_SAMPLES];
+
+esp_err_t thermistor_scan(thermistor_handle_t* ths, int cnt, uint8_t *scanned)
+{
+    esp_err_t err = ESP_OK;
+    thermistor_handle_t *chan_th[SCAN_CHANNELS] = {0};
+    uint8_t chan_cnt[SCAN_CHANNELS] = {0};
+    adc_digi_pattern_config_t pattern[SOC_ADC_PATT_LEN_MAX];
+    int pattern_num = 0;
+
+    memset(scanned, 0, cnt);
+    for (int i = 0; i < cnt; i++) {
+        // the rest is left for oneshot
+        if (ths[i].adc_unit != ADC_UNIT_1 || ths[i].channel >= SCAN_CHANNELS ||
+            chan_th[ths[i].channel] != NULL || pattern_num == SOC_ADC_PATT_LEN_MAX)
+            continue;
+        chan_th[ths[i].channel] = &ths[i];
+        pattern[pattern_num++] = (adc_digi_pattern_config_t) {
+            .atten = atten,
+            .channel = ths[i].channel,
+            .unit = ADC_UNIT_1,
+            .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+        };
     }
-    adc_reading /= NO_OF_SAMPLES;
-    */
-
-    // filtering should be good enough
-    // counting on median falling into more precise group of values
-    // and outliers being more extreme to be successfully filtered
-    int samples = 0;
-    if (th->vmedian)
-        median = th->vmedian;
-    for (int i = 0; i < NO_OF_SAMPLES; i++) {
-        value = values[i];
-        if (abs(median - value) < 10) {
-            adc_reading += value;
-            samples += 1;
+    if (pattern_num == 0)
+        return ESP_OK;
+
+    if (scan == NULL) {
+        adc_continuous_handle_cfg_t handle_config = {
+            .max_store_buf_size = 4 * SCAN_FRAME,
+            .conv_frame_size = SCAN_FRAME,
+        };
+        err = adc_continuous_new_handle(&handle_config, &scan);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "continuous mode not available: %s", esp_err_to_name(err));
+            scan = NULL;
+            return err;
         }
     }
-    ESP_LOGI(TAG, "median %d filtered %d samples", median, NO_OF_SAMPLES - samples);
-    if (samples) {
-        adc_reading /= samples;
-        th->vmedian = adc_reading;
-    } else {
-        // this can result in a large jump
-        //adc_reading = avg_reading;
-        // take middle of largest histogram group as result
-        adc_reading = start_max + 10;
-    }
-    /*
-    {
-        // TODO test this as result, as a fallback it was always quite lower ~1C
-        // TODO this can be better if there are extreme outliers
-        samples = 0;
-        adc_reading = 0;
-        for (int i=0; i < NO_OF_SAMPLES; i++) {
-            // max + neighbor on each side
-            if (values[i] >= start_max-20 && values[i] < start_max+20+20) {
-                samples += 1;
-                adc_reading += values[i];
-            }
-        }
-        adc_reading /= samples;
-        //th->vmedian = adc_reading;
+
+    adc_continuous_config_t scan_config = {
+        .pattern_num = pattern_num,
+        .adc_pattern = pattern,
+        .sample_freq_hz = CONFIG_THERMISTOR_SCAN_FREQ_HZ,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = SCAN_FORMAT,
+    };
+    // pool keeps conversions from the end of previous scan
+    if ((err = adc_continuous_config(scan, &scan_config)) != ESP_OK ||
+        (err = adc_continuous_flush_pool(scan)) != ESP_OK ||
+        (err = adc_continuous_start(scan)) != ESP_OK) {
+        ESP_LOGE(TAG, "continuous mode start: %s", esp_err_to_name(err));
+        return err;
     }
-    */
-
-    // histogram
-    int start_i = 0;
-    samples = 0;
-    for (int start=values[0], i=0, start_c=0; start <= values[NO_OF_SAMPLES-1]; start+=20) {
-        while (values[i] < start+20) {
-            if (start_c == 0)
-                start_i = i;
-            start_c += 1;
-            i += 1;
-        }
-        ESP_LOGI(TAG, "%d: %d", start, start_c);
-        if (start_c >= 10*(NO_OF_SAMPLES/64)) {
-            for (int j=start_i; j<i; j++) {
-                adc_reading += values[j];
-                samples += 1;
-            }
+
+    // round-robin, channels fill up at the same pace
+    int full = 0;
+    while (full < pattern_num) {
+        uint32_t len = 0;
+        err = adc_continuous_read(scan, scan_frame, sizeof(scan_frame), &len, SCAN_TIMEOUT_MS);
+        if (err != ESP_OK)
+            break;
+        for (int i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= len; i += SOC_ADC_DIGI_RESULT_BYTES) {
+            adc_digi_output_data_t *p = (adc_digi_output_data_t *) &scan_frame[i];
+            int ch = SCAN_CHANNEL(p);
+            if (ch >= SCAN_CHANNELS || chan_th[ch] == NULL || chan_cnt[ch] == NO_OF_SAMPLES)
+                continue;
+            scan_values[ch][chan_cnt[ch]++] = SCAN_DATA(p);
+            if (chan_cnt[ch] == NO_OF_SAMPLES)
+                full += 1;
         }
-        start_c = 0;
-        start_i = i;
     }
-    // prevent division by zero
-    if (!samples) {
-        ESP_LOGE(TAG, "no samples GPIO %d", th->gpio);
-    } else {
-        adc_reading /= samples;
+    adc_continuous_stop(scan);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "continuous mode read: %s", esp_err_to_name(err));
+        return err;
     }
 
-    ESP_LOGI(TAG, "histogram >=%d, %d samples, %" PRIu32, 10*(NO_OF_SAMPLES/64), samples, adc_reading);
-
-    int voltage;
-    ESP_ERROR_CHECK(adc_cali_raw_to_voltage(cali, adc_reading, &voltage));
-    return voltage;
+    int values[NO_OF_SAMPLES];
+    for (int ch = 0; ch < SCAN_CHANNELS; ch++) {
+        thermistor_handle_t *th = chan_th[ch];
+        if (th == NULL)
+            continue;
+        for (int i = 0; i < NO_OF_SAMPLES; i++)
+            values[i] = scan_values[ch][i];
+
+        thermistor_filter_t f;
+        thermistor_filter(th, values, NO_OF_SAMPLES, &f);
+        int voltage;
+        ESP_ERROR_CHECK(adc_cali_raw_to_voltage(cali_unit1, f.reading, &voltage));
+        th->vout = voltage;
+        th->celsius = thermistor_vout_to_celsius(th, th->vout);
+        scanned[th - ths] = 1;
+    }
+    return ESP_OK;
 }
+#else
+esp_err_t thermistor_scan(thermistor_handle_t* ths, int cnt, uint8_t *scanned)
+{
+    memset(scanned, 0, cnt);
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif
 
 float thermistor_get_celsius(thermistor_handle_t* th)
 {
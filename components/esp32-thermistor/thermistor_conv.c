@@ -0,0 +1,194 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Juan Schiavoni
+ * Copyright (c) 2022 Adam Sloboda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file thermistor_conv.c
+ * @brief Voltage to temperature conversion, computed or from shared tables
+ * (no ADC access, runs on host too).
+ */
+
+#include "thermistor.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "esp_log.h"
+static const char* TAG = "drv_thr";
+
+// slot is free without centi, tables don't move
+static thermistor_lut_t luts[THERMISTOR_LUT_MAX];
+static size_t lut_bytes = 0;
+
+static float steinhart_celsius(const thermistor_lut_t *p, float vout, float *t_resistance)
+{
+    float steinhart;
+
+    // Rt = R1 * Vout / (Vs - Vout);
+    *t_resistance =  (p->serial_resistance * vout) / (p->vsource - vout);
+
+    steinhart = *t_resistance / p->nominal_resistance;      // (R/Ro)
+    steinhart = log(steinhart);                             // ln(R/Ro)
+    steinhart /= p->beta_val;                               // 1/B * ln(R/Ro)
+    steinhart += 1.0 / (p->nominal_temperature + 273.15);   // + (1/To)
+    steinhart = 1.0 / steinhart;                            // Invert
+    steinhart -= 273.15;                                    // convert to C
+
+    return steinhart;
+}
+
+static void lut_params(thermistor_handle_t* th, thermistor_lut_t *p)
+{
+    *p = (thermistor_lut_t) {
+        .serial_resistance = th->serial_resistance,
+        .nominal_resistance = th->nominal_resistance,
+        .nominal_temperature = th->nominal_temperature,
+        .beta_val = th->beta_val,
+        .vsource = th->vsource,
+    };
+}
+
+static int lut_match(const thermistor_lut_t *a, const thermistor_lut_t *b)
+{
+    return a->serial_resistance == b->serial_resistance &&
+           a->nominal_resistance == b->nominal_resistance &&
+           a->nominal_temperature == b->nominal_temperature &&
+           a->beta_val == b->beta_val &&
+           a->vsource == b->vsource;
+}
+
+const thermistor_lut_t *thermistor_lut(thermistor_handle_t* th)
+{
+    thermistor_lut_t p;
+    lut_params(th, &p);
+    thermistor_lut_t *free_lut = NULL;
+    for (int i = 0; i < THERMISTOR_LUT_MAX; i++) {
+        if (luts[i].centi == NULL) {
+            if (free_lut == NULL)
+                free_lut = &luts[i];
+        } else if (lut_match(&luts[i], &p)) {
+            luts[i].users += 1;
+            return &luts[i];
+        }
+    }
+    if (free_lut == NULL || p.vsource < THERMISTOR_LUT_STEP_MV) {
+        ESP_LOGW(TAG, "no table for GPIO %d, computing temperature", th->gpio);
+        return NULL;
+    }
+
+    // last entry is at or over vsource
+    p.cnt = (uint32_t) ceilf(p.vsource / THERMISTOR_LUT_STEP_MV) + 1;
+    p.centi = malloc(p.cnt * sizeof(int16_t));
+    if (p.centi == NULL) {
+        ESP_LOGE(TAG, "can't allocate %d bytes", (int) (p.cnt * sizeof(int16_t)));
+        return NULL;
+    }
+    for (int i = 0; i < p.cnt; i++) {
+        // ends are faulty readings (short or open), keep them finite
+        float vout = i * THERMISTOR_LUT_STEP_MV;
+        if (vout < 1)
+            vout = 1;
+        if (vout > p.vsource - 1)
+            vout = p.vsource - 1;
+        float r;
+        float centi = roundf(steinhart_celsius(&p, vout, &r) * 100);
+        if (!(centi > INT16_MIN))
+            centi = INT16_MIN;
+        else if (!(centi < INT16_MAX))
+            centi = INT16_MAX;
+        p.centi[i] = centi;
+    }
+
+    p.users = 1;
+    *free_lut = p;
+    lut_bytes += p.cnt * sizeof(int16_t);
+    ESP_LOGI(TAG, "table #%d for R %.0f/%.0f B %.0f: %d bytes, %d bytes total",
+             (int) (free_lut - luts), p.serial_resistance, p.nominal_resistance, p.beta_val,
+             (int) (p.cnt * sizeof(int16_t)), (int) lut_bytes);
+    return free_lut;
+}
+
+void thermistor_lut_release(const thermistor_lut_t *lut)
+{
+    if (lut == NULL)
+        return;
+    thermistor_lut_t *p = &luts[lut - luts];
+    if (--p->users > 0)
+        return;
+    lut_bytes -= p->cnt * sizeof(int16_t);
+    ESP_LOGI(TAG, "table #%d freed, %d bytes total", (int) (p - luts), (int) lut_bytes);
+    free(p->centi);
+    *p = (thermistor_lut_t) {0};
+}
+
+// parameters changed after table was bound
+static void lut_rebind(thermistor_handle_t* th)
+{
+    thermistor_lut_t p;
+    lut_params(th, &p);
+    if (th->lut == NULL || lut_match(th->lut, &p))
+        return;
+    // old slot can be reused when this was the last user
+    thermistor_lut_release(th->lut);
+    th->lut = thermistor_lut(th);
+}
+
+size_t thermistor_lut_bytes()
+{
+    return lut_bytes;
+}
+
+int thermistor_vout_to_centi(thermistor_handle_t* th, uint32_t vout)
+{
+    lut_rebind(th);
+    const thermistor_lut_t *lut = th->lut;
+    if (lut == NULL) {
+        float c = roundf(thermistor_vout_to_celsius(th, vout) * 100);
+        return (c > INT32_MIN && c < INT32_MAX)? (int) c : INT32_MIN;
+    }
+
+    uint32_t vsource = lut->vsource;
+    th->t_resistance = (vout < vsource)?
+        (uint32_t) lut->serial_resistance * vout / (vsource - vout) : INFINITY;
+
+    uint32_t i = vout / THERMISTOR_LUT_STEP_MV;
+    if (i >= lut->cnt - 1)
+        return lut->centi[lut->cnt - 1];
+    int a = lut->centi[i];
+    int b = lut->centi[i+1];
+    int frac = vout % THERMISTOR_LUT_STEP_MV;
+    return a + (b - a) * frac / THERMISTOR_LUT_STEP_MV;
+}
+
+float thermistor_vout_to_celsius(thermistor_handle_t* th, uint32_t vout)
+{
+    lut_rebind(th);
+    if (th->lut != NULL)
+        return thermistor_vout_to_centi(th, vout) / 100.0f;
+
+    thermistor_lut_t p;
+    lut_params(th, &p);
+    return steinhart_celsius(&p, vout, &th->t_resistance);
+}
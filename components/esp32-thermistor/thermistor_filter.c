@@ -0,0 +1,159 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Adam Sloboda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file thermistor_filter.c
+ * @brief Outlier filtering of raw ADC samples, no ADC access (runs on host too).
+ */
+
+#include "thermistor.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "esp_log.h"
+static const char* TAG = "drv_thr";
+
+// 12-bit codes
+#define BINS ((1 << 12) / THERMISTOR_BIN + 1)
+
+static inline void swap(int *a, int *b)
+{
+    int t = *a;
+    *a = *b;
+    *b = t;
+}
+
+// k-th smallest value, reorders values (quickselect, median of three pivot)
+static int select_kth(int *values, int cnt, int k)
+{
+    int lo = 0;
+    int hi = cnt - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (values[mid] < values[lo])
+            swap(&values[mid], &values[lo]);
+        if (values[hi] < values[lo])
+            swap(&values[hi], &values[lo]);
+        if (values[hi] < values[mid])
+            swap(&values[hi], &values[mid]);
+        int pivot = values[mid];
+
+        int i = lo;
+        int j = hi;
+        while (i <= j) {
+            while (values[i] < pivot)
+                i++;
+            while (values[j] > pivot)
+                j--;
+            if (i <= j) {
+                swap(&values[i], &values[j]);
+                i++;
+                j--;
+            }
+        }
+        if (k <= j)
+            hi = j;
+        else if (k >= i)
+            lo = i;
+        else
+            break;
+    }
+    return values[k];
+}
+
+void thermistor_filter(thermistor_handle_t* th, int *values, int cnt, thermistor_filter_t *f)
+{
+    assert(cnt > 0 && cnt <= UINT8_MAX);
+    int min = values[0];
+    int max = values[0];
+    for (int i = 1; i < cnt; i++) {
+        if (values[i] < min)
+            min = values[i];
+        else if (values[i] > max)
+            max = values[i];
+    }
+    assert(min >= 0 && max < (1 << 12));
+
+    // average can jump, there are outliers
+    f->median = select_kth(values, cnt, cnt/2);
+
+    // counting on median falling into more precise group of values
+    // and outliers being more extreme to be successfully filtered,
+    // previous result is more stable than median of current samples
+    int median = th->vmedian? th->vmedian : f->median;
+    uint32_t near_sum = 0;
+    int near = 0;
+    // histogram from lowest sample
+    uint8_t bins[BINS] = {0};
+    for (int i = 0; i < cnt; i++) {
+        bins[(values[i] - min) / THERMISTOR_BIN] += 1;
+        if (abs(median - values[i]) < THERMISTOR_NEAR) {
+            near_sum += values[i];
+            near += 1;
+        }
+    }
+
+    int nbins = (max - min) / THERMISTOR_BIN + 1;
+    int top = 0;
+    for (int b = 1; b < nbins; b++)
+        if (bins[b] > bins[top])
+            top = b;
+    f->dominant = min + top * THERMISTOR_BIN;
+
+    uint32_t reading;
+    f->near = near;
+    if (near) {
+        reading = near_sum / near;
+        th->vmedian = reading;
+    } else {
+        // this can result in a large jump
+        // take middle of largest histogram group as result
+        reading = f->dominant + THERMISTOR_BIN/2;
+    }
+
+    // result is average of populated bins, near median result is added
+    // to the sum as it always was (shifts result by about 1/samples)
+    int threshold = THERMISTOR_BIN_MIN * (cnt/64);
+    uint32_t sum = reading;
+    int samples = 0;
+    for (int i = 0; i < cnt; i++) {
+        if (bins[(values[i] - min) / THERMISTOR_BIN] >= threshold) {
+            sum += values[i];
+            samples += 1;
+        }
+    }
+    f->outliers = cnt - samples;
+    // prevent division by zero
+    if (!samples)
+        ESP_LOGE(TAG, "no samples GPIO %d", th->gpio);
+    else
+        reading = sum / samples;
+    f->reading = reading;
+
+    ESP_LOGI(TAG, "median %d filtered %d, histogram %d outliers, %" PRIu32,
+             median, cnt - near, f->outliers, reading);
+}
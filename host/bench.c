@@ -0,0 +1,663 @@
+// benchmarks of heating/temperature core on host
+//
+// bench [filter] - runs benchmarks with filter in name
+// each result is best of BENCH_REPEAT runs to keep numbers reproducible,
+// every benchmark runs in its own process (zones can't be removed)
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define INCLUDE_THERMISTORS
+#include "config.h"
+#include "heating.h"
+#include "zone.h"
+#include "metrics.h"
+#include "metar.h"
+#include "auto.h"
+#include "thermistor.h"
+#include "util.h"
+#include "esp_log.h"
+
+#define BENCH_REPEAT 5
+
+typedef struct {
+    const char *name;
+    // returns number of operations done
+    uint64_t (*run)(void *arg);
+    void *arg;
+    // untimed, before every run
+    void (*setup)(void *arg);
+} bench_t;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// keeps results alive
+static volatile uintptr_t sink;
+
+static void bench_run(bench_t *b)
+{
+    double best = INFINITY;
+    uint64_t ops = 0;
+    for (int i=0; i<BENCH_REPEAT; i++) {
+        if (b->setup != NULL)
+            b->setup(b->arg);
+        uint64_t start = now_ns();
+        ops = b->run(b->arg);
+        double ns = (double) (now_ns() - start) / ops;
+        if (ns < best)
+            best = ns;
+    }
+    printf("%-24s %10" PRIu64 " %12.1f ns/op\n", b->name, ops, best);
+}
+
+// returns 0 when benchmark didn't fail
+static int bench_report(bench_t *b)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        bench_run(b);
+        fflush(stdout);
+        _exit(0);
+    }
+
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        return 0;
+    printf("%-24s failed\n", b->name);
+    return 1;
+}
+
+// zones
+
+static char zone_names[HEATING_ZONES_MAX][member_size(heating_t, name)];
+
+static int zones_cnt = 0;
+
+// zones can't be removed, benchmark process starts without them
+static void zones_create(int cnt)
+{
+    for (; zones_cnt<cnt; zones_cnt++) {
+        snprintf(zone_names[zones_cnt], sizeof(zone_names[zones_cnt]), "zone%d", zones_cnt);
+        heating_relay(zone_names[zones_cnt], 18);
+    }
+}
+
+#define ZONE_LOOKUPS 1000000
+static uint64_t bench_zone_find(void *arg)
+{
+    int cnt = (intptr_t) arg;
+    zones_create(cnt);
+    for (int i=0; i<ZONE_LOOKUPS; i++)
+        sink += (uintptr_t) heating_find(zone_names[(i * 7) % cnt], 0);
+    return ZONE_LOOKUPS;
+}
+
+static uint64_t bench_zone_miss(void *arg)
+{
+    int cnt = (intptr_t) arg;
+    zones_create(cnt);
+    for (int i=0; i<ZONE_LOOKUPS; i++)
+        sink += (uintptr_t) heating_find("missing", 0);
+    return ZONE_LOOKUPS;
+}
+
+#define ZONE_ITERS 100000
+static uint64_t bench_zone_iter(void *arg)
+{
+    int cnt = (intptr_t) arg;
+    zones_create(cnt);
+    for (int i=0; i<ZONE_ITERS; i++) {
+        iter_t iter = heating_iter();
+        heating_t *data;
+        while ((iter = heating_next(iter, &data)) != NULL)
+            sink += data->relay;
+    }
+    return ZONE_ITERS;
+}
+
+#define ZONE_UPDATES 200000
+static uint64_t bench_zone_update(void *arg)
+{
+    int cnt = (intptr_t) arg;
+    zones_create(cnt);
+    for (int i=0; i<ZONE_UPDATES; i++)
+        sink += (uintptr_t) heating_temp_val(zone_names[i % cnt], 20.0 + (i % 50) / 10.0, 1);
+    return ZONE_UPDATES;
+}
+
+// thermostat UDP protocol
+
+#define UDP_PACKETS 200000
+static uint64_t bench_udp_encode(void *arg)
+{
+    char buf[128];
+    for (int i=0; i<UDP_PACKETS; i++)
+        sink += th_prepare(buf, '!', "zone1", 21.5, 22.0);
+    return UDP_PACKETS;
+}
+
+// fresh datagrams, replay protection would reject repeated ones
+#define UDP_DGRAM 128
+static char (*udp_dgrams)[UDP_DGRAM];
+static int udp_dgram_len;
+
+static void setup_udp_decode(void *arg)
+{
+    if (udp_dgrams == NULL)
+        udp_dgrams = malloc(UDP_PACKETS * UDP_DGRAM);
+    assert(udp_dgrams != NULL);
+    for (int i=0; i<UDP_PACKETS; i++)
+        udp_dgram_len = th_prepare(udp_dgrams[i], '!', "zone1", 21.5, 22.0);
+}
+
+static uint64_t bench_udp_decode(void *arg)
+{
+    // decoding is in place, replay needs a copy
+    char copy[UDP_DGRAM];
+    char *dec;
+    memcpy(copy, udp_dgrams[0], udp_dgram_len);
+    assert(th_decode(udp_dgrams[0], udp_dgram_len, &dec) == 0);
+#if HEATING_UDP_AEAD
+    assert(th_decode(copy, udp_dgram_len, &dec) == 4);
+#endif
+    for (int i=1; i<UDP_PACKETS; i++)
+        sink += th_decode(udp_dgrams[i], udp_dgram_len, &dec);
+    return UDP_PACKETS;
+}
+
+// all zones with one datagram per zone like '*', ops are zones
+static uint64_t bench_udp_zones(void *arg)
+{
+    int cnt = (intptr_t) arg;
+    zones_create(cnt);
+    char buf[128];
+    for (int i=0; i<UDP_PACKETS/cnt; i++) {
+        iter_t iter = heating_iter();
+        heating_t *data;
+        while ((iter = heating_next(iter, &data)) != NULL)
+            sink += th_prepare(buf, '!', data->name, data->val, data->set);
+    }
+    return UDP_PACKETS/cnt*cnt;
+}
+
+// batch of all zones decodes back
+static void udp_batch_check(int cnt)
+{
+    zones_create(cnt);
+    char buf[TH_BATCH_SIZE];
+    char *dec;
+    iter_t iter = heating_iter();
+    th_batch_t hdr = {0};
+    int zones = 0;
+    while (iter != NULL) {
+        int n = th_batch(buf, &iter, &hdr);
+        assert(th_decode(buf, n, &dec) == 0);
+        assert(dec[0] == '&' && dec[1] == TH_BATCH_VERSION);
+        assert(!(dec[3] & TH_BATCH_MORE) == (iter == NULL));
+        for (int i=0; i<(uint8_t) dec[2]; i++)
+            assert(strcmp(dec + TH_BATCH_HEADER + i * TH_BATCH_ENTRY, zone_names[zones + i]) == 0);
+        zones += (uint8_t) dec[2];
+    }
+    assert(zones == cnt);
+
+    // only zone changed after since
+    static int toggle = 0;
+    heating_t *data = heating_temp_set(zone_names[0], (toggle++ % 2)? 21.0 : 22.0, 0);
+    hdr = (th_batch_t) {.since = data->gen - 1};
+    iter = heating_iter();
+    th_decode(buf, th_batch(buf, &iter, &hdr), &dec);
+    assert(dec[2] == 1 && iter == NULL);
+
+    // request
+    int n = th_batch(buf, NULL, &hdr);
+    assert(th_decode(buf, n, &dec) == 0 && dec[0] == '&' && dec[2] == 0 && !(dec[3] & TH_BATCH_REPLY));
+}
+
+// all zones batched like '&', ops are zones
+static uint64_t bench_udp_batch(void *arg)
+{
+    int cnt = (intptr_t) arg;
+    udp_batch_check(cnt);
+    char buf[TH_BATCH_SIZE];
+    for (int i=0; i<UDP_PACKETS/cnt; i++) {
+        iter_t iter = heating_iter();
+        th_batch_t hdr = {0};
+        while (iter != NULL)
+            sink += th_batch(buf, &iter, &hdr);
+    }
+    return UDP_PACKETS/cnt*cnt;
+}
+
+// METAR
+
+static char metar_sample[] =
+    "2024/01/15 12:00\n"
+    "LZIB 151200Z 24012G25KT 210V280 9999 -SHRA FEW012 SCT030CB BKN050 M02/M05 Q1012 "
+    "BECMG 27015KT NSW=\n";
+
+#define METAR_DECODES 20000
+static uint64_t bench_metar_decode(void *arg)
+{
+    metar_t *metar = arg;
+    char buf[sizeof(metar_sample)];
+    for (int i=0; i<METAR_DECODES; i++) {
+        // decoding writes into buffer
+        memcpy(buf, metar_sample, sizeof(buf));
+        sink += (uintptr_t) metar_decode(metar, buf, sizeof(buf), NULL);
+    }
+    return METAR_DECODES;
+}
+
+// autoconfiguration
+
+static char config_sample[] =
+    "# generated\n"
+    "hostname=livingroom\n"
+    "controller_ip=10.0.0.2\n"
+    "graphite_ip=10.0.0.9\n"
+    "graphite_port=2003\n"
+    "temp_zone_adc=room=36\n"
+    "temp_zone_relay=room=18\n"
+    "th.udp.port=1024\n"
+    "loglevel=*=3\n"
+    "lograte=wifi=5,50\n"
+    "mode_default=1\n"
+    "oled_power=1\n"
+    "module=metar=1\n"
+    "\n"
+    "STOP\n";
+
+#define CONFIG_PARSES 200000
+static uint64_t bench_config_pair(void *arg)
+{
+    char buf[sizeof(config_sample)];
+    for (int i=0; i<CONFIG_PARSES; i++) {
+        memcpy(buf, config_sample, sizeof(buf));
+        char *start = buf;
+        char *name, *value;
+        while ((start = config_pair(start, buf + sizeof(buf), &name, &value)) != NULL)
+            sink += (uintptr_t) value;
+    }
+    return CONFIG_PARSES;
+}
+
+// handlers are matched but values don't exist as keys
+static char config_unknown[] =
+    "x.hostname=livingroom\n"
+    "x.controller_ip=10.0.0.2\n"
+    "x.graphite_ip=10.0.0.9\n"
+    "x.graphite_port=2003\n"
+    "x.temp_zone_adc=room=36\n"
+    "x.temp_zone_relay=room=18\n"
+    "x.loglevel=*=3\n"
+    "x.mode_default=1\n";
+
+#define CONFIG_APPLIES 100000
+static uint64_t bench_config_apply(void *arg)
+{
+    char buf[sizeof(config_unknown)];
+    for (int i=0; i<CONFIG_APPLIES; i++) {
+        memcpy(buf, config_unknown, sizeof(buf));
+        config_apply(NULL, buf, sizeof(buf), 0, 1);
+    }
+    return CONFIG_APPLIES;
+}
+
+// history, sample every 10 s
+#define HISTORY_ADDS 1000000
+static uint64_t bench_history_add(void *arg)
+{
+    history_t *h = arg;
+    for (int i=0; i<HISTORY_ADDS; i++)
+        history_add(h, 21.0 + (i % 100) / 100.0, 1700000000 + i*10);
+    sink += h->fine[0];
+    return HISTORY_ADDS;
+}
+
+// zone serialization of 16 zones with full measurements as in /temp/get
+#define ZONE_FORMATS 20000
+static uint64_t bench_zone_format(void *arg)
+{
+    int fmt = (intptr_t) arg;
+    char out[ZONE_SIZE];
+    zones_create(16);
+    heating_t *zones[16];
+    for (int i=0; i<COUNT_OF(zones); i++) {
+        zones[i] = heating_find(zone_names[i], 0);
+        for (int j=0; j<COUNT_OF(zones[i]->vals); j++)
+            heating_temp_val(zone_names[i], 21.0 + j / 10.0, 0);
+    }
+    for (int i=0; i<ZONE_FORMATS; i++)
+        for (int j=0; j<COUNT_OF(zones); j++)
+            sink += zone_format(zones[j], fmt, ZONE_STATE | ZONE_CTL, out, sizeof(out));
+    return ZONE_FORMATS;
+}
+
+// metrics registry, histogram update and /metrics scrape
+#define METRIC_OBSERVES 1000000
+static const float metric_bounds[] = {0.05, 0.1, 0.25, 0.5, 1, 2.5, 5};
+static uint64_t bench_metric_observe(void *arg)
+{
+    metric_t *m = metric_histogram("bench_observe_seconds", "bench", metric_bounds, COUNT_OF(metric_bounds));
+    for (int i=0; i<METRIC_OBSERVES; i++)
+        metric_observe(m, (i % 600) / 100.0);
+    sink += m->cnt;
+    return METRIC_OBSERVES;
+}
+
+static int metric_sink(void *ctx, const char *buf, int len)
+{
+    *(size_t *) ctx += len;
+    return 0;
+}
+
+static int metric_text(void *ctx, const char *buf, int len)
+{
+    strncat(ctx, buf, len);
+    return 0;
+}
+
+// dropped gauge isn't exported, header stays with the next one of
+// the same name and slot is reused
+static void metrics_check()
+{
+    metric_t *a = metric_labeled(METRIC_GAUGE, "check_stack_bytes", "check", "task", "a");
+    metric_t *b = metric_labeled(METRIC_GAUGE, "check_stack_bytes", "check", "task", "b");
+    metric_drop(a);
+    int cnt = metrics_count();
+    char out[1024] = "";
+    metrics_write(metric_text, out);
+    assert(strstr(out, "task=\"a\"") == NULL && strstr(out, "task=\"b\"") != NULL);
+    assert(strstr(out, "# TYPE check_stack_bytes gauge\n") != NULL);
+    metric_t *c = metric_labeled(METRIC_GAUGE, "check_stack_bytes", "check", "task", "c");
+    assert(c == a && metrics_count() == cnt);
+    metric_drop(b);
+    metric_drop(c);
+}
+
+// 32 labeled gauges like task stacks
+#define METRIC_SCRAPES 10000
+static uint64_t bench_metrics_write(void *arg)
+{
+    char name[16];
+    for (int i=0; i<32; i++) {
+        snprintf(name, sizeof(name), "task%d", i);
+        metric_set(metric_labeled(METRIC_GAUGE, "bench_stack_bytes", "bench", "task", name), 1000 + i);
+    }
+    size_t len = 0;
+    for (int i=0; i<METRIC_SCRAPES; i++)
+        metrics_write(metric_sink, &len);
+    sink += len;
+    return METRIC_SCRAPES;
+}
+
+// thermistor sample filter
+
+#define FILTER_SAMPLES 64
+#define FILTER_SETS 256
+
+// previous qsort implementation, result has to stay the same
+static int filter_compar(const void *a, const void *b)
+{
+    return (*(int *)a - *(int *)b);
+}
+
+static uint32_t filter_qsort(uint32_t *vmedian, int *values)
+{
+    uint32_t adc_reading = 0;
+    qsort(values, FILTER_SAMPLES, sizeof(int), filter_compar);
+    int median = values[FILTER_SAMPLES/2];
+    int start_max = values[0];
+    int start_c = 0;
+    for (int start=values[0], i=0, c=0; start <= values[FILTER_SAMPLES-1]; start+=20) {
+        while (i < FILTER_SAMPLES && values[i] < start+20) {
+            c += 1;
+            i += 1;
+        }
+        if (c > start_c) {
+            start_c = c;
+            start_max = start;
+        }
+        c = 0;
+    }
+
+    int samples = 0;
+    if (*vmedian)
+        median = *vmedian;
+    for (int i = 0; i < FILTER_SAMPLES; i++) {
+        if (abs(median - values[i]) < 10) {
+            adc_reading += values[i];
+            samples += 1;
+        }
+    }
+    if (samples) {
+        adc_reading /= samples;
+        *vmedian = adc_reading;
+    } else {
+        adc_reading = start_max + 10;
+    }
+
+    samples = 0;
+    for (int start=values[0], i=0, start_c=0; start <= values[FILTER_SAMPLES-1]; start+=20) {
+        int start_i = i;
+        while (i < FILTER_SAMPLES && values[i] < start+20) {
+            start_c += 1;
+            i += 1;
+        }
+        if (start_c >= 10*(FILTER_SAMPLES/64)) {
+            for (int j=start_i; j<i; j++) {
+                adc_reading += values[j];
+                samples += 1;
+            }
+        }
+        start_c = 0;
+    }
+    if (samples)
+        adc_reading /= samples;
+    return adc_reading;
+}
+
+// ADC noise of a few codes with occasional spikes, some sets have
+// a second cluster nearby or mostly outliers
+static int filter_sets[FILTER_SETS][FILTER_SAMPLES];
+
+static void filter_sets_init()
+{
+    srandom(1);
+    for (int s=0; s<FILTER_SETS; s++) {
+        int base = 1500 + random() % 1500;
+        int spikes = (s % 4 == 3)? 40 : s % 8;
+        for (int i=0; i<FILTER_SAMPLES; i++) {
+            int v = base + random() % 9 - 4 + random() % 9 - 4;
+            if (s % 5 == 4 && random() % 3 == 0)
+                v += 30;
+            if (random() % FILTER_SAMPLES < spikes)
+                v += random() % 600 - 300;
+            filter_sets[s][i] = v;
+        }
+    }
+}
+
+// vmedian carries over between sets of same sensor
+static void filter_check()
+{
+    thermistor_handle_t th = {0};
+    uint32_t vmedian = 0;
+    int a[FILTER_SAMPLES], b[FILTER_SAMPLES];
+    for (int s=0; s<FILTER_SETS; s++) {
+        if (s % 16 == 0) {
+            th.vmedian = 0;
+            vmedian = 0;
+        }
+        memcpy(a, filter_sets[s], sizeof(a));
+        memcpy(b, filter_sets[s], sizeof(b));
+        thermistor_filter_t f;
+        thermistor_filter(&th, a, FILTER_SAMPLES, &f);
+        uint32_t expected = filter_qsort(&vmedian, b);
+        assert(f.reading == expected);
+        assert(f.median == b[FILTER_SAMPLES/2]);
+        assert(th.vmedian == vmedian);
+    }
+}
+
+static uint64_t bench_filter(void *arg)
+{
+    thermistor_handle_t th = {0};
+    int values[FILTER_SAMPLES];
+    for (int s=0; s<FILTER_SETS; s++) {
+        memcpy(values, filter_sets[s], sizeof(values));
+        thermistor_filter_t f;
+        thermistor_filter(&th, values, FILTER_SAMPLES, &f);
+        sink += f.reading;
+    }
+    return FILTER_SETS;
+}
+
+static uint64_t bench_filter_qsort(void *arg)
+{
+    uint32_t vmedian = 0;
+    int values[FILTER_SAMPLES];
+    for (int s=0; s<FILTER_SETS; s++) {
+        memcpy(values, filter_sets[s], sizeof(values));
+        sink += filter_qsort(&vmedian, values);
+    }
+    return FILTER_SETS;
+}
+
+// thermistor conversion
+
+static thermistor_handle_t conv_th[2];
+
+static void conv_init(thermistor_handle_t *th, thermistor_t *def)
+{
+    *th = (thermistor_handle_t) {
+        .serial_resistance = def->serial_resistance,
+        .nominal_resistance = def->nominal_resistance,
+        .nominal_temperature = def->nominal_temperature,
+        .beta_val = def->beta_val,
+        .vsource = def->vsource,
+    };
+}
+
+// table error within valid range (0-45 C), both definitions share
+// one table each however many thermistors use them
+static void conv_check()
+{
+    thermistor_t *defs[] = {&th_4k7, &th_1k};
+    for (int d=0; d<COUNT_OF(defs); d++) {
+        thermistor_handle_t th, tab;
+        conv_init(&th, defs[d]);
+        conv_init(&tab, defs[d]);
+        tab.lut = thermistor_lut(&tab);
+        assert(tab.lut != NULL && thermistor_lut(&th) == tab.lut);
+        conv_th[d] = tab;
+
+        float err = 0;
+        for (uint32_t mv=1; mv<th.vsource; mv++) {
+            float c = thermistor_vout_to_celsius(&th, mv);
+            if (c < 0 || c > 45)
+                continue;
+            float e = fabsf(thermistor_vout_to_celsius(&tab, mv) - c);
+            if (e > err)
+                err = e;
+        }
+        printf("thermistor table %d: max error %.3f C, %zu bytes total\n", d, err, thermistor_lut_bytes());
+        assert(err < 0.05);
+
+        // changed serial resistor gets its own table, freed with last user
+        size_t bytes = thermistor_lut_bytes();
+        thermistor_handle_t moved = tab;
+        moved.lut = thermistor_lut(&moved);
+        moved.serial_resistance *= 2;
+        thermistor_vout_to_celsius(&moved, 1000);
+        assert(moved.lut != NULL && moved.lut != tab.lut && moved.lut->serial_resistance == moved.serial_resistance);
+        assert(thermistor_lut_bytes() > bytes);
+        thermistor_lut_release(moved.lut);
+        assert(thermistor_lut_bytes() == bytes);
+    }
+}
+
+#define CONVS 1000000
+static uint64_t bench_conv(void *arg)
+{
+    thermistor_handle_t th = conv_th[0];
+    if (arg == NULL)
+        th.lut = NULL;
+    for (int i=0; i<CONVS; i++)
+        sink += (uintptr_t) thermistor_vout_to_celsius(&th, 1000 + i % 1300);
+    return CONVS;
+}
+
+int main(int argc, char *argv[])
+{
+    char *filter = (argc > 1)? argv[1] : "";
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    HEATING_UDP_SECRET = "bench";
+    th_aes_init();
+    auto_init();
+    metar_t *metar = metar_new("LZIB", 0);
+    char buf[sizeof(metar_sample)];
+    memcpy(buf, metar_sample, sizeof(buf));
+    metar_decode(metar, buf, sizeof(buf), NULL);
+    assert(metar->pressure == 1012);
+    filter_sets_init();
+    filter_check();
+    conv_check();
+    metrics_check();
+
+    bench_t benches[] = {
+        {"zone_find_16", bench_zone_find, (void *) 16},
+        {"zone_find_64", bench_zone_find, (void *) 64},
+        {"zone_find_256", bench_zone_find, (void *) 256},
+        {"zone_miss_256", bench_zone_miss, (void *) 256},
+        {"zone_iter_256", bench_zone_iter, (void *) 256},
+        {"zone_update_16", bench_zone_update, (void *) 16},
+        {"udp_encode", bench_udp_encode, NULL},
+        {"udp_decode", bench_udp_decode, NULL, setup_udp_decode},
+        {"udp_zones_16", bench_udp_zones, (void *) 16},
+        {"udp_batch_16", bench_udp_batch, (void *) 16},
+        {"udp_zones_64", bench_udp_zones, (void *) 64},
+        {"udp_batch_64", bench_udp_batch, (void *) 64},
+        {"metar_decode", bench_metar_decode, metar},
+        {"config_pair", bench_config_pair, NULL},
+        {"config_apply", bench_config_apply, NULL},
+        {"history_add", bench_history_add, history_new()},
+        {"zone_text_16", bench_zone_format, (void *) ZONE_TEXT},
+        {"zone_json_16", bench_zone_format, (void *) ZONE_JSON},
+        {"zone_cbor_16", bench_zone_format, (void *) ZONE_CBOR},
+        {"zone_bin_16", bench_zone_format, (void *) ZONE_BIN},
+        {"metric_observe", bench_metric_observe, NULL},
+        {"metrics_write", bench_metrics_write, NULL},
+        {"thermistor_filter", bench_filter, NULL},
+        {"thermistor_qsort", bench_filter_qsort, NULL},
+        {"thermistor_celsius", bench_conv, NULL},
+        {"thermistor_table", bench_conv, (void *) 1},
+    };
+
+    char dgram[TH_BATCH_SIZE];
+    th_batch_t hdr = {0};
+    printf("thermostat UDP %s: '!' %d bytes, '&' request %d bytes\n",
+           HEATING_UDP_AEAD? "AES-GCM" : HEATING_UDP_ENC? "AES-CBC" : "cleartext",
+           th_prepare(dgram, '!', "zone1", 21.5, 22.0), th_batch(dgram, NULL, &hdr));
+
+    printf("%-24s %10s %15s\n", "benchmark", "ops", "best");
+    int failed = 0;
+    for (int i=0; i<COUNT_OF(benches); i++)
+        if (strstr(benches[i].name, filter) != NULL)
+            failed += bench_report(&benches[i]);
+    return failed > 0;
+}
@@ -0,0 +1,635 @@
+// ESP-IDF, FreeRTOS and mbedtls functions for host build
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "mbedtls/aes.h"
+#include "mbedtls/base64.h"
+#include "mbedtls/gcm.h"
+#include <openssl/evp.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "esp_netif.h"
+#include "esp_heap_caps.h"
+#include "esp_http_client.h"
+#include "esp_http_server.h"
+#include "driver/gpio.h"
+#include "nvs.h"
+
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t start_us = 0;
+
+__attribute__((constructor))
+static void shim_init()
+{
+    start_us = now_us();
+}
+
+// FreeRTOS
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (now_us() - start_us) / (1000 * portTICK_PERIOD_MS);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    uint64_t ms = pdTICKS_TO_MS(ticks);
+    struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000};
+    nanosleep(&ts, NULL);
+}
+
+typedef struct {
+    pthread_t thread;
+    char name[configMAX_TASK_NAME_LEN];
+    TaskFunction_t code;
+    void *param;
+} shim_task_t;
+
+static __thread shim_task_t *current = NULL;
+static shim_task_t main_task = {.name = "main"};
+
+static void *task_start(void *arg)
+{
+    current = arg;
+    current->code(current->param);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, configSTACK_DEPTH_TYPE stack,
+                                   void *param, UBaseType_t prio, TaskHandle_t *task, BaseType_t core)
+{
+    shim_task_t *t = calloc(1, sizeof(shim_task_t));
+    if (t == NULL)
+        return pdFAIL;
+    strncpy(t->name, name, sizeof(t->name) - 1);
+    t->code = code;
+    t->param = param;
+    if (pthread_create(&t->thread, NULL, task_start, t) != 0) {
+        free(t);
+        return pdFAIL;
+    }
+    pthread_detach(t->thread);
+    if (task != NULL)
+        *task = t;
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, configSTACK_DEPTH_TYPE stack,
+                       void *param, UBaseType_t prio, TaskHandle_t *task)
+{
+    return xTaskCreatePinnedToCore(code, name, stack, param, prio, task, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == current)
+        pthread_exit(NULL);
+    // other tasks are not cancelled, modules stop on their own
+}
+
+void vTaskEndScheduler(void)
+{
+    exit(0);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return (current != NULL)? current : &main_task;
+}
+
+char *pcTaskGetName(TaskHandle_t task)
+{
+    shim_task_t *t = (task != NULL)? task : xTaskGetCurrentTaskHandle();
+    return t->name;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    return 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+    vTaskDelay(wait);
+    return 0;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    return pdPASS;
+}
+
+// mutex is binary semaphore, priority inheritance doesn't matter here
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t max;
+} shim_sem_t;
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    shim_sem_t *sem = calloc(1, sizeof(shim_sem_t));
+    if (sem == NULL)
+        return NULL;
+    pthread_mutex_init(&sem->lock, NULL);
+    pthread_cond_init(&sem->cond, NULL);
+    sem->count = initial;
+    sem->max = max;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t wait)
+{
+    shim_sem_t *sem = handle;
+    BaseType_t ret = pdTRUE;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t ns = ts.tv_nsec + (uint64_t) pdTICKS_TO_MS(wait) * 1000000;
+    ts.tv_sec += ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+
+    pthread_mutex_lock(&sem->lock);
+    while (sem->count == 0) {
+        if (wait == 0 ||
+            (wait != portMAX_DELAY && pthread_cond_timedwait(&sem->cond, &sem->lock, &ts) != 0)) {
+            ret = pdFALSE;
+            goto CLEANUP;
+        }
+        if (wait == portMAX_DELAY)
+            pthread_cond_wait(&sem->cond, &sem->lock);
+    }
+    sem->count -= 1;
+
+CLEANUP:
+    pthread_mutex_unlock(&sem->lock);
+    return ret;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle)
+{
+    shim_sem_t *sem = handle;
+    BaseType_t ret = pdFALSE;
+    pthread_mutex_lock(&sem->lock);
+    if (sem->count < sem->max) {
+        sem->count += 1;
+        pthread_cond_signal(&sem->cond);
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return ret;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t handle)
+{
+    shim_sem_t *sem = handle;
+    pthread_mutex_destroy(&sem->lock);
+    pthread_cond_destroy(&sem->cond);
+    free(sem);
+}
+
+// timers, callers fall back to work without them
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t reload, void *id,
+                           TimerCallbackFunction_t callback)
+{
+    return NULL;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t wait)
+{
+    return pdFALSE;
+}
+
+// logging, only default level and "*"
+
+static esp_log_level_t log_level = ESP_LOG_WARN;
+static vprintf_like_t log_vprintf = vprintf;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    if (strcmp(tag, "*") == 0)
+        log_level = level;
+}
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func)
+{
+    vprintf_like_t orig = log_vprintf;
+    log_vprintf = func;
+    return orig;
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (now_us() - start_us) / 1000;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    if (level > log_level)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    log_vprintf(format, args);
+    va_end(args);
+}
+
+// system
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_NVS_NOT_FOUND:
+        return "ESP_ERR_NVS_NOT_FOUND";
+    }
+    return "ESP_FAIL";
+}
+
+esp_reset_reason_t esp_reset_reason(void)
+{
+    return ESP_RST_POWERON;
+}
+
+void esp_restart(void)
+{
+    exit(0);
+}
+
+void esp_system_abort(const char *details)
+{
+    fprintf(stderr, "abort: %s\n", details);
+    abort();
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return 0;
+}
+
+void heap_caps_get_info(multi_heap_info_t *info, uint32_t caps)
+{
+    memset(info, 0, sizeof(multi_heap_info_t));
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    return 0;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return now_us() - start_us;
+}
+
+esp_err_t esp_efuse_mac_get_default(uint8_t *mac)
+{
+    static const uint8_t host[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    memcpy(mac, host, sizeof(host));
+    return ESP_OK;
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    return esp_efuse_mac_get_default(mac);
+}
+
+uint32_t esp_random(void)
+{
+    uint32_t r;
+    esp_fill_random(&r, sizeof(r));
+    return r;
+}
+
+void esp_fill_random(void *buf, size_t len)
+{
+    FILE *f = fopen("/dev/urandom", "r");
+    if (f == NULL || fread(buf, 1, len, f) != len)
+        abort();
+    fclose(f);
+}
+
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key)
+{
+    return NULL;
+}
+
+esp_netif_t *esp_netif_next(esp_netif_t *esp_netif)
+{
+    return NULL;
+}
+
+esp_err_t esp_netif_set_hostname(esp_netif_t *esp_netif, const char *hostname)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_get_hostname(esp_netif_t *esp_netif, const char **hostname)
+{
+    return ESP_FAIL;
+}
+
+// peripherals and storage are not there
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    return 0;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_entry_find(const char *part_name, const char *namespace_name, nvs_type_t type, nvs_iterator_t *output_iterator)
+{
+    *output_iterator = NULL;
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_entry_next(nvs_iterator_t *iterator)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_entry_info(const nvs_iterator_t iterator, nvs_entry_info_t *out_info)
+{
+    return ESP_ERR_INVALID_ARG;
+}
+
+void nvs_release_iterator(nvs_iterator_t iterator)
+{
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_get_i8(nvs_handle_t handle, const char *key, int8_t *out_value)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return 0;
+}
+
+int64_t esp_http_client_get_content_length(esp_http_client_handle_t client)
+{
+    return 0;
+}
+
+// responses go to stdout
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    if (buf == NULL)
+        return ESP_OK;
+    if (buf_len == HTTPD_RESP_USE_STRLEN)
+        buf_len = strlen(buf);
+    fwrite(buf, 1, buf_len, stdout);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_sendstr_chunk(httpd_req_t *r, const char *str)
+{
+    return httpd_resp_send_chunk(r, str, HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    return ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size)
+{
+    size_t klen = strlen(key);
+    for (const char *p = qry; p != NULL && *p != '\0'; p = strchr(p, '&'), p = (p)? p + 1 : NULL) {
+        if (strncmp(p, key, klen) != 0 || p[klen] != '=')
+            continue;
+        const char *v = p + klen + 1;
+        size_t len = strcspn(v, "&");
+        if (len >= val_size) {
+            memcpy(val, v, val_size - 1);
+            val[val_size - 1] = '\0';
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(val, v, len);
+        val[len] = '\0';
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+// mbedtls, ESP32 hardware AES uses the same key for both directions
+// (espire only calls mbedtls_aes_setkey_enc)
+
+void mbedtls_aes_init(mbedtls_aes_context *ctx)
+{
+    memset(ctx, 0, sizeof(mbedtls_aes_context));
+}
+
+void mbedtls_aes_free(mbedtls_aes_context *ctx)
+{
+    memset(ctx, 0, sizeof(mbedtls_aes_context));
+}
+
+int mbedtls_aes_setkey_enc(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits)
+{
+    if (AES_set_encrypt_key(key, keybits, &ctx->enc) != 0)
+        return -1;
+    return AES_set_decrypt_key(key, keybits, &ctx->dec);
+}
+
+int mbedtls_aes_setkey_dec(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits)
+{
+    return mbedtls_aes_setkey_enc(ctx, key, keybits);
+}
+
+int mbedtls_aes_crypt_cbc(mbedtls_aes_context *ctx, int mode, size_t length, unsigned char iv[16],
+                          const unsigned char *input, unsigned char *output)
+{
+    if (length % 16)
+        return -1;
+    AES_cbc_encrypt(input, output, length, (mode == MBEDTLS_AES_ENCRYPT)? &ctx->enc : &ctx->dec,
+                    iv, (mode == MBEDTLS_AES_ENCRYPT)? AES_ENCRYPT : AES_DECRYPT);
+    return 0;
+}
+
+void mbedtls_gcm_init(mbedtls_gcm_context *ctx)
+{
+    memset(ctx, 0, sizeof(mbedtls_gcm_context));
+}
+
+void mbedtls_gcm_free(mbedtls_gcm_context *ctx)
+{
+    if (ctx->evp != NULL)
+        EVP_CIPHER_CTX_free(ctx->evp);
+    memset(ctx, 0, sizeof(mbedtls_gcm_context));
+}
+
+int mbedtls_gcm_setkey(mbedtls_gcm_context *ctx, mbedtls_cipher_id_t cipher,
+                       const unsigned char *key, unsigned int keybits)
+{
+    const EVP_CIPHER *evp_cipher = (keybits == 128)? EVP_aes_128_gcm() :
+        (keybits == 192)? EVP_aes_192_gcm() : EVP_aes_256_gcm();
+    if (cipher != MBEDTLS_CIPHER_ID_AES)
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    if (ctx->evp == NULL && (ctx->evp = EVP_CIPHER_CTX_new()) == NULL)
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    // direction is chosen per message, key stays
+    if (EVP_CipherInit_ex(ctx->evp, evp_cipher, NULL, key, NULL, -1) != 1)
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    return 0;
+}
+
+static int gcm_crypt(mbedtls_gcm_context *ctx, int enc, size_t length,
+                     const unsigned char *iv, size_t iv_len,
+                     const unsigned char *add, size_t add_len,
+                     const unsigned char *input, unsigned char *output)
+{
+    int len;
+    if (ctx->evp == NULL)
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    if (EVP_CipherInit_ex(ctx->evp, NULL, NULL, NULL, NULL, enc) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx->evp, EVP_CTRL_GCM_SET_IVLEN, iv_len, NULL) != 1 ||
+        EVP_CipherInit_ex(ctx->evp, NULL, NULL, NULL, iv, enc) != 1)
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    if (add_len > 0 && EVP_CipherUpdate(ctx->evp, NULL, &len, add, add_len) != 1)
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    if (length > 0 && EVP_CipherUpdate(ctx->evp, output, &len, input, length) != 1)
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    return 0;
+}
+
+int mbedtls_gcm_crypt_and_tag(mbedtls_gcm_context *ctx, int mode, size_t length,
+                              const unsigned char *iv, size_t iv_len,
+                              const unsigned char *add, size_t add_len,
+                              const unsigned char *input, unsigned char *output,
+                              size_t tag_len, unsigned char *tag)
+{
+    int len;
+    int enc = mode == MBEDTLS_GCM_ENCRYPT;
+    int ret = gcm_crypt(ctx, enc, length, iv, iv_len, add, add_len, input, output);
+    if (ret != 0)
+        return ret;
+    if (!enc)
+        return 0;
+    if (EVP_CipherFinal_ex(ctx->evp, output + length, &len) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx->evp, EVP_CTRL_GCM_GET_TAG, tag_len, tag) != 1)
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    return 0;
+}
+
+int mbedtls_gcm_auth_decrypt(mbedtls_gcm_context *ctx, size_t length,
+                             const unsigned char *iv, size_t iv_len,
+                             const unsigned char *add, size_t add_len,
+                             const unsigned char *tag, size_t tag_len,
+                             const unsigned char *input, unsigned char *output)
+{
+    int len;
+    int ret = gcm_crypt(ctx, 0, length, iv, iv_len, add, add_len, input, output);
+    if (ret != 0)
+        return ret;
+    if (EVP_CIPHER_CTX_ctrl(ctx->evp, EVP_CTRL_GCM_SET_TAG, tag_len, (void *) tag) != 1 ||
+        EVP_CipherFinal_ex(ctx->evp, output + length, &len) != 1)
+        return MBEDTLS_ERR_GCM_AUTH_FAILED;
+    return 0;
+}
+
+#define MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL -0x002A
+#define MBEDTLS_ERR_BASE64_INVALID_CHARACTER -0x002C
+
+int mbedtls_base64_encode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen)
+{
+    size_t n = 4 * ((slen + 2) / 3);
+    *olen = n + 1;
+    if (dst == NULL || dlen < n + 1)
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    EVP_EncodeBlock(dst, src, slen);
+    *olen = n;
+    return 0;
+}
+
+// stops at first '\0' like callers expect from NUL padded buffers
+int mbedtls_base64_decode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen)
+{
+    slen = strnlen((const char *) src, slen);
+    if (slen % 4)
+        return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+
+    int pad = 0;
+    for (size_t i = slen; i > 0 && src[i - 1] == '=' && pad < 2; i--)
+        pad += 1;
+    size_t n = 3 * (slen / 4) - pad;
+    *olen = n;
+    if (dst == NULL || dlen < n)
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+
+    unsigned char *tmp = malloc(3 * (slen / 4) + 1);
+    if (tmp == NULL)
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    int ret = 0;
+    if (EVP_DecodeBlock(tmp, src, slen) < 0)
+        ret = MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+    else
+        memcpy(dst, tmp, n);
+    free(tmp);
+    return ret;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "esp_err.h"
+#include "hal/adc_types.h"
+
+typedef struct adc_oneshot_unit_ctx_t *adc_oneshot_unit_handle_t;
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "esp_err.h"
+
+typedef const char *esp_event_base_t;
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct esp_http_client *esp_http_client_handle_t;
+
+typedef enum {
+    HTTP_AUTH_TYPE_NONE = 0,
+    HTTP_AUTH_TYPE_BASIC,
+    HTTP_AUTH_TYPE_DIGEST,
+} esp_http_client_auth_type_t;
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client);
+int64_t esp_http_client_get_content_length(esp_http_client_handle_t client);
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "esp_http_server.h"
+
+typedef struct {
+    httpd_config_t httpd;
+} httpd_ssl_config_t;
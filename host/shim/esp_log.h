@@ -0,0 +1,44 @@
+#ifndef __SHIM_ESP_LOG_H__
+#define __SHIM_ESP_LOG_H__
+
+#include <stdint.h>
+#include <stdarg.h>
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+typedef int (*vprintf_like_t)(const char *, va_list);
+
+// default level is ESP_LOG_WARN, benchmarks shouldn't measure stderr
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func);
+uint32_t esp_log_timestamp(void);
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+    __attribute__ ((format (printf, 3, 4)));
+
+#define LOG_COLOR_E
+#define LOG_COLOR_W
+#define LOG_COLOR_I
+#define LOG_COLOR_D
+#define LOG_COLOR_V
+#define LOG_RESET_COLOR
+#define LOG_FORMAT(letter, format) #letter " (%lu) %s: " format "\n"
+
+#define ESP_LOG_LEVEL_(level, letter, tag, format, ...) \
+    esp_log_write(level, tag, LOG_FORMAT(letter, format), (unsigned long) esp_log_timestamp(), tag, ##__VA_ARGS__)
+#define ESP_LOGE(tag, format, ...) ESP_LOG_LEVEL_(ESP_LOG_ERROR, E, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_LEVEL_(ESP_LOG_WARN, W, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_LEVEL_(ESP_LOG_INFO, I, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_LEVEL_(ESP_LOG_DEBUG, D, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_LEVEL_(ESP_LOG_VERBOSE, V, tag, format, ##__VA_ARGS__)
+
+#define ESP_LOG_BUFFER_HEX(tag, buf, len) ((void) (buf))
+#define ESP_LOG_BUFFER_CHAR(tag, buf, len) ((void) (buf))
+
+#endif /* __SHIM_ESP_LOG_H__ */
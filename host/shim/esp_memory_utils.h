@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdbool.h>
+
+// there is no flash on host, nothing is in DROM
+static inline bool esp_ptr_in_drom(const void *p)
+{
+    (void) p;
+    return false;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "esp_err.h"
+
+typedef struct esp_netif_obj esp_netif_t;
+
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key);
+esp_err_t esp_netif_set_hostname(esp_netif_t *esp_netif, const char *hostname);
+esp_netif_t *esp_netif_next(esp_netif_t *esp_netif);
+esp_err_t esp_netif_get_hostname(esp_netif_t *esp_netif, const char **hostname);
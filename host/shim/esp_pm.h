@@ -0,0 +1,5 @@
+#pragma once
+
+#include "esp_err.h"
+
+typedef struct esp_pm_lock *esp_pm_lock_handle_t;
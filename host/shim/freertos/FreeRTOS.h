@@ -0,0 +1,74 @@
+#ifndef __SHIM_FREERTOS_H__
+#define __SHIM_FREERTOS_H__
+
+// FreeRTOS on top of pthreads, enough for the modules built on host
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+// newlib and lwip headers pulled in by ESP-IDF, sources rely on them
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+
+typedef uint32_t u32_t;
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t StackType_t;
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef void *QueueHandle_t;
+typedef void *TimerHandle_t;
+typedef void *EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define configTICK_RATE_HZ 100
+#define configMAX_TASK_NAME_LEN 16
+#define configSTACK_DEPTH_TYPE uint32_t
+#define portMAX_DELAY ((TickType_t) 0xffffffff)
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define pdMS_TO_TICKS(ms) ((TickType_t) (((uint64_t) (ms) * configTICK_RATE_HZ) / 1000))
+#define pdTICKS_TO_MS(t) ((TickType_t) (((uint64_t) (t) * 1000) / configTICK_RATE_HZ))
+#define tskNO_AFFINITY 0x7fffffff
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void) (mux))
+#define portEXIT_CRITICAL(mux) ((void) (mux))
+
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(TickType_t ticks);
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, configSTACK_DEPTH_TYPE stack,
+                       void *param, UBaseType_t prio, TaskHandle_t *task);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, configSTACK_DEPTH_TYPE stack,
+                                   void *param, UBaseType_t prio, TaskHandle_t *task, BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+void vTaskEndScheduler(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+char *pcTaskGetName(TaskHandle_t task);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+
+#endif /* __SHIM_FREERTOS_H__ */
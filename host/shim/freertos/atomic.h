@@ -0,0 +1,47 @@
+#ifndef __SHIM_ATOMIC_H__
+#define __SHIM_ATOMIC_H__
+
+#include "freertos/FreeRTOS.h"
+
+#define ATOMIC_COMPARE_AND_SWAP_SUCCESS 0x1U
+#define ATOMIC_COMPARE_AND_SWAP_FAILURE 0x0U
+
+static inline uint32_t Atomic_CompareAndSwap_u32(uint32_t volatile *dest, uint32_t exchange, uint32_t comparand)
+{
+    return __atomic_compare_exchange_n(dest, &comparand, exchange, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)?
+        ATOMIC_COMPARE_AND_SWAP_SUCCESS : ATOMIC_COMPARE_AND_SWAP_FAILURE;
+}
+
+static inline uint32_t Atomic_CompareAndSwapPointers_p32(void *volatile *dest, void *exchange, void *comparand)
+{
+    return __atomic_compare_exchange_n(dest, &comparand, exchange, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)?
+        ATOMIC_COMPARE_AND_SWAP_SUCCESS : ATOMIC_COMPARE_AND_SWAP_FAILURE;
+}
+
+// all return previous value
+static inline uint32_t Atomic_Add_u32(uint32_t volatile *addend, uint32_t count)
+{
+    return __atomic_fetch_add(addend, count, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t Atomic_Subtract_u32(uint32_t volatile *addend, uint32_t count)
+{
+    return __atomic_fetch_sub(addend, count, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t Atomic_Increment_u32(uint32_t volatile *addend)
+{
+    return __atomic_fetch_add(addend, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t Atomic_Decrement_u32(uint32_t volatile *addend)
+{
+    return __atomic_fetch_sub(addend, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t Atomic_AND_u32(uint32_t volatile *destination, uint32_t value)
+{
+    return __atomic_fetch_and(destination, value, __ATOMIC_SEQ_CST);
+}
+
+#endif /* __SHIM_ATOMIC_H__ */
@@ -0,0 +1,4 @@
+#pragma once
+
+// FTP is not built on host
+typedef struct NetBuf netbuf;
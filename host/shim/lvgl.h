@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+
+// display is not built on host, types are opaque
+typedef struct _lv_obj_t lv_obj_t;
+typedef struct _lv_disp_t lv_disp_t;
+typedef struct _lv_disp_drv_t lv_disp_drv_t;
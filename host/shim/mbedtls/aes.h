@@ -0,0 +1,27 @@
+#ifndef __SHIM_MBEDTLS_AES_H__
+#define __SHIM_MBEDTLS_AES_H__
+
+// mbedtls AES API on top of OpenSSL
+
+#include <stddef.h>
+#include <stdint.h>
+// low level AES keeps the key schedule like mbedtls context
+#define OPENSSL_SUPPRESS_DEPRECATED
+#include <openssl/aes.h>
+
+#define MBEDTLS_AES_ENCRYPT 1
+#define MBEDTLS_AES_DECRYPT 0
+
+typedef struct {
+    AES_KEY enc;
+    AES_KEY dec;
+} mbedtls_aes_context;
+
+void mbedtls_aes_init(mbedtls_aes_context *ctx);
+void mbedtls_aes_free(mbedtls_aes_context *ctx);
+int mbedtls_aes_setkey_enc(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits);
+int mbedtls_aes_setkey_dec(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits);
+int mbedtls_aes_crypt_cbc(mbedtls_aes_context *ctx, int mode, size_t length, unsigned char iv[16],
+                          const unsigned char *input, unsigned char *output);
+
+#endif /* __SHIM_MBEDTLS_AES_H__ */
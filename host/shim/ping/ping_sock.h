@@ -0,0 +1,7 @@
+#pragma once
+
+#include "esp_err.h"
+
+typedef void *esp_ping_handle_t;
+typedef struct { int count; } esp_ping_config_t;
+typedef struct { void *cb_args; } esp_ping_callbacks_t;
@@ -0,0 +1,54 @@
+#ifndef __SHIM_SDKCONFIG_H__
+#define __SHIM_SDKCONFIG_H__
+
+// Kconfig defaults from main/Kconfig.projbuild relevant on host
+
+#define CONFIG_ESP_API_KEY ""
+#define CONFIG_ESP_CONTROLLER_IP "127.0.0.1"
+#define CONFIG_ESP_WIFI_SSID ""
+#define CONFIG_ESP_WIFI_PASSWORD ""
+#define CONFIG_ESP_WIFI_COUNTRY_CODE "01"
+#define CONFIG_ESP_PING_ONLINE_IP "1.1.1.1"
+#define CONFIG_ESP_TZ "CET-1CEST,M3.5.0,M10.5.0/3"
+#define CONFIG_ESP_NTP_SERVER1 "pool.ntp.org"
+#define CONFIG_ESP_NTP_SERVER2 "10.0.0.1"
+#define CONFIG_ESP_TEMP_PERIOD_S 60
+#define CONFIG_ESP_RELAY_CNT 0
+#define CONFIG_ESP_BUTTON_REPEAT_MS 100
+#define CONFIG_ESP_BUTTON_LONG_MS 1000
+#define CONFIG_ESP_HEAP_PERIOD_S 60
+#define CONFIG_ESP_HEAP_PERIOD_INFO_S 60
+#define CONFIG_ESP_HEAP_WARN_DECREASE_B 1024
+#define CONFIG_ESP_HEAP_REBOOT_B 5000
+#define CONFIG_ESP_AUTO_CONFIG_URL ""
+#define CONFIG_ESP_AUTO_CONFIG_URL_USER ""
+#define CONFIG_ESP_AUTO_CONFIG_URL_PASSWORD ""
+#define CONFIG_ESP_AUTO_CONFIG_PERIOD_S 60
+#define CONFIG_ESP_AUTO_HTTPS_INTERNAL 1
+#define CONFIG_ESP_AUTO_HTTPS_INSECURE 0
+#define CONFIG_ESP_OTA_FIRMWARE_URL ""
+#define CONFIG_ESP_OTA_USER ""
+#define CONFIG_ESP_OTA_PASSWORD ""
+#define CONFIG_ESP_OTA_HTTPS_INTERNAL 1
+#define CONFIG_ESP_OTA_HTTPS_INSECURE 1
+#define CONFIG_ESP_METAR_LOCATION "LZIB"
+#define CONFIG_ESP_METAR_PERIOD_S 60
+#define CONFIG_ESP_SHMU_STATION 11816
+#define CONFIG_ESP_OWM_API_KEY ""
+#define CONFIG_ESP_OWM_LAT ""
+#define CONFIG_ESP_OWM_LON ""
+#define CONFIG_ESP_SHMU_HTTP_PORT 1024
+#define CONFIG_ESP_WIFI_MAX_RETRY_CNT 5
+#define CONFIG_ESP_WIFI_RETRY_WAIT_MS 5000
+#define CONFIG_ESP_WIFI_RETRY_CANCEL_MS 5000
+#define CONFIG_ESP_TEMP_FORCE_WIFI_MS 5000
+#define CONFIG_ESP_BUTTON_DEBOUNCE_MS 10
+#define CONFIG_ESP_HEATING_UDP_PORT 1024
+#define CONFIG_ESP_HEATING_UDP_SECRET ""
+#define CONFIG_ESP_HEATING_UDP_KEY_B64 "MTIzNDU2Nzg5MDEyMzQ1Njc4OTAxMjM0NTY3ODkwMTI="
+#define CONFIG_ESP_HEATING_UDP_IV_B64 "MTIzNDU2Nzg5MDEyMzQ1Ng=="
+#define CONFIG_ESP_HEATING_UDP_ENCRYPT 1
+
+#define CONFIG_LWIP_MAX_SOCKETS 10
+
+#endif /* __SHIM_SDKCONFIG_H__ */
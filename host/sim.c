@@ -0,0 +1,137 @@
+// simulation of floor heating zone with heating controllers
+//
+// sim [controller...] - compares controllers (see control.h) on the same
+// room, default is onoff, pi and pid with default gains
+//
+// room air and slab are two heat capacities, water loop has dead time,
+// sensor is sampled every minute with 0.1 resolution and lowest of last
+// 5 values is used like in heating_temp_val()
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "control.h"
+#include "util.h"
+
+// per hour, kW and kWh/K
+#define SIM_STEP_S 10
+#define SIM_HOURS 72
+#define SIM_POWER 3.0
+#define SIM_SLAB_C 2.0
+#define SIM_ROOM_C 0.3
+#define SIM_SLAB_ROOM_K 0.25
+#define SIM_ROOM_OUT_K 0.05
+#define SIM_DEAD_S 1200
+#define SIM_SENSOR_S 60
+// overshoot and error are measured after warm-up
+#define SIM_WARMUP_H 24
+
+typedef struct {
+    float overshoot;
+    float mae;
+    int switches;
+    float on;
+} sim_result_t;
+
+#define SIM_SET_DAY 21.0
+static float sim_set_night[] = {21.0, 19.0};
+static float sim_night;
+
+static float sim_set(int64_t t)
+{
+    // night setback
+    int h = (t / 3600) % 24;
+    return (h >= 22 || h < 5)? sim_night : SIM_SET_DAY;
+}
+
+static float sim_outside(int64_t t)
+{
+    return 6.0 + 5.0 * sin(2*M_PI * (t / 3600.0 - 9) / 24);
+}
+
+static sim_result_t sim_run(ctl_t *ctl)
+{
+    sim_result_t res = {0};
+    // steady state without heating
+    double room = SIM_SET_DAY;
+    double slab = room + SIM_ROOM_OUT_K * (room - sim_outside(0)) / SIM_SLAB_ROOM_K;
+    // water loop delay
+    int dead[SIM_DEAD_S/SIM_STEP_S] = {0};
+    float vals[5];
+    int vi = 0;
+    for (int i=0; i<COUNT_OF(vals); i++)
+        vals[i] = NAN;
+    float val = NAN;
+    int state = 0;
+    int64_t on = 0;
+    int64_t n = 0;
+
+    for (int64_t t=0; t<SIM_HOURS*3600; t+=SIM_STEP_S) {
+        if (t % SIM_SENSOR_S == 0) {
+            vals[vi] = roundf(room * 10) / 10;
+            vi = (vi + 1) % COUNT_OF(vals);
+            val = vals[(vi + COUNT_OF(vals) - 1) % COUNT_OF(vals)];
+            for (int i=0; i<COUNT_OF(vals); i++)
+                if (!isnanf(vals[i]) && vals[i] < val)
+                    val = vals[i];
+        }
+
+        float set = sim_set(t);
+        int next = ctl_update(ctl, set, val, t);
+        if (next != state)
+            res.switches += 1;
+        state = next;
+        on += state;
+
+        int heat = dead[(t / SIM_STEP_S) % COUNT_OF(dead)];
+        dead[(t / SIM_STEP_S) % COUNT_OF(dead)] = state;
+
+        double dt = SIM_STEP_S / 3600.0;
+        double q_slab = SIM_SLAB_ROOM_K * (slab - room);
+        double q_out = SIM_ROOM_OUT_K * (room - sim_outside(t));
+        slab += (SIM_POWER * heat - q_slab) / SIM_SLAB_C * dt;
+        room += (q_slab - q_out) / SIM_ROOM_C * dt;
+
+        // setback cooldown is not controlled
+        if (t >= SIM_WARMUP_H*3600 && set == SIM_SET_DAY) {
+            if (room - set > res.overshoot)
+                res.overshoot = room - set;
+            res.mae += fabs(room - set);
+            n += 1;
+        }
+    }
+
+    res.mae /= n;
+    res.on = 100.0 * on / (SIM_HOURS*3600/SIM_STEP_S);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    char *defaults[] = {"onoff", "pi", "pid"};
+    char **cfgs = (argc > 1)? argv + 1 : defaults;
+    int cnt = (argc > 1)? argc - 1 : COUNT_OF(defaults);
+
+    printf("%d h, slab %.0f h, dead time %d s, after %d h\n", SIM_HOURS,
+           SIM_SLAB_C / SIM_SLAB_ROOM_K, SIM_DEAD_S, SIM_WARMUP_H);
+    for (int s=0; s<COUNT_OF(sim_set_night); s++) {
+        sim_night = sim_set_night[s];
+        printf("\nset %.0f, %.0f at night\n", SIM_SET_DAY, sim_night);
+        printf("%-32s %10s %10s %10s %8s\n", "controller", "overshoot", "mae", "switches", "on %");
+        for (int i=0; i<cnt; i++) {
+            ctl_t ctl;
+            ctl_init(&ctl);
+            char cfg[64];
+            snprintf(cfg, sizeof(cfg), "%s", cfgs[i]);
+            if (!ctl_parse(cfg, &ctl.cfg)) {
+                fprintf(stderr, "invalid controller: %s\n", cfgs[i]);
+                return 1;
+            }
+
+            sim_result_t res = sim_run(&ctl);
+            ctl_format(&ctl.cfg, cfg, sizeof(cfg));
+            printf("%-32s %10.2f %10.2f %10d %8.1f\n", cfg, res.overshoot, res.mae, res.switches, res.on);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,192 @@
+// espire modules not built on host (network, display, peripherals, storage)
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "config.h"
+#include "device.h"
+#include "adc2.h"
+#include "api.h"
+#include "ftp.h"
+#include "http.h"
+#include "nv.h"
+#include "ntp.h"
+#include "oled.h"
+#include "ota.h"
+#include "ping.h"
+#include "thermistor.h"
+#include "wifi.h"
+
+// main.c, device.c
+
+static device_t host_device = {
+    .mac = "020000000001",
+    .hostname = "host",
+    .controller = 1,
+};
+
+system_t esp = {
+    .dev = &host_device,
+};
+
+// stays offline, graphite and tasks never touch network
+
+int wifi_connected = 0;
+ping_t ping_online = {.connected = 0};
+time_t ntp_synced = 0;
+time_t api_synced = 0;
+int ota_force = 0;
+oled_update_t oled_update = {0};
+adc2_mode_t adc2_use = ADC2_NONE;
+
+const char httpd_pem_start[] asm("_binary_httpd_pem_start") = "";
+
+int wifi_run(int add, int nonblock, TaskHandle_t owner)
+{
+    return 1;
+}
+
+void wifi_update(char *ssid, char *password, int apply)
+{
+}
+
+void ADC2_FREE()
+{
+}
+
+int ADC2_WAIT(adc2_mode_t value, int add, TickType_t force_tick, int nonblock, TaskHandle_t owner)
+{
+    return 1;
+}
+
+void adc2_net_next(int user, TickType_t at)
+{
+}
+
+TickType_t adc2_slot(TickType_t max_wait)
+{
+    return 0;
+}
+
+// requests fail immediately and free themselves like on timeout
+
+void https_get(http_request_t *req)
+{
+    if (req->callback != NULL)
+        req->callback(req, 0);
+}
+
+void ftp_get(ftp_request_t *req)
+{
+    if (req->callback != NULL)
+        req->callback(req, 0);
+}
+
+esp_err_t api_reboot(httpd_req_t *req)
+{
+    exit(0);
+}
+
+esp_err_t api_ota(httpd_req_t *req)
+{
+    return ESP_OK;
+}
+
+esp_err_t thermistor_init(thermistor_handle_t *th, int gpio, int adc_unit,
+                          uint8_t channel, float serie_resistance,
+                          float nominal_resistance, float nominal_temperature,
+                          float beta_val, float vsource)
+{
+    return ESP_OK;
+}
+
+float thermistor_get_celsius(thermistor_handle_t *th)
+{
+    return NAN;
+}
+
+esp_err_t thermistor_scan(thermistor_handle_t *ths, int cnt, uint8_t *scanned)
+{
+    memset(scanned, 0, cnt);
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+// NVS is empty and writes are dropped
+
+uint32_t nv_writes = 0;
+
+esp_err_t nv_commit()
+{
+    return ESP_OK;
+}
+
+esp_err_t nv_remove(char *key)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nv_read_u8(char *key, uint8_t *value)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nv_read_i8(char *key, int8_t *value)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nv_read_u16(char *key, uint16_t *value)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nv_read_u32(char *key, uint32_t *value)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nv_read_str(char *key, char **value, size_t *len)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nv_read_blob(char *key, void **value, size_t *len)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nv_write_u8(char *key, uint8_t value)
+{
+    nv_writes += 1;
+    return ESP_OK;
+}
+
+esp_err_t nv_write_i8(char *key, int8_t value)
+{
+    nv_writes += 1;
+    return ESP_OK;
+}
+
+esp_err_t nv_write_u16(char *key, uint16_t value)
+{
+    nv_writes += 1;
+    return ESP_OK;
+}
+
+esp_err_t nv_write_u32(char *key, uint32_t value)
+{
+    nv_writes += 1;
+    return ESP_OK;
+}
+
+esp_err_t nv_write_str(char *key, char *value)
+{
+    nv_writes += 1;
+    return ESP_OK;
+}
+
+esp_err_t nv_write_blob(char *key, void *value, size_t len, int is_str)
+{
+    nv_writes += 1;
+    return ESP_OK;
+}
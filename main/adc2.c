@@ -2,6 +2,7 @@
 #include "adc2.h"
 #include "wifi.h"
 #include "util.h"
+#include "metrics.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
@@ -48,38 +49,21 @@ static void _MUTEX_EXIT_CRITICAL()
     ESP_LOGD(TAG, "mutex unlocked");
 }
 
-list_t wifi_owner = {0};
+// fixed table, sleep task reads a copy under mutex
+static wifi_owner_t owners[WIFI_OWNERS_MAX] = {0};
 inline static void WIFI_OWNER_REMOVE(TaskHandle_t task)
 {
     assert(task != NULL);
 
-    //list_t *item = list_find(&wifi_owner, task);
-    list_t *item = &wifi_owner;
-    while ((item = list_iter(item)) != NULL) {
-        if (LIST(wifi_owner_t, item, task) == task) {
-            break;
-        }
-    }
-
-    if (item != NULL) {
-        wifi_owner_t *o = item->data;
-        list_remove(&wifi_owner, item);
-        free(o);
-
-        // double allocation per task is tentatively invalid (ftp/http has own task)
-        item = &wifi_owner;
-        while ((item = list_iter(item)) != NULL) {
-            if (LIST(wifi_owner_t, item, task) == task) {
-                break;
-            }
+    for (int i=0; i<COUNT_OF(owners); i++) {
+        if (owners[i].task == task) {
+            owners[i].task = NULL;
+            return;
         }
-        assert(item == NULL);
-
-        return;
     }
 
     ESP_LOGE(TAG, "wifi owner not found: %" PRIx32, (uint32_t) task);
-    assert(item != NULL);
+    assert(0);
 }
 
 // time tracking relies on fact that only one allocation is made per task
@@ -89,22 +73,113 @@ inline static void WIFI_OWNER_ADD(TaskHandle_t task)
     assert(task != NULL);
 
     // double allocation per task is tentatively invalid (ftp/http has own task)
-    //list_t *item = list_find(&wifi_owner, (void *) task);
-    list_t *item = &wifi_owner;
-    while ((item = list_iter(item)) != NULL) {
-        if (LIST(wifi_owner_t, item, task) == task) {
-            break;
+    wifi_owner_t *free_slot = NULL;
+    for (int i=0; i<COUNT_OF(owners); i++) {
+        assert(owners[i].task != task);
+        if (owners[i].task == NULL && free_slot == NULL)
+            free_slot = &owners[i];
+    }
+    assert(free_slot != NULL);
+
+    time(&free_slot->time);
+    free_slot->task = task;
+}
+
+int wifi_owners(wifi_owner_t *copy, int max)
+{
+    int cnt = 0;
+    _MUTEX_ENTER_CRITICAL();
+    for (int i=0; i<COUNT_OF(owners) && cnt<max; i++)
+        if (owners[i].task != NULL)
+            copy[cnt++] = owners[i];
+    _MUTEX_EXIT_CRITICAL();
+    return cnt;
+}
+
+// outage planning, ticks of next expected network activity (0 unknown)
+static TickType_t net_next[ADC2_NET_CNT] = {0};
+static TickType_t outage_start = 0;
+static uint32_t outage_expected_ms = ADC2_OUTAGE_INIT_MS;
+adc2_outage_t adc2_outage = {0};
+
+void adc2_net_next(int user, TickType_t at)
+{
+    assert(user >= 0 && user < ADC2_NET_CNT);
+    net_next[user] = at;
+}
+
+// first time from now when no activity falls into outage
+static TickType_t adc2_gap(TickType_t now, TickType_t len)
+{
+    TickType_t t = now;
+    // every move is past one activity, so this ends
+    for (int moved=1, n=0; moved && n<=ADC2_NET_CNT; n++) {
+        moved = 0;
+        for (int i=0; i<ADC2_NET_CNT; i++) {
+            TickType_t at = net_next[i];
+            // unknown, nothing to avoid
+            if (at == 0)
+                continue;
+            if ((int32_t) (at - t) < 0 || (int32_t) (at - (t + len)) >= 0)
+                continue;
+            // activity itself takes a moment
+            t = at + MS_TO_TICK(500);
+            moved = 1;
         }
     }
-    assert(item == NULL);
+    return t;
+}
+
+TickType_t adc2_slot(TickType_t max_wait)
+{
+    TickType_t now = xTaskGetTickCount();
+    TickType_t len = MS_TO_TICK(outage_expected_ms);
+    TickType_t wait = adc2_gap(now, len) - now;
+    // no gap soon enough, don't delay collection for nothing
+    if (wait > max_wait)
+        return 0;
+
+    ESP_LOGI(TAG, "outage of %" PRIu32 " ms planned in %" PRIu32 " ms", outage_expected_ms, (uint32_t) TICK_TO_MS(wait));
+    if (wait > 0)
+        _vTaskDelay(wait);
+    return wait;
+}
 
-    wifi_owner_t *o = calloc(1, sizeof(wifi_owner_t));
-    assert(o != NULL);
-    time(&o->time);
-    o->task = task;
+// seconds
+static const float adc2_outage_bounds[] = {0.05, 0.1, 0.25, 0.5, 1, 2.5, 5};
 
-    //list_prepend(&wifi_owner, task);
-    list_prepend(&wifi_owner, o);
+void adc2_outage_end()
+{
+    static metric_t *outages = NULL;
+    if (outages == NULL)
+        outages = metric_histogram("espire_adc2_outage_seconds", "WiFi outage for ADC2 measurements",
+                                   adc2_outage_bounds, COUNT_OF(adc2_outage_bounds));
+
+    uint32_t ms = 0;
+    int ended = 0;
+    _MUTEX_ENTER_CRITICAL();
+    if (outage_start != 0) {
+        ended = 1;
+        ms = TICK_TO_MS(xTaskGetTickCount() - outage_start);
+        outage_start = 0;
+        adc2_outage.cnt += 1;
+        adc2_outage.total_ms += ms;
+        adc2_outage.last_ms = ms;
+        if (ms > adc2_outage.max_ms)
+            adc2_outage.max_ms = ms;
+        // planning uses recent outages
+        outage_expected_ms += ((int32_t) ms - (int32_t) outage_expected_ms) / 4;
+        ESP_LOGI(TAG, "outage %" PRIu32 " ms", ms);
+    }
+    _MUTEX_EXIT_CRITICAL();
+    if (ended)
+        metric_observe(outages, ms / 1000.0);
+}
+
+static void adc2_outage_start()
+{
+    if (outage_start == 0)
+        outage_start = xTaskGetTickCount();
 }
 
 inline void WIFI_ADD(TaskHandle_t owner)
@@ -179,6 +254,7 @@ inline int ADC2_WAIT(adc2_mode_t value, int add, TickType_t force_tick, int nonb
             switch (adc2_use) {
             case ADC2_WIFI:
                 ESP_LOGE(TAG, "forcing disconnect for %d", value);
+                adc2_outage_start();
                 // maybe only do this when not connected - that can block us
                 _wifi_stop_sta(1);
                 wifi_count = 0;
@@ -236,6 +312,9 @@ inline int ADC2_WAIT(adc2_mode_t value, int add, TickType_t force_tick, int nonb
                 //    _vTaskDelay(MS_TO_TICK(500));
                 //}
             } else {
+                _MUTEX_ENTER_CRITICAL();
+                adc2_outage_start();
+                _MUTEX_EXIT_CRITICAL();
                 _wifi_stop_sta(0);
                 while (wifi_connected) {
                     ESP_LOGI(TAG, "waiting for disconnect (%d)", value);
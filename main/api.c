@@ -6,7 +6,13 @@
 #include "temp.h"
 #include "api.h"
 #include "heating.h"
+#include "zone.h"
+#include "emit.h"
+#include "metrics.h"
+#include "probe.h"
+#include "outdoor.h"
 #include "relay.h"
+#include "adc2.h"
 #include "driver/gpio.h"
 #include "ping.h"
 #include "httpd.h"
@@ -18,13 +24,16 @@
 #include "button.h"
 #include "ntp.h"
 #include "log.h"
+#include "graphite.h"
 #include "util.h"
 
 #include "ota.h"
 #include "esp_ota_ops.h"
+#include "esp_timer.h"
 
 #include <stdarg.h>
 #include <inttypes.h>
+#include <math.h>
 
 #include "nvs_flash.h"
 #include "esp_log.h"
@@ -157,6 +166,63 @@ CLEANUP:
 }
 
 
+static int api_emit_write(void *req, const char *buf, int len)
+{
+    return http_write(req, buf, len);
+}
+
+// fmt= parsed by parse or Accept header, -1 if fmt is unknown
+static int api_fmt(httpd_req_t *req, char *query, int (*parse)(char *name))
+{
+    char value[4+1] = "";
+    esp_err_t res = ESP_ERR_NOT_FOUND;
+    if (query != NULL)
+        res = httpd_query_key_value(query, "fmt", (char *) value, sizeof(value));
+    // value cut to "json" from "jsonx" is not json
+    if (res == ESP_OK)
+        return parse(value);
+    if (res != ESP_ERR_NOT_FOUND)
+        return -1;
+
+    // browsers send long Accept, prefix is enough
+    char accept[64];
+    res = httpd_req_get_hdr_value_str(req, "Accept", accept, sizeof(accept));
+    if (res == ESP_OK || res == ESP_ERR_HTTPD_RESULT_TRUNC) {
+        if (strstr(accept, emit_type(EMIT_CBOR)) != NULL)
+            return EMIT_CBOR;
+        if (strstr(accept, emit_type(EMIT_JSON)) != NULL)
+            return EMIT_JSON;
+    }
+    return EMIT_TEXT;
+}
+
+// negotiated response with root map open, 0 if fmt is unknown
+static int api_emit(emit_t *e, httpd_req_t *req, char *query)
+{
+    int fmt = api_fmt(req, query, emit_fmt);
+    if (fmt < 0) {
+        httpd_resp_set_status(req, "400 Bad Request - fmt");
+        return 0;
+    }
+
+    httpd_resp_set_type(req, emit_type(fmt));
+    emit_init(e, fmt, api_emit_write, req);
+    emit_map(e, NULL);
+    return 1;
+}
+
+// text or binary zone
+static void api_zone_write(httpd_req_t *req, heating_t *data, int fmt, int flags)
+{
+    char out[ZONE_SIZE];
+    int len = zone_format(data, fmt, flags, out, sizeof(out));
+    if (len < 0) {
+        ESP_LOGE(TAG, "zone %s over %d bytes", data->name, sizeof(out));
+        return;
+    }
+    http_write(req, out, len);
+}
+
 static esp_err_t api_temp_zone(httpd_req_t *req)
 {
     char *buf = NULL;
@@ -202,34 +268,16 @@ PRINT:
         http_printf(req, "temp_zone_adc=%s==%d\n", temp_zones[i].name, temp_zones[i].adc);
     }
 
+    int flags = esp.dev->controller? ZONE_STATE : 0;
     iter_t iter = heating_iter();
     heating_t *data;
-    while ((iter = heating_next(iter, &data)) != NULL) {
-        http_printf(req, "heating_relay=%s=%d\n", data->name, data->relay);
-        if (data->c > 0) {
-            int last = HEATING_LAST_VAL_I(data);
-            http_printf(req, "temp=%.1f\n", data->vals[last]);
-            http_printf(req, "vals=");
-            // from oldest to newest
-            for (int i=data->c - 1; i>=0; i--)
-                http_printf(req, "%.1f ", data->vals[(last+COUNT_OF(data->vals)-i) % COUNT_OF(data->vals)]);
-            http_printf(req, "\n");
-        }
-        http_printf(req, "val=%.1f\n", data->val);
-        http_printf(req, "set=%.1f\n", data->set);
-        if (esp.dev->controller) {
-            http_printf(req, "fix=%.1f\n", data->fix);
-            http_printf(req, "state=%d\n", data->state == HEATING_ON);
-            http_printf(req, "triggered=%d\n", data->triggered);
-            http_printf(req, "change=%d\n", data->change);
-            //http_printf(req, "relay=%d\n", data->relay);
-        }
-    }
+    while ((iter = heating_next(iter, &data)) != NULL)
+        api_zone_write(req, data, ZONE_TEXT, flags);
 
 CLEANUP:
     if (buf != NULL)
         free(buf);
-    httpd_resp_send(req, NULL, 0);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -268,7 +316,7 @@ PRINT:
 CLEANUP:
     if (buf != NULL)
         free(buf);
-    httpd_resp_send(req, NULL, 0);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -279,6 +327,12 @@ static esp_err_t api_heating_temp_get(httpd_req_t *req)
     // no authorization required
     api_key_check(0, req, &buf, &buf_len);
 
+    int fmt = api_fmt(req, buf, zone_fmt);
+    if (fmt < 0) {
+        httpd_resp_set_status(req, "400 Bad Request - fmt");
+        goto CLEANUP;
+    }
+
     heating_t *data = NULL;
     if (buf_len > 1) {
         {//if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
@@ -288,65 +342,107 @@ static esp_err_t api_heating_temp_get(httpd_req_t *req)
                 if (data == NULL) {
                     httpd_resp_set_status(req, "404 Not Found - name");
                     goto CLEANUP;
-                } else {
-                    // TODO curl: Illegal or missing hexadecimal sequence in chunked-encoding
-                    http_printf(req, "heating_relay=%s=%d\n", data->name, data->relay);
-                    //http_printf(req, "name=%s\n", data->name);
-                    if (data->c > 0) {
-                        int last = HEATING_LAST_VAL_I(data);
-                        http_printf(req, "temp=%.1f\n", data->vals[last]);
-                        http_printf(req, "vals=");
-                        // from oldest to newest
-                        for (int i=data->c - 1; i>=0; i--)
-                            http_printf(req, "%.1f ", data->vals[(last+COUNT_OF(data->vals)-i) % COUNT_OF(data->vals)]);
-                        http_printf(req, "\n");
-                    }
-                    http_printf(req, "val=%.1f\n", data->val);
-                    http_printf(req, "set=%.1f\n", data->set);
-                    if (esp.dev->controller) {
-                        http_printf(req, "fix=%.1f\n", data->fix);
-                        http_printf(req, "state=%d\n", data->state == HEATING_ON);
-                        http_printf(req, "triggered=%d\n", data->triggered);
-                        http_printf(req, "change=%d\n", data->change);
-                        //http_printf(req, "relay=%d\n", data->relay);
-                    }
                 }
             } else {
-                httpd_resp_set_status(req, "400 Bad Request - name");
-                goto CLEANUP;
+                // only fmt given lists all zones
+                char value[4+1];
+                esp_err_t res = httpd_query_key_value(buf, "fmt", (char *) value, sizeof(value));
+                if (res == ESP_ERR_NOT_FOUND) {
+                    httpd_resp_set_status(req, "400 Bad Request - name");
+                    goto CLEANUP;
+                }
+                if (res != ESP_OK) {
+                    httpd_resp_set_status(req, "400 Bad Request - fmt");
+                    goto CLEANUP;
+                }
             }
         }
+    }
+
+    int flags = esp.dev->controller? ZONE_STATE | ZONE_CTL : 0;
+    if (fmt == ZONE_JSON || fmt == ZONE_CBOR) {
+        // single zone is map, all zones array of maps
+        emit_t e;
+        httpd_resp_set_type(req, emit_type(fmt));
+        emit_init(&e, fmt, api_emit_write, req);
+        if (data != NULL) {
+            zone_emit(&e, data, flags);
+        } else {
+            emit_array(&e, NULL);
+            iter_t iter = heating_iter();
+            while ((iter = heating_next(iter, &data)) != NULL)
+                zone_emit(&e, data, flags);
+        }
+        emit_finish(&e);
+        goto CLEANUP;
+    }
+
+    if (fmt == ZONE_BIN)
+        httpd_resp_set_type(req, "application/octet-stream");
+    if (data != NULL) {
+        api_zone_write(req, data, fmt, flags);
     } else {
         iter_t iter = heating_iter();
-        while ((iter = heating_next(iter, &data)) != NULL) {
-            http_printf(req, "heating_relay=%s=%d\n", data->name, data->relay);
-            //http_printf(req, "name=%s\n", data->name);
-            if (data->c > 0) {
-                int last = HEATING_LAST_VAL_I(data);
-                http_printf(req, "temp=%.1f\n", data->vals[last]);
-                http_printf(req, "vals=");
-                // from oldest to newest
-                for (int i=data->c - 1; i>=0; i--)
-                    http_printf(req, "%.1f ", data->vals[(last+COUNT_OF(data->vals)-i) % COUNT_OF(data->vals)]);
-                http_printf(req, "\n");
-            }
-            http_printf(req, "val=%.1f\n", data->val);
-            http_printf(req, "set=%.1f\n", data->set);
-            if (esp.dev->controller) {
-                http_printf(req, "fix=%.1f\n", data->fix);
-                http_printf(req, "state=%d\n", data->state == HEATING_ON);
-                http_printf(req, "triggered=%d\n", data->triggered);
-                http_printf(req, "change=%d\n", data->change);
-                //http_printf(req, "relay=%d\n", data->relay);
-            }
-        }
+        while ((iter = heating_next(iter, &data)) != NULL)
+            api_zone_write(req, data, fmt, flags);
     }
 
 CLEANUP:
     if (buf != NULL)
         free(buf);
 
-    httpd_resp_send(req, NULL, 0);
+    http_end(req);
+    return ESP_OK;
+}
+
+// binary, history_header_t and samples (see history.h)
+static esp_err_t api_history(httpd_req_t *req)
+{
+    char *buf = NULL;
+    int buf_len;
+    // no authorization required
+    api_key_check(0, req, &buf, &buf_len);
+
+    char name[member_size(heating_t, name)] = "";
+    if (buf_len <= 1 || httpd_query_key_value(buf, "name", (char *) name, sizeof(name)) != ESP_OK) {
+        httpd_resp_set_status(req, "400 Bad Request - name");
+        goto CLEANUP;
+    }
+
+    heating_t *data = heating_find(name, 0);
+    if (data == NULL || data->history == NULL) {
+        httpd_resp_set_status(req, "404 Not Found - name");
+        goto CLEANUP;
+    }
+
+    int tier = HISTORY_FINE;
+    char value[2] = "";
+    if (httpd_query_key_value(buf, "tier", (char *) value, sizeof(value)) == ESP_OK)
+        tier = (atoi(value) == HISTORY_COARSE)? HISTORY_COARSE : HISTORY_FINE;
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    history_header_t hdr;
+    history_read(data->history, tier, 0, NULL, 0, &hdr);
+    if (http_write(req, (char *) &hdr, sizeof(hdr)) != ESP_OK)
+        goto CLEANUP;
+    // chunks are read from slots fixed by header
+    int64_t oldest = (int64_t) (hdr.time / hdr.step) - hdr.cnt;
+    int16_t samples[128];
+    for (int from = 0; from < hdr.cnt; ) {
+        int cnt = hdr.cnt - from;
+        if (cnt > COUNT_OF(samples))
+            cnt = COUNT_OF(samples);
+        int n = history_read(data->history, tier, oldest + from, samples, cnt, NULL);
+        // ESP32 is little endian
+        if (http_write(req, (char *) samples, n * sizeof(int16_t)) != ESP_OK)
+            break;
+        from += n;
+    }
+
+CLEANUP:
+    if (buf != NULL)
+        free(buf);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -385,6 +481,22 @@ static esp_err_t api_heating_temp_set(httpd_req_t *req)
                 heating_temp_fix(name, fixf, 1);
                 httpd_resp_set_status(req, "200 OK");
             }
+
+            char ctl[32];
+            if (httpd_query_key_value(buf, "ctl", (char *) ctl, sizeof(ctl)) == ESP_OK) {
+                if (heating_ctl(name, ctl) != NULL)
+                    httpd_resp_set_status(req, "200 OK");
+                else
+                    httpd_resp_set_status(req, "400 Bad Request - ctl");
+            }
+
+            char est[8];
+            if (httpd_query_key_value(buf, "est", (char *) est, sizeof(est)) == ESP_OK) {
+                if (heating_est(name, est) != NULL)
+                    httpd_resp_set_status(req, "200 OK");
+                else
+                    httpd_resp_set_status(req, "400 Bad Request - est");
+            }
        }
     }
 
@@ -410,7 +522,7 @@ CLEANUP:
     if (buf != NULL)
         free(buf);
 
-    httpd_resp_send(req, NULL, 0);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -426,7 +538,7 @@ static esp_err_t api_co2_ppm_get(httpd_req_t *req)
     if (buf != NULL)
         free(buf);
 
-    httpd_resp_send(req, NULL, 0);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -441,7 +553,7 @@ static esp_err_t api_co2_abc_get(httpd_req_t *req)
     if (buf != NULL)
         free(buf);
 
-    httpd_resp_send(req, NULL, 0);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -457,7 +569,7 @@ static esp_err_t api_co2_get(httpd_req_t *req)
     if (buf != NULL)
         free(buf);
 
-    httpd_resp_send(req, NULL, 0);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -512,7 +624,7 @@ CLEANUP:
     if (buf != NULL)
         free(buf);
     // End response
-    httpd_resp_send_chunk(req, NULL, 0);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -582,17 +694,26 @@ static esp_err_t api_loglevel(httpd_req_t *req)
 
     if (buf_len > 1) {
         {//if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
-            char level[2];
-            if (httpd_query_key_value(buf, "level", (char *) level, sizeof(level)) != ESP_OK) {
-                httpd_resp_set_status(req, "400 Bad Request - level");
+            char tag[50];
+            if (httpd_query_key_value(buf, "tag", (char *) tag, sizeof(tag)) != ESP_OK) {
+                httpd_resp_set_status(req, "400 Bad Request - tag");
                 goto CLEANUP;
             }
 
-            char tag[50];
-            if (httpd_query_key_value(buf, "tag", (char *) tag, sizeof(tag)) == ESP_OK) {
+            // network log rate limit, burst is optional
+            char rate[5+1] = "";
+            if (httpd_query_key_value(buf, "rate", (char *) rate, sizeof(rate)) == ESP_OK) {
+                char burst[5+1];
+                if (httpd_query_key_value(buf, "burst", (char *) burst, sizeof(burst)) != ESP_OK)
+                    strcpy(burst, "-1");
+                log_limit(tag, atoi(rate), atoi(burst));
+            }
+
+            char level[2];
+            if (httpd_query_key_value(buf, "level", (char *) level, sizeof(level)) == ESP_OK) {
                 esp_log_level_set(tag, atoi(level));
-            } else {
-                httpd_resp_set_status(req, "400 Bad Request - tag");
+            } else if (rate[0] == '\0') {
+                httpd_resp_set_status(req, "400 Bad Request - level");
                 goto CLEANUP;
             }
         }
@@ -602,7 +723,7 @@ CLEANUP:
     if (buf != NULL)
         free(buf);
     // End response
-    httpd_resp_send_chunk(req, NULL, 0);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -615,6 +736,12 @@ static esp_err_t api_log(httpd_req_t *req)
 
     if (buf_len > 1) {
         {//if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
+            char binary[1+1];
+            if (httpd_query_key_value(buf, "binary", (char *) binary, sizeof(binary)) == ESP_OK) {
+                log_binary = atoi(binary);
+                goto CLEANUP;
+            }
+
             char ip[4*3+3+1];
             if (httpd_query_key_value(buf, "ip", (char *) ip, sizeof(ip)) != ESP_OK) {
                 httpd_resp_set_status(req, "400 Bad Request - ip");
@@ -635,7 +762,7 @@ CLEANUP:
     if (buf != NULL)
         free(buf);
     // End response
-    httpd_resp_send_chunk(req, NULL, 0);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -683,15 +810,19 @@ CLEANUP:
     if (buf != NULL)
         free(buf);
 
-    httpd_resp_send_chunk(req, NULL, 0);
+    http_end(req);
     ota_main();
     return ESP_OK;
 }
 
-#define PRINT_FIELD_STR(DATA, PREFIX, FIELD) http_printf(req, PREFIX "." #FIELD "=%s\n", DATA.FIELD)
+#define EMIT_FIELD_STR(DATA, PREFIX, FIELD) emit_str(&e, PREFIX "." #FIELD, DATA.FIELD)
 esp_err_t api_version(httpd_req_t *req)
 {
-    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    int buf_len;
+    char *buf = NULL;
+    // no authorization required
+    api_key_check(0, req, &buf, &buf_len);
+
     const esp_partition_t *running = esp_ota_get_running_partition();
     esp_app_desc_t info;
     if (esp_ota_get_partition_description(running, &info) != ESP_OK) {
@@ -699,19 +830,23 @@ esp_err_t api_version(httpd_req_t *req)
         goto CLEANUP;
     }
 
-    PRINT_FIELD_STR(info, "app", version);
-    PRINT_FIELD_STR(info, "app", project_name);
-    PRINT_FIELD_STR(info, "app", date);
-    PRINT_FIELD_STR(info, "app", time);
-    PRINT_FIELD_STR(info, "app", idf_ver);
-    http_printf(req, "app.app_elf_sha256=");
-    for (int i=0; i< sizeof(info.app_elf_sha256); i++)
-        http_printf(req, "%02x", info.app_elf_sha256[i]);
-    http_printf(req, "\n");
-    http_printf(req, "app.secure_version=%"PRIu32"\n", info.secure_version);
+    emit_t e;
+    if (!api_emit(&e, req, buf))
+        goto CLEANUP;
+
+    EMIT_FIELD_STR(info, "app", version);
+    EMIT_FIELD_STR(info, "app", project_name);
+    EMIT_FIELD_STR(info, "app", date);
+    EMIT_FIELD_STR(info, "app", time);
+    EMIT_FIELD_STR(info, "app", idf_ver);
+    emit_hex(&e, "app.app_elf_sha256", info.app_elf_sha256, sizeof(info.app_elf_sha256));
+    emit_uint(&e, "app.secure_version", info.secure_version);
+    emit_finish(&e);
 
 CLEANUP:
-    httpd_resp_send_chunk(req, NULL, 0);
+    if (buf != NULL)
+        free(buf);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -721,7 +856,7 @@ static esp_err_t api_heap(httpd_req_t *req)
     //httpd_resp_set_type(req, "text/plain");
     //httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
     http_printf(req, "%zu", esp_get_free_heap_size());
-    httpd_resp_send_chunk(req, NULL, 0);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -872,7 +1007,7 @@ static esp_err_t api_screenshot(httpd_req_t *req)
 CLEANUP:
     if (buf != NULL)
         free(buf);
-    httpd_resp_send_chunk(req, NULL, 0);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -962,7 +1097,7 @@ static esp_err_t api_debug(httpd_req_t *req)
 CLEANUP:
     if (buf != NULL)
         free(buf);
-    httpd_resp_send_chunk(req, NULL, 0);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -1026,7 +1161,7 @@ static esp_err_t api_nvdump(httpd_req_t *req)
 CLEANUP:
     if (buf != NULL)
         free(buf);
-    httpd_resp_send_chunk(req, NULL, 0);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -1035,7 +1170,7 @@ static esp_err_t api_mac(httpd_req_t *req)
     char *mac = get_mac();
     http_printf(req, "%02X:%02X:%02X:%02X:%02X:%02X",
                 mac[0],mac[1],mac[2],mac[3],mac[4],mac[5]);
-    httpd_resp_send_chunk(req, NULL, 0);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -1071,15 +1206,27 @@ static esp_err_t api_time_set(httpd_req_t *req)
 CLEANUP:
     if (buf != NULL)
         free(buf);
-    httpd_resp_send_chunk(req, NULL, 0);
+    http_end(req);
     return ESP_OK;
 }
 
 
 static esp_err_t api_gpio(httpd_req_t *req)
 {
-    check_report((void *) req, (int (*)(void *, const char *, ...)) &http_printf);
-    httpd_resp_send_chunk(req, NULL, 0);
+    int buf_len;
+    char *buf = NULL;
+    // no authorization required
+    api_key_check(0, req, &buf, &buf_len);
+
+    emit_t e;
+    if (api_emit(&e, req, buf)) {
+        check_report(&e);
+        emit_finish(&e);
+    }
+
+    if (buf != NULL)
+        free(buf);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -1167,14 +1314,16 @@ static esp_err_t api_stats(httpd_req_t *req)
     // no authorization required
     api_key_check(0, req, &buf, &buf_len);
 
-    httpd_resp_set_type(req, "text/plain");
+    emit_t e;
+    if (!api_emit(&e, req, buf))
+        goto CLEANUP;
 
     time_t now;
     time(&now);
     char timestr[4+1+2+1+2 +1+ 2+1+2+1+2 +1] = "";
     format_time(now, timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S");
-    http_printf(req, "timestamp=%lld\n", now);
-    http_printf(req, "time=%s\n", timestr);
+    emit_int(&e, "timestamp", now);
+    emit_str(&e, "time", timestr);
     uint64_t runtime;
     if (ntp_synced)
         runtime = now - ntp_start + ntp_synced;
@@ -1182,74 +1331,115 @@ static esp_err_t api_stats(httpd_req_t *req)
         TickType_t tick_now = xTaskGetTickCount();
         runtime = (TICK_TO_MS(tick_now) + esp.slept_ms) / 1000;
     }
-    http_printf(req, "runtime=%lld\n", runtime);
+    emit_uint(&e, "runtime", runtime);
     if (ntp_synced)
-        http_printf(req, "runtime.synced=%lld\n", now - ntp_start);
-    http_printf(req, "runtime.pm=%d\n", esp.pm);
+        emit_int(&e, "runtime.synced", now - ntp_start);
+    emit_int(&e, "runtime.pm", esp.pm);
     if (esp.sleep != NULL) {
-        http_printf(req, "runtime.sleep_ms=%lld\n", esp.slept_ms);
-        http_printf(req, "runtime.sleep=%d%%\n", (esp.slept_ms / 10) / runtime);
+        emit_int(&e, "runtime.sleep_ms", esp.slept_ms);
+        // percent, text keeps the sign
+        if (e.fmt == EMIT_TEXT)
+            emit_text(&e, "runtime.sleep=%d%%\n", (int) ((esp.slept_ms / 10) / runtime));
+        else
+            emit_uint(&e, "runtime.sleep", (esp.slept_ms / 10) / runtime);
     }
-    http_printf(req, "activity=%" PRIi32 "\n", now - esp.activity);
-    http_printf(req, "ntp.start=%lld\n", ntp_start);
-    http_printf(req, "nv.writes=%" PRIu32 "\n", nv_writes);
-    http_printf(req, "net.online=%d\n", ping_online.connected);
-    http_printf(req, "net.last_timestamp=%" PRIu64 "\n", (uint64_t) ping_online.last);
+    emit_int(&e, "activity", now - esp.activity);
+    emit_int(&e, "ntp.start", ntp_start);
+    emit_uint(&e, "nv.writes", nv_writes);
+    emit_int(&e, "log.size", LOG_SIZE);
+    emit_uint(&e, "log.used", log_used());
+    emit_uint(&e, "log.high_water", log_high_water);
+    emit_uint(&e, "log.dropped", log_dropped);
+    emit_uint(&e, "log.dropped_lines", log_dropped_lines);
+    emit_uint(&e, "log.suppressed", log_suppressed);
+    emit_int(&e, "net.online", ping_online.connected);
+    emit_uint(&e, "graphite.sent", graphite_sent);
+    emit_uint(&e, "graphite.datagrams", graphite_datagrams);
+    emit_uint(&e, "graphite.dropped", graphite_dropped);
+    emit_int(&e, "graphite.backlog", graphite_backlog());
+    emit_uint(&e, "net.last_timestamp", ping_online.last);
     if (ping_online.last > 0) {
         format_time(ping_online.last, timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S");
-        http_printf(req, "net.last_time=%s\n", timestr);
+        emit_str(&e, "net.last_time", timestr);
     }
 
-    http_printf(req, "heap.estimate_s=%f\n", heap_estimate_s);
-    http_printf(req, "heap.estimate_d=%f\n", heap_estimate_s/(24.0*60*60));
-    //http_printf(req, "heap.free=%zu\n", esp_get_free_heap_size());
-    http_printf(req, "heap.first_free=%zu\n", heap_first_free);
-    //http_printf(req, "heap.free=%zu\n", heap_caps_get_free_size(MALLOC_CAP_8BIT));
-    //http_printf(req, "heap.total=%zu\n", heap_caps_get_total_size(MALLOC_CAP_8BIT));
+    // wifi off for ADC2 measurements
+    emit_uint(&e, "adc2.outages", adc2_outage.cnt);
+    emit_uint(&e, "adc2.outage_ms", adc2_outage.total_ms);
+    emit_uint(&e, "adc2.outage_last_ms", adc2_outage.last_ms);
+    emit_uint(&e, "adc2.outage_max_ms", adc2_outage.max_ms);
+    int64_t uptime_s = esp_timer_get_time() / 1000000;
+    if (uptime_s > 0)
+        emit_uint(&e, "adc2.outage_ms_per_h", (uint64_t) adc2_outage.total_ms * 3600 / uptime_s);
+
+    emit_float(&e, "heap.estimate_s", heap_estimate_s, -1);
+    emit_float(&e, "heap.estimate_d", heap_estimate_s/(24.0*60*60), -1);
+    emit_uint(&e, "heap.first_free", heap_first_free);
     multi_heap_info_t heap = {0};
     heap_caps_get_info(&heap, MALLOC_CAP_8BIT);
-#define PRINT_FIELD(DATA, PREFIX, FIELD) http_printf(req, PREFIX "." #FIELD "=%zu\n", DATA.FIELD)
-    PRINT_FIELD(heap, "heap", total_free_bytes);
-    PRINT_FIELD(heap, "heap", total_allocated_bytes);
-    PRINT_FIELD(heap, "heap", largest_free_block);
-    PRINT_FIELD(heap, "heap", minimum_free_bytes);
-    PRINT_FIELD(heap, "heap", allocated_blocks);
-    PRINT_FIELD(heap, "heap", free_blocks);
-    PRINT_FIELD(heap, "heap", total_blocks);
+#define EMIT_FIELD(DATA, PREFIX, FIELD) emit_uint(&e, PREFIX "." #FIELD, DATA.FIELD)
+    EMIT_FIELD(heap, "heap", total_free_bytes);
+    EMIT_FIELD(heap, "heap", total_allocated_bytes);
+    EMIT_FIELD(heap, "heap", largest_free_block);
+    EMIT_FIELD(heap, "heap", minimum_free_bytes);
+    EMIT_FIELD(heap, "heap", allocated_blocks);
+    EMIT_FIELD(heap, "heap", free_blocks);
+    EMIT_FIELD(heap, "heap", total_blocks);
+    emit_uint(&e, "thermistor.lut_bytes", thermistor_lut_bytes());
 
     extern SemaphoreHandle_t lvgl_mutex;
     if (lvgl_mutex != NULL)
-        http_printf(req, "lvgl.mutex.count=%d\n", uxSemaphoreGetCount(lvgl_mutex));
+        emit_int(&e, "lvgl.mutex.count", uxSemaphoreGetCount(lvgl_mutex));
     if (oled.mutex_i2c != NULL)
-        http_printf(req, "i2c.mutex.count=%d\n", uxSemaphoreGetCount(oled.mutex_i2c));
+        emit_int(&e, "i2c.mutex.count", uxSemaphoreGetCount(oled.mutex_i2c));
 
-    http_printf(req, "socket.max=%d\n", CONFIG_LWIP_MAX_SOCKETS);
-    http_printf(req, "socket.free=%d\n", uxSemaphoreGetCount(esp.sockets));
+    emit_int(&e, "socket.max", CONFIG_LWIP_MAX_SOCKETS);
+    emit_int(&e, "socket.free", uxSemaphoreGetCount(esp.sockets));
 
-    http_printf(req, "task.total=%zu\n", uxTaskGetNumberOfTasks());
-    http_printf(req, "task.managed=%zu\n", list_count(&tasks));
+    emit_uint(&e, "task.total", uxTaskGetNumberOfTasks());
+    emit_uint(&e, "task.managed", list_count(&tasks));
 
     iter_t itask = task_iter();
     task_t *task;
     while ((itask = task_next(itask, &task)) != NULL) {
-        http_printf(req, "task.%s(%x).stack_min=%zu\n", task->name, task->task, uxTaskGetStackHighWaterMark(task->task));
+        emit_uint(&e, emit_keyf(&e, "task.%s(%x).stack_min", task->name, task->task), uxTaskGetStackHighWaterMark(task->task));
     }
 
     nvs_stats_t nvs_stats;
     nvs_get_stats(NULL, &nvs_stats);
-    PRINT_FIELD(nvs_stats, "nvs", used_entries);
-    PRINT_FIELD(nvs_stats, "nvs", free_entries);
-    PRINT_FIELD(nvs_stats, "nvs", total_entries);
-    PRINT_FIELD(nvs_stats, "nvs", namespace_count);
+    EMIT_FIELD(nvs_stats, "nvs", used_entries);
+    EMIT_FIELD(nvs_stats, "nvs", free_entries);
+    EMIT_FIELD(nvs_stats, "nvs", total_entries);
+    EMIT_FIELD(nvs_stats, "nvs", namespace_count);
     module_t *m;
     iter_t imod = module_iter();
-    while ((imod = module_next(imod, &m)) != NULL)
-        http_printf(req, "module %d type=%d name=%s state=%d\n", m, m->type, (m->name == NULL)? "(null)" : m->name, m->state);
+    while ((imod = module_next(imod, &m)) != NULL) {
+        char *name = (m->name == NULL)? "(null)" : m->name;
+        if (e.fmt == EMIT_TEXT) {
+            emit_text(&e, "module %d type=%d name=%s state=%d\n", (int) (uintptr_t) m, m->type, name, m->state);
+            continue;
+        }
+        emit_int(&e, emit_keyf(&e, "module.%s(%x).type", name, m), m->type);
+        emit_int(&e, emit_keyf(&e, "module.%s(%x).state", name, m), m->state);
+    }
+    emit_finish(&e);
 
-//CLEANUP:
+CLEANUP:
     if (buf != NULL)
         free(buf);
-    httpd_resp_send_chunk(req, NULL, 0);
+    http_end(req);
+    return ESP_OK;
+}
+
+// Prometheus text format, probes are cached on controller (probe.c)
+static esp_err_t api_metrics(httpd_req_t *req)
+{
+    // no authorization required, like /stats
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    probe_scrape();
+    if (metrics_write(api_emit_write, req) != 0)
+        ESP_LOGW(TAG, "metrics write failed");
+    http_end(req);
     return ESP_OK;
 }
 
@@ -1261,7 +1451,10 @@ static esp_err_t api_export(httpd_req_t *req)
     if (!api_key_check(1, req, &buf, &buf_len))
         goto CLEANUP;
 
-    httpd_resp_set_type(req, "text/plain");
+    emit_t e;
+    if (!api_emit(&e, req, buf))
+        goto CLEANUP;
+
     nvs_iterator_t iter = NULL;
     // counting on this namespace to be used by nv module
     esp_err_t res = nvs_entry_find(NVS_LABEL, NVS_NAMESPACE, NVS_TYPE_ANY, &iter);
@@ -1277,72 +1470,73 @@ static esp_err_t api_export(httpd_req_t *req)
         switch (info.type) {
         case NVS_TYPE_U8:
             READ(uint8_t, u8, info);
-            http_printf(req, "%s=%"PRIu8"\n", info.key, value_u8);
+            emit_uint(&e, info.key, value_u8);
             break;
         case NVS_TYPE_I8:
             READ(int8_t, i8, info);
-            http_printf(req, "%s=%"PRIi8"\n", info.key, value_i8);
+            emit_int(&e, info.key, value_i8);
             break;
         case NVS_TYPE_U16:
             READ(uint16_t, u16, info);
-            http_printf(req, "%s=%"PRIu16"\n", info.key, value_u16);
+            emit_uint(&e, info.key, value_u16);
             break;
         case NVS_TYPE_I16:
             READ(int16_t, i16, info);
-            http_printf(req, "%s=%"PRIi16"\n", info.key, value_i16);
+            emit_int(&e, info.key, value_i16);
             break;
         case NVS_TYPE_U32:
             READ(uint32_t, u32, info);
-            http_printf(req, "%s=%"PRIu32"\n", info.key, value_u32);
+            emit_uint(&e, info.key, value_u32);
             break;
         case NVS_TYPE_I32:
             READ(int32_t, i32, info);
-            http_printf(req, "%s=%"PRIi32"\n", info.key, value_i32);
+            emit_int(&e, info.key, value_i32);
             break;
         case NVS_TYPE_U64:
             READ(uint64_t, u64, info);
-            http_printf(req, "%s=%"PRIu64"\n", info.key, value_u64);
+            emit_uint(&e, info.key, value_u64);
             break;
         case NVS_TYPE_I64:
             READ(int64_t, i64, info);
-            http_printf(req, "%s=%"PRIi64"\n", info.key, value_i64);
+            emit_int(&e, info.key, value_i64);
             break;
         case NVS_TYPE_STR:
             size_t size_str = 0;
             char *value_str;
             ESP_ERROR_CHECK(nv_read_str(info.key, &value_str, &size_str));
-            http_printf(req, "%s=%s\n", info.key, value_str);
+            emit_str(&e, info.key, value_str);
             free(value_str);
             break;
         case NVS_TYPE_BLOB:
             size_t size_blob = 0;
             ESP_ERROR_CHECK(nv_read_blob_size(info.key, &size_blob));
             //ESP_LOGW(TAG, "blob(%d) ignored", size_blob);
-            http_printf(req, "#%s=blob[%d] use /nvdump?key=%s to retrieve\n", info.key, size_blob, info.key);
+            emit_printf(&e, emit_keyf(&e, "#%s", info.key), "blob[%d] use /nvdump?key=%s to retrieve", size_blob, info.key);
 // not sure if this can cause issues in HTTP output
 // no binary data is currently used in project namespace
 #if 0
             char *value_blob;
             size_blob = 0;
             ESP_ERROR_CHECK(nv_read_blob(info.key, (void *) &value_blob, &size_blob));
-            http_printf(req, "#%s=raw[%s]\n", info.key, value_blob);
+            emit_printf(&e, emit_keyf(&e, "#%s", info.key), "raw[%s]", value_blob);
             free(value_blob);
 #endif
             break;
         case NVS_TYPE_ANY:
             ESP_LOGW(TAG, "found ANY type");
-            http_printf(req, "#%s=ANY type\n", info.key);
+            emit_str(&e, emit_keyf(&e, "#%s", info.key), "ANY type");
             break;
         }
 
         res = nvs_entry_next(&iter);
     }
     nvs_release_iterator(iter);
+    emit_finish(&e);
 
 CLEANUP:
     if (buf != NULL)
         free(buf);
-    httpd_resp_send_chunk(req, NULL, 0);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -1411,7 +1605,7 @@ static esp_err_t api_auto_post(httpd_req_t *req)
     if (buf != NULL)
         free(buf);
     // End response
-    httpd_resp_send_chunk(req, NULL, 0);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -1461,6 +1655,11 @@ static httpd_uri_t api_uris[] = {
         .method    = HTTP_GET,
         .handler   = api_heating_temp_get,
     },
+    {
+        .uri       = "/history",
+        .method    = HTTP_GET,
+        .handler   = api_history,
+    },
     {
         .uri       = "/co2/ppm",
         .method    = HTTP_GET,
@@ -1527,6 +1726,11 @@ static httpd_uri_t api_uris[] = {
         .method    = HTTP_GET,
         .handler   = api_stats,
     },
+    {
+        .uri       = "/metrics",
+        .method    = HTTP_GET,
+        .handler   = api_metrics,
+    },
     {
         .uri       = "/time/set",
         .method    = HTTP_GET,
@@ -1594,7 +1798,7 @@ esp_err_t api_help(httpd_req_t *req)
     while ((iter = list_iter(iter)) != NULL) {
         http_printf(req, "%s is_blob=%d\n", LIST(auto_handler_t, iter, name), LIST(auto_handler_t, iter, is_blob));
     }
-    httpd_resp_send_chunk(req, NULL, 0);
+    http_end(req);
     return ESP_OK;
 }
 
@@ -2,6 +2,7 @@
 #include "device.h"
 #include "esp_http_client.h"
 #include "heating.h"
+#include "outdoor.h"
 #include "module.h"
 #include "auto.h"
 #include "http.h"
@@ -13,6 +14,8 @@
 #include "ping.h"
 #include "api.h"
 #include "ota.h"
+#include "log.h"
+#include "graphite.h"
 
 #include "esp_wifi.h"
 #include "esp_log.h"
@@ -75,6 +78,31 @@ static void loglevel_handler(auto_handler_t *self, char *value)
     esp_log_level_set(name, atoi(value));
 }
 
+// NAME=RATE[,BURST]
+static void lograte_handler(auto_handler_t *self, char *value)
+{
+    if (value == NULL)
+        return;
+
+    char *name = value;
+    value = strchrnul(value, '=');
+    if (value[0] != '\0') {
+        value[0] = '\0';
+        value += 1;
+    }
+
+    char *burst = strchrnul(value, ',');
+    log_limit(name, atoi(value), (burst[0] != '\0')? atoi(burst + 1) : -1);
+}
+
+static void log_binary_handler(auto_handler_t *self, char *value)
+{
+    if (value == NULL)
+        return;
+
+    log_binary = atoi(value);
+}
+
 static void th_serial_r_handler(auto_handler_t *self, char *value)
 {
     if (value == NULL)
@@ -93,6 +121,7 @@ static void th_serial_r_handler(auto_handler_t *self, char *value)
 
     for (int i=0; i<COUNT_OF(ths); i++) {
         if (ths[i].gpio == gpio) {
+            // conversion table follows on next read
             ths[i].serial_resistance = (float) r;
             char key[] = "th.serial.XX";
             if (snprintf(&key[10], 2+1, "%d", gpio) > 0)
@@ -134,6 +163,44 @@ static void heating_relay_handler(auto_handler_t *self, char *value)
     heating_relay(name, gpio);
 }
 
+static void heating_ctl_handler(auto_handler_t *self, char *value)
+{
+    if (value == NULL)
+        return;
+
+    char *name = value;
+    value = strchrnul(value, '=');
+    if (value[0] != '\0') {
+        value[0] = '\0';
+        value += 1;
+    }
+
+    heating_ctl(name, value);
+}
+
+static void heating_est_handler(auto_handler_t *self, char *value)
+{
+    if (value == NULL)
+        return;
+
+    char *name = value;
+    value = strchrnul(value, '=');
+    if (value[0] != '\0') {
+        value[0] = '\0';
+        value += 1;
+    }
+
+    heating_est(name, value);
+}
+
+static void heating_curve_handler(auto_handler_t *self, char *value)
+{
+    if (value == NULL)
+        return;
+
+    outdoor_curve_set(value);
+}
+
 static void heating_hc_url_handler(auto_handler_t *self, char *value)
 {
     if (value == NULL)
@@ -444,6 +511,18 @@ auto_handler_t default_handlers[] = {
         .name = "heating_relay",
         .handler = heating_relay_handler,
     },
+    {
+        .name = "heating_ctl",
+        .handler = heating_ctl_handler,
+    },
+    {
+        .name = "heating_est",
+        .handler = heating_est_handler,
+    },
+    {
+        .name = "heating_curve",
+        .handler = heating_curve_handler,
+    },
     {
         .name = "heating_hc_url",
         .handler = heating_hc_url_handler,
@@ -490,6 +569,14 @@ auto_handler_t default_handlers[] = {
         .name = "loglevel",
         .handler = loglevel_handler,
     },
+    {
+        .name = "lograte",
+        .handler = lograte_handler,
+    },
+    {
+        .name = "log_binary",
+        .handler = log_binary_handler,
+    },
     {
         .name = "pm",
         .handler = pm_handler,
@@ -155,12 +155,14 @@ void check_init(int wifi)
         gpio_user[i] = NOT_EXPOSED;
 }
 
-void check_report(void *req, int (*func)(void *req, const char *fmt, ...))
+void check_report(emit_t *e)
 {
     for (int i=0; i<COUNT_OF(gpio_user); i++) {
         if (gpio_user[i] != NONE) {
-            if (req && func)
-                func(req, "GPIO %d used by %s\n", i, gpio_owner_str(gpio_user[i]));
+            if (e != NULL && e->fmt == EMIT_TEXT)
+                emit_text(e, "GPIO %d used by %s\n", i, gpio_owner_str(gpio_user[i]));
+            else if (e != NULL)
+                emit_str(e, emit_keyf(e, "gpio.%d", i), gpio_owner_str(gpio_user[i]));
             else
                 ESP_LOGI(TAG, "GPIO %d used by %s", i, gpio_owner_str(gpio_user[i]));
         }
@@ -181,8 +183,10 @@ void check_report(void *req, int (*func)(void *req, const char *fmt, ...))
             for (int x=0; x<ADC2_WIFI_USABLE; x++)
                 if (adc2_gpio[x] == i)
                     wifi = 1;
-            if (req && func)
-                func(req, "GPIO %d is FREE %s%s %s\n", i, adc1? "ADC1" : "", adc2? "ADC2" : "", wifi? "WIFI" : "");
+            if (e != NULL && e->fmt == EMIT_TEXT)
+                emit_text(e, "GPIO %d is FREE %s%s %s\n", i, adc1? "ADC1" : "", adc2? "ADC2" : "", wifi? "WIFI" : "");
+            else if (e != NULL)
+                emit_printf(e, emit_keyf(e, "gpio.%d", i), "FREE %s%s %s", adc1? "ADC1" : "", adc2? "ADC2" : "", wifi? "WIFI" : "");
             else
                 ESP_LOGI(TAG, "GPIO %d is FREE %s%s %s", i, adc1? "ADC1" : "", adc2? "ADC2" : "", wifi? "WIFI" : "");
         }
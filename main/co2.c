@@ -2,6 +2,7 @@
 #include "device.h"
 #include "co2.h"
 #include "check.h"
+#include "graphite.h"
 #include "driver/uart.h"
 
 #include "esp_log.h"
@@ -218,13 +219,17 @@ void co2_task(void *pvParameter)
 {
     //TickType_t last_task = 0;
     //time_t last_task = 0;
+    graphite_metric_t *metric = NULL;
     while (1) {
         // we can run this only via request or periodically (and send UDP?)
         co2_ppm = senseair_s8_co2_ppm();
         if (co2_ppm != -1) {
             ESP_LOGI(TAG, "PPM: %d", co2_ppm);
             co2_send(co2_ppm);
-            graphite_udp("co2.", esp.dev->hostname, "espire", co2_ppm, 1, 0);
+            if (metric == NULL)
+                metric = graphite_metric("co2.", esp.dev->hostname, "espire");
+            graphite_value(metric, co2_ppm, 1, 0);
+            graphite_flush();
        }
 
         //last_task = xTaskGetTickCount();
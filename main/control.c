@@ -0,0 +1,158 @@
+#include "control.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static char *ctl_modes[CTL_MODE_CNT] = {
+    [CTL_ONOFF] = "onoff",
+    [CTL_PI] = "pi",
+    [CTL_PID] = "pid",
+};
+
+void ctl_init(ctl_t *ctl)
+{
+    ctl->cfg = (ctl_cfg_t) {
+        .mode = CTL_ONOFF,
+        .kp = CTL_KP_DEFAULT,
+        .ti = CTL_TI_DEFAULT,
+        .td = CTL_TD_DEFAULT,
+        .window = CTL_WINDOW_DEFAULT,
+    };
+    ctl_reset(ctl);
+}
+
+// forget state, next update starts new window
+void ctl_reset(ctl_t *ctl)
+{
+    ctl->integral = 0;
+    ctl->prev = NAN;
+    ctl->out = 0;
+    ctl->duty = 0;
+    ctl->last = -1;
+    ctl->start = -1;
+    ctl->late = 0;
+}
+
+char *ctl_mode_name(int mode)
+{
+    if (mode < 0 || mode >= CTL_MODE_CNT)
+        return "?";
+    return ctl_modes[mode];
+}
+
+int ctl_mode(char *name)
+{
+    for (int i=0; i<CTL_MODE_CNT; i++)
+        if (strcmp(ctl_modes[i], name) == 0)
+            return i;
+    return -1;
+}
+
+int ctl_parse(char *value, ctl_cfg_t *cfg)
+{
+    char *end = strchrnul(value, ',');
+    char c = *end;
+    *end = '\0';
+    int mode = ctl_mode(value);
+    *end = c;
+    if (mode < 0)
+        return 0;
+
+    // kp, ti, td, window
+    float params[] = {CTL_KP_DEFAULT, CTL_TI_DEFAULT, (mode == CTL_PID)? CTL_TD_DEFAULT : 0, CTL_WINDOW_DEFAULT};
+    for (int i=0; i<COUNT_OF(params) && *end == ','; i++) {
+        value = end + 1;
+        params[i] = strtof(value, &end);
+        if (end == value)
+            return 0;
+    }
+    if (*end != '\0')
+        return 0;
+
+    // ti 0 is without integral term
+    if (!(params[0] >= 0 && params[1] >= 0 && params[2] >= 0))
+        return 0;
+    if (!(params[3] >= CTL_WINDOW_MIN && params[3] <= CTL_WINDOW_MAX))
+        return 0;
+
+    cfg->mode = mode;
+    cfg->kp = params[0];
+    cfg->ti = params[1];
+    cfg->td = params[2];
+    cfg->window = (uint16_t) params[3];
+    return 1;
+}
+
+int ctl_format(ctl_cfg_t *cfg, char *buf, int size)
+{
+    if (cfg->mode == CTL_ONOFF)
+        return snprintf(buf, size, "%s", ctl_mode_name(cfg->mode));
+    return snprintf(buf, size, "%s,%g,%.0f,%.0f,%u", ctl_mode_name(cfg->mode),
+                    cfg->kp, cfg->ti, cfg->td, cfg->window);
+}
+
+// pulse is at window start and end alternately, so pulses of two
+// windows join and relay switches about once per window
+static int ctl_pulse(ctl_t *ctl, int64_t now)
+{
+    float elapsed = now - ctl->start;
+    if (ctl->late)
+        return elapsed >= (1.0 - ctl->duty) * ctl->cfg.window;
+    return elapsed < ctl->duty * ctl->cfg.window;
+}
+
+int ctl_update(ctl_t *ctl, float set, float val, int64_t now)
+{
+    ctl_cfg_t *cfg = &ctl->cfg;
+    if (isnanf(set) || isnanf(val)) {
+        // integral is kept, window starts over when value is back
+        ctl->last = -1;
+        ctl->start = -1;
+        ctl->duty = 0;
+        return 0;
+    }
+
+    float err = set - val;
+    if (cfg->mode == CTL_ONOFF)
+        return err > 0;
+
+    // long gaps (heating unavailable) count as one window
+    float dt = (ctl->last < 0)? 0 : (now - ctl->last);
+    if (dt > cfg->window)
+        dt = cfg->window;
+    ctl->last = now;
+
+    // anti-windup, integral doesn't grow while output is saturated
+    // in the same direction
+    if (cfg->ti > 0 && dt > 0 && !(ctl->out >= 1.0 && err > 0) && !(ctl->out <= 0.0 && err < 0)) {
+        ctl->integral += cfg->kp * err * dt / cfg->ti;
+        if (ctl->integral < 0.0)
+            ctl->integral = 0.0;
+        else if (ctl->integral > 1.0)
+            ctl->integral = 1.0;
+    }
+
+    if (ctl->start >= 0 && now - ctl->start < cfg->window)
+        return ctl_pulse(ctl, now);
+
+    // new window, derivative over previous window filters sensor steps
+    float d = 0;
+    if (cfg->mode == CTL_PID && ctl->start >= 0 && !isnanf(ctl->prev) && now > ctl->start)
+        d = -cfg->kp * cfg->td * (val - ctl->prev) / (now - ctl->start);
+    ctl->prev = val;
+    ctl->start = now;
+    ctl->late = !ctl->late;
+
+    ctl->out = cfg->kp * err + ctl->integral + d;
+    float duty = ctl->out;
+    if (duty * cfg->window < CTL_PULSE_MIN_S)
+        duty = 0.0;
+    else if ((1.0 - duty) * cfg->window < CTL_PULSE_MIN_S)
+        duty = 1.0;
+    ctl->duty = duty;
+
+    return ctl_pulse(ctl, now);
+}
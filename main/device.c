@@ -22,6 +22,7 @@
 #include "httpd.h"
 #include "ntp.h"
 #include "util.h"
+#include "graphite.h"
 #include "heap.h"
 #include "auto.h"
 #include "api.h"
@@ -31,6 +32,7 @@
 #include "ota.h"
 #include "dummy.h"
 #include "log.h"
+#include "probe.h"
 
 #include "nvs_flash.h"
 #include "esp_sleep.h"
@@ -403,7 +405,7 @@ void device_init(device_t *dev)
     temp_run(NULL, 1);
 
     // print GPIO usage
-    check_report(NULL, NULL);
+    check_report(NULL);
 
     api_init(httpd);
     // seen hang on oled_power so make extra httpd
@@ -439,6 +441,8 @@ void device_init(device_t *dev)
 
     // monitor memory leaks
     heap_init(lowmem_reboot);
+    // cached heap, NVS and task numbers for /metrics
+    probe_init();
 
     ota_main();
     thermostat_init();
@@ -469,24 +473,25 @@ void sleep_task(sleep_t *self)
         // TODO
         ESP_LOGI(TAG, "ntp %lld activity %lld wifi_count %d", ntp_synced, now.tv_sec - esp.activity, wifi_count);
         if ((!esp.dev->controller || ntp_synced) && now.tv_sec - esp.activity >= 60 && wifi_count > 0) {
-            list_t *item = &wifi_owner;
+            wifi_owner_t owners[WIFI_OWNERS_MAX];
+            int cnt = wifi_owners(owners, COUNT_OF(owners));
             time_t now;
             time(&now);
-            // both iterations are risky, can be freed during iteration
-            while ((item = list_iter(item)) != NULL) {
+            for (int i=0; i<cnt; i++) {
+                // task list can still change, only for logging
                 extern list_t tasks;
                 list_t *iter = &tasks;
                 int found = 0;
                 while ((iter = list_iter(iter)) != NULL) {
-                    if (LIST(task_t, iter, task) == LIST(wifi_owner_t, item, task)) {
+                    if (LIST(task_t, iter, task) == owners[i].task) {
                         found = 1;
                         break;
                     }
                 }
                 if (!found)
-                    ESP_LOGW(TAG, "wifi owner %x (%llds) does not exist", (size_t) LIST(wifi_owner_t, item, task), now - LIST(wifi_owner_t, item, time));
+                    ESP_LOGW(TAG, "wifi owner %x (%llds) does not exist", (size_t) owners[i].task, now - owners[i].time);
                 else
-                    ESP_LOGW(TAG, "wifi owner %x (%llds)", (size_t) LIST(wifi_owner_t, item, task), now - LIST(wifi_owner_t, item, time));
+                    ESP_LOGW(TAG, "wifi owner %x (%llds)", (size_t) owners[i].task, now - owners[i].time);
             }
         }
         //if ((!esp.dev->controller || ntp_synced) && now.tv_sec - esp.activity >= 60 && wifi_count == 0) {
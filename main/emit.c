@@ -0,0 +1,367 @@
+#include "emit.h"
+#include "util.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+static char *emit_fmts[EMIT_FMT_CNT] = {
+    [EMIT_TEXT] = "text",
+    [EMIT_JSON] = "json",
+    [EMIT_CBOR] = "cbor",
+};
+
+static char *emit_types[EMIT_FMT_CNT] = {
+    [EMIT_TEXT] = "text/plain",
+    [EMIT_JSON] = "application/json",
+    [EMIT_CBOR] = "application/cbor",
+};
+
+// CBOR major types
+enum {
+    CBOR_UINT,
+    CBOR_NINT,
+    CBOR_BYTES,
+    CBOR_TEXT,
+    CBOR_ARRAY,
+    CBOR_MAP,
+};
+#define CBOR_INDEFINITE 31
+#define CBOR_FLOAT32 0xfa
+#define CBOR_FLOAT64 0xfb
+#define CBOR_NULL 0xf6
+#define CBOR_BREAK 0xff
+
+char *emit_fmt_name(int fmt)
+{
+    if (fmt < 0 || fmt >= EMIT_FMT_CNT)
+        return "?";
+    return emit_fmts[fmt];
+}
+
+int emit_fmt(char *name)
+{
+    for (int i=0; i<EMIT_FMT_CNT; i++)
+        if (strcmp(emit_fmts[i], name) == 0)
+            return i;
+    return -1;
+}
+
+char *emit_type(int fmt)
+{
+    if (fmt < 0 || fmt >= EMIT_FMT_CNT)
+        return emit_types[EMIT_TEXT];
+    return emit_types[fmt];
+}
+
+void emit_init(emit_t *e, int fmt, emit_write_t write, void *ctx)
+{
+    assert(fmt >= 0 && fmt < EMIT_FMT_CNT);
+    memset(e, 0, sizeof(emit_t));
+    e->fmt = fmt;
+    e->write = write;
+    e->ctx = ctx;
+}
+
+static void emit_out(emit_t *e, const char *buf, int len)
+{
+    if (e->err == 0 && len > 0)
+        e->err = e->write(e->ctx, buf, len);
+}
+
+// initial byte and n-1 big endian bytes of val
+static void emit_cbor_be(emit_t *e, uint8_t initial, uint64_t val, int n)
+{
+    uint8_t buf[1+8];
+    buf[0] = initial;
+    for (int i=n-1; i>0; i--) {
+        buf[i] = val & 0xff;
+        val >>= 8;
+    }
+    emit_out(e, (char *) buf, n);
+}
+
+static void emit_cbor_head(emit_t *e, int major, uint64_t val)
+{
+    if (val < 24)
+        emit_cbor_be(e, major << 5 | val, 0, 1);
+    else if (val <= UINT8_MAX)
+        emit_cbor_be(e, major << 5 | 24, val, 1+1);
+    else if (val <= UINT16_MAX)
+        emit_cbor_be(e, major << 5 | 25, val, 1+2);
+    else if (val <= UINT32_MAX)
+        emit_cbor_be(e, major << 5 | 26, val, 1+4);
+    else
+        emit_cbor_be(e, major << 5 | 27, val, 1+8);
+}
+
+// quoted, unescaped runs are written at once
+static void emit_json_str(emit_t *e, const char *str, int len)
+{
+    emit_out(e, "\"", 1);
+    const char *run = str;
+    for (int i=0; i<len; i++) {
+        unsigned char c = str[i];
+        if (c >= ' ' && c != '"' && c != '\\')
+            continue;
+
+        emit_out(e, run, str + i - run);
+        char esc[2+4+1];
+        int n;
+        if (c == '"' || c == '\\')
+            n = snprintf(esc, sizeof(esc), "\\%c", c);
+        else
+            n = snprintf(esc, sizeof(esc), "\\u%04x", c);
+        emit_out(e, esc, n);
+        run = str + i + 1;
+    }
+    emit_out(e, run, str + len - run);
+    emit_out(e, "\"", 1);
+}
+
+static void emit_string(emit_t *e, const char *str, int len)
+{
+    switch (e->fmt) {
+    case EMIT_TEXT:
+        emit_out(e, str, len);
+        break;
+    case EMIT_JSON:
+        emit_json_str(e, str, len);
+        break;
+    case EMIT_CBOR:
+        emit_cbor_head(e, CBOR_TEXT, len);
+        emit_out(e, str, len);
+        break;
+    }
+}
+
+static int emit_in_array(emit_t *e)
+{
+    return e->depth > 0 && e->array[e->depth];
+}
+
+// separator and key of next value (key is ignored inside arrays)
+static void emit_key(emit_t *e, const char *key)
+{
+    if (emit_in_array(e))
+        key = NULL;
+
+    if (e->fmt == EMIT_JSON && e->depth > 0 && !e->first[e->depth])
+        emit_out(e, ",", 1);
+    e->first[e->depth] = 0;
+
+    if (key == NULL)
+        return;
+    emit_string(e, key, strlen(key));
+    if (e->fmt == EMIT_TEXT)
+        emit_out(e, "=", 1);
+    else if (e->fmt == EMIT_JSON)
+        emit_out(e, ":", 1);
+}
+
+// text values are lines, space separated in arrays
+static void emit_value_end(emit_t *e)
+{
+    if (e->fmt != EMIT_TEXT)
+        return;
+    if (emit_in_array(e))
+        emit_out(e, " ", 1);
+    else
+        emit_out(e, "\n", 1);
+}
+
+// already formatted number (text and JSON)
+static void emit_number(emit_t *e, const char *key, const char *buf, int len)
+{
+    emit_key(e, key);
+    emit_out(e, buf, len);
+    emit_value_end(e);
+}
+
+static void emit_open(emit_t *e, const char *key, int array)
+{
+    assert(e->depth < EMIT_DEPTH);
+    if (e->fmt != EMIT_TEXT || array)
+        emit_key(e, key);
+    else
+        e->first[e->depth] = 0;
+
+    if (e->fmt == EMIT_JSON)
+        emit_out(e, array? "[" : "{", 1);
+    else if (e->fmt == EMIT_CBOR)
+        emit_cbor_be(e, (array? CBOR_ARRAY : CBOR_MAP) << 5 | CBOR_INDEFINITE, 0, 1);
+
+    e->depth++;
+    e->array[e->depth] = array;
+    e->first[e->depth] = 1;
+}
+
+void emit_map(emit_t *e, const char *key)
+{
+    emit_open(e, key, 0);
+}
+
+void emit_array(emit_t *e, const char *key)
+{
+    emit_open(e, key, 1);
+}
+
+void emit_close(emit_t *e)
+{
+    assert(e->depth > 0);
+    int array = e->array[e->depth];
+    e->depth--;
+
+    if (e->fmt == EMIT_JSON)
+        emit_out(e, array? "]" : "}", 1);
+    else if (e->fmt == EMIT_CBOR)
+        emit_cbor_be(e, CBOR_BREAK, 0, 1);
+    else if (array)
+        emit_value_end(e);
+}
+
+int emit_finish(emit_t *e)
+{
+    while (e->depth > 0)
+        emit_close(e);
+    return e->err;
+}
+
+char *emit_keyf(emit_t *e, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vsnprintf(e->key, sizeof(e->key), format, args);
+    va_end(args);
+    return e->key;
+}
+
+void emit_int(emit_t *e, const char *key, int64_t val)
+{
+    if (e->fmt == EMIT_CBOR) {
+        emit_key(e, key);
+        if (val >= 0)
+            emit_cbor_head(e, CBOR_UINT, val);
+        else
+            emit_cbor_head(e, CBOR_NINT, -(val + 1));
+        return;
+    }
+
+    char buf[21];
+    emit_number(e, key, buf, snprintf(buf, sizeof(buf), "%lld", (long long) val));
+}
+
+void emit_uint(emit_t *e, const char *key, uint64_t val)
+{
+    if (e->fmt == EMIT_CBOR) {
+        emit_key(e, key);
+        emit_cbor_head(e, CBOR_UINT, val);
+        return;
+    }
+
+    char buf[21];
+    emit_number(e, key, buf, snprintf(buf, sizeof(buf), "%llu", (unsigned long long) val));
+}
+
+void emit_float(emit_t *e, const char *key, double val, int prec)
+{
+    int valid = !isnan(val) && !isinf(val);
+    if (e->fmt == EMIT_CBOR) {
+        emit_key(e, key);
+        if (!valid) {
+            emit_cbor_be(e, CBOR_NULL, 0, 1);
+        } else if ((float) val == val) {
+            union { float f; uint32_t u; } v = { .f = val };
+            emit_cbor_be(e, CBOR_FLOAT32, v.u, 1+4);
+        } else {
+            union { double d; uint64_t u; } v = { .d = val };
+            emit_cbor_be(e, CBOR_FLOAT64, v.u, 1+8);
+        }
+        return;
+    }
+
+    if (e->fmt == EMIT_JSON && !valid) {
+        emit_number(e, key, "null", 4);
+        return;
+    }
+
+    // huge values are cut
+    char buf[48];
+    int len;
+    if (prec < 0)
+        len = snprintf(buf, sizeof(buf), "%f", val);
+    else
+        len = snprintf(buf, sizeof(buf), "%.*f", prec, val);
+    if (len >= sizeof(buf))
+        len = sizeof(buf) - 1;
+    emit_number(e, key, buf, len);
+}
+
+void emit_str(emit_t *e, const char *key, const char *val)
+{
+    emit_key(e, key);
+    emit_string(e, val, strlen(val));
+    emit_value_end(e);
+}
+
+void emit_printf(emit_t *e, const char *key, const char *format, ...)
+{
+    char buf[EMIT_PRINTF_MAX];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len < 0)
+        len = 0;
+    else if (len >= sizeof(buf))
+        len = sizeof(buf) - 1;
+
+    emit_key(e, key);
+    emit_string(e, buf, len);
+    emit_value_end(e);
+}
+
+void emit_text(emit_t *e, const char *format, ...)
+{
+    if (e->fmt != EMIT_TEXT)
+        return;
+
+    char buf[EMIT_PRINTF_MAX];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len >= (int) sizeof(buf))
+        len = sizeof(buf) - 1;
+    emit_out(e, buf, len);
+}
+
+void emit_hex(emit_t *e, const char *key, const uint8_t *val, int len)
+{
+    emit_key(e, key);
+    if (e->fmt == EMIT_CBOR) {
+        emit_cbor_head(e, CBOR_BYTES, len);
+        emit_out(e, (char *) val, len);
+        return;
+    }
+
+    if (e->fmt == EMIT_JSON)
+        emit_out(e, "\"", 1);
+    static const char digits[] = "0123456789abcdef";
+    char buf[64];
+    int n = 0;
+    for (int i=0; i<len; i++) {
+        buf[n++] = digits[val[i] >> 4];
+        buf[n++] = digits[val[i] & 0x0f];
+        if (n == sizeof(buf)) {
+            emit_out(e, buf, n);
+            n = 0;
+        }
+    }
+    emit_out(e, buf, n);
+    if (e->fmt == EMIT_JSON)
+        emit_out(e, "\"", 1);
+    emit_value_end(e);
+}
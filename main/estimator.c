@@ -0,0 +1,156 @@
+#include "estimator.h"
+#include "util.h"
+
+#include <string.h>
+#include <math.h>
+
+static char *est_modes[EST_MODE_CNT] = {
+    [EST_MIN] = "min",
+    [EST_EWMA] = "ewma",
+    [EST_KALMAN] = "kalman",
+};
+
+void est_init(est_t *est, int mode)
+{
+    est->mode = mode;
+    est_reset(est);
+}
+
+void est_reset(est_t *est)
+{
+    est->n = 0;
+    est->reject = 0;
+    est->x = NAN;
+    est->p = EST_R_INIT;
+    est->r = EST_R_INIT;
+    est->last = -1;
+    est->i = 0;
+    for (int i=0; i<COUNT_OF(est->vals); i++)
+        est->vals[i] = NAN;
+}
+
+char *est_mode_name(int mode)
+{
+    if (mode < 0 || mode >= EST_MODE_CNT)
+        return "?";
+    return est_modes[mode];
+}
+
+int est_mode(char *name)
+{
+    for (int i=0; i<EST_MODE_CNT; i++)
+        if (strcmp(est_modes[i], name) == 0)
+            return i;
+    return -1;
+}
+
+// circular buffer, lowest value, missing measurement is NAN
+static float est_min(est_t *est, float z)
+{
+    est->vals[est->i] = z;
+    est->i = (est->i + 1) % COUNT_OF(est->vals);
+    float val = z;
+    for (int i=0; i<COUNT_OF(est->vals); i++)
+        if (!isnanf(est->vals[i]) && est->vals[i] < val)
+            val = est->vals[i];
+    return val;
+}
+
+// 1 if z is kept
+static int est_gate(est_t *est, float d, float s)
+{
+    if (est->n < EST_WARMUP || d*d <= EST_GATE*EST_GATE * s) {
+        est->reject = 0;
+        return 1;
+    }
+
+    est->reject += 1;
+    if (est->reject < EST_REJECT_MAX)
+        return 0;
+    // step, start over from this measurement
+    float r = est->r;
+    est_reset(est);
+    est->r = r;
+    return 1;
+}
+
+static void est_noise_update(est_t *est, float r)
+{
+    est->r += EST_R_ALPHA * (r - est->r);
+    if (est->r < EST_R_MIN)
+        est->r = EST_R_MIN;
+    else if (est->r > EST_R_MAX)
+        est->r = EST_R_MAX;
+}
+
+float est_update(est_t *est, float z, int64_t now)
+{
+    if (est->mode == EST_MIN)
+        return est_min(est, z);
+
+    if (isnanf(z)) {
+        // stale or faulty sensor, keep learned noise
+        float r = est->r;
+        est_reset(est);
+        est->r = r;
+        return NAN;
+    }
+
+    if (est->n == 0) {
+        est->x = z;
+        est->p = est->r;
+    } else if (est->mode == EST_EWMA) {
+        float d = z - est->x;
+        if (!est_gate(est, d, est->r))
+            return est->x;
+        if (est->n == 0) {
+            est->x = z;
+        } else {
+            est->x += EST_EWMA_ALPHA * d;
+            est_noise_update(est, d*d);
+        }
+    } else {
+        // predict, random walk since last measurement
+        float dt = (est->last < 0 || now < est->last)? 0 : (now - est->last);
+        float p = est->p + EST_Q * dt;
+        float d = z - est->x;
+        float s = p + est->r;
+        if (!est_gate(est, d, s))
+            return est->x;
+        if (est->n == 0) {
+            est->x = z;
+            est->p = est->r;
+        } else {
+            float k = p / s;
+            est->x += k * d;
+            est->p = (1 - k) * p;
+            // innovation variance is p + r
+            est_noise_update(est, d*d - p);
+        }
+    }
+
+    est->last = now;
+    if (est->n < UINT8_MAX)
+        est->n += 1;
+    return est->x;
+}
+
+void est_shift(est_t *est, float delta)
+{
+    est->x += delta;
+    for (int i=0; i<COUNT_OF(est->vals); i++)
+        est->vals[i] += delta;
+}
+
+float est_noise(est_t *est)
+{
+    if (est->mode == EST_MIN || est->n < EST_WARMUP)
+        return NAN;
+    return sqrtf(est->r);
+}
+
+int est_stable(est_t *est)
+{
+    return est->mode != EST_MIN && est->n >= EST_WARMUP &&
+           est->reject == 0 && est->r < EST_STABLE_SD*EST_STABLE_SD;
+}
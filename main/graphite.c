@@ -0,0 +1,356 @@
+#include "config.h"
+#include "device.h"
+#include "graphite.h"
+#include "ntp.h"
+#include "ping.h"
+#include "util.h"
+#include "wifi.h"
+#include "nv.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+
+#include "esp_log.h"
+static const char *TAG = "graphite";
+
+// longest "prefix+metric;tag1=tag "
+#define GRAPHITE_KEY_MAX 80
+
+struct sockaddr_in GRAPHITE_SA = {0};
+static int g_sock_udp = -1;
+
+// lines waiting for next datagram
+static char *batch = NULL;
+static int batch_len = 0;
+static TickType_t batch_start = 0;
+// sends batch GRAPHITE_FLUSH_MS after its first line
+static TimerHandle_t batch_timer = NULL;
+
+// timestamped lines while offline, oldest are dropped when full
+static char *backlog = NULL;
+static int backlog_len = 0;
+
+uint32_t graphite_sent = 0;
+uint32_t graphite_datagrams = 0;
+uint32_t graphite_dropped = 0;
+
+static SemaphoreHandle_t mutex = NULL;
+static void GRAPHITE_ENTER()
+{
+    if (mutex == NULL) {
+        mutex = xSemaphoreCreateMutex();
+        assert(mutex != NULL);
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+}
+
+static void GRAPHITE_EXIT()
+{
+    xSemaphoreGive(mutex);
+}
+
+int graphite_init(char *host, int port)
+{
+    int ret = 0;
+    uint16_t nv;
+
+    if (port == 0) {
+        port = GRAPHITE_UDP_PORT_DEFAULT;
+        if (nv_read_u16("graphite.port", &nv) == ESP_OK)
+            if (port != nv) {
+                port = nv;
+                ret = 1;
+            }
+    }
+
+    if (host == NULL) {
+        size_t size;
+        if (nv_read_str("graphite.ip", &host, &size) != ESP_OK) {
+            ret = init_sa(GRAPHITE_IP_DEFAULT, port, &GRAPHITE_SA);
+        } else {
+            ret = init_sa(host, port, &GRAPHITE_SA);
+            free(host);
+            host = NULL;
+        }
+    } else {
+        ret = init_sa(host, port, &GRAPHITE_SA);
+    }
+
+    if (ret != 0 && g_sock_udp != -1) {
+        close(g_sock_udp);
+        g_sock_udp = -1;
+        xSemaphoreGive(esp.sockets);
+    }
+
+    ESP_LOGI(TAG, "init: %s:%d: %d", (host)? host : GRAPHITE_IP_DEFAULT, port, ret);
+    return ret;
+}
+
+static int graphite_socket()
+{
+    if (g_sock_udp != -1)
+        return 0;
+
+    graphite_init(NULL, 0);
+    // don't block
+    if (xSemaphoreTake(esp.sockets, 0/*S_TO_TICK(1)*/) == pdFALSE) {
+        ESP_LOGE(TAG, "no sockets available");
+        return 4;
+    }
+    if ((g_sock_udp = socket(PF_INET, SOCK_DGRAM, 0)) == -1) {
+        ESP_LOGE(TAG, "socket: %s", strerror(errno));
+        xSemaphoreGive(esp.sockets);
+        return 1;
+    }
+
+    return 0;
+}
+
+// ping is not running on every device (-1)
+static inline int graphite_online()
+{
+    return wifi_connected && ping_online.connected != 0;
+}
+
+static int graphite_send(char *data, int len)
+{
+    if (graphite_socket() != 0)
+        return 1;
+
+    ssize_t s = sendto(g_sock_udp, data, len,
+                       MSG_DONTWAIT, (struct sockaddr *) &GRAPHITE_SA, sizeof(GRAPHITE_SA));
+    if (s == -1) {
+        ESP_LOGE(TAG, "graphite errno %s", strerror(errno));
+        return 3;
+    }
+
+    graphite_datagrams += 1;
+    return 0;
+}
+
+static void graphite_backlog_add(char *line, int len)
+{
+    if (backlog == NULL) {
+        backlog = malloc(GRAPHITE_BACKLOG_SIZE);
+        if (backlog == NULL) {
+            graphite_dropped += 1;
+            return;
+        }
+    }
+
+    // drop oldest lines
+    int drop = 0;
+    while (backlog_len - drop + len > GRAPHITE_BACKLOG_SIZE) {
+        char *eol = memchr(backlog + drop, '\n', backlog_len - drop);
+        assert(eol != NULL);
+        drop = eol - backlog + 1;
+        graphite_dropped += 1;
+    }
+    if (drop > 0) {
+        memmove(backlog, backlog + drop, backlog_len - drop);
+        backlog_len -= drop;
+    }
+
+    memcpy(backlog + backlog_len, line, len);
+    backlog_len += len;
+}
+
+// datagrams are cut at line boundary
+static int graphite_backfill()
+{
+    int ret = 0;
+    int sent = 0;
+    while (sent < backlog_len) {
+        int len = backlog_len - sent;
+        if (len > GRAPHITE_BATCH_SIZE) {
+            char *eol = backlog + sent + GRAPHITE_BATCH_SIZE;
+            while (eol[-1] != '\n')
+                --eol;
+            len = eol - (backlog + sent);
+        }
+
+        if ((ret = graphite_send(backlog + sent, len)) != 0)
+            break;
+        sent += len;
+    }
+
+    if (sent > 0) {
+        ESP_LOGI(TAG, "backfilled %d bytes", sent);
+        memmove(backlog, backlog + sent, backlog_len - sent);
+        backlog_len -= sent;
+    }
+
+    // not needed after reconnect
+    if (backlog_len == 0 && backlog != NULL) {
+        free(backlog);
+        backlog = NULL;
+    }
+
+    return ret;
+}
+
+// needs mutex
+static int graphite_flush_()
+{
+    int ret = 0;
+    if (backlog_len > 0)
+        ret = graphite_backfill();
+
+    if (batch_len == 0)
+        return ret;
+
+    // whatever could get out, everything else is lost now
+    ret = graphite_send(batch, batch_len);
+    batch_len = 0;
+    return ret;
+}
+
+int graphite_flush()
+{
+    int ret = 0;
+    GRAPHITE_ENTER();
+    if (graphite_online())
+        ret = graphite_flush_();
+    GRAPHITE_EXIT();
+    return ret;
+}
+
+// runs in timer task, it can't wait for mutex and has small stack so
+// socket is only reused (first flush by caller creates it)
+static void graphite_batch_timer(TimerHandle_t timer)
+{
+    if (xSemaphoreTake(mutex, 0) != pdTRUE) {
+        xTimerReset(timer, 0);
+        return;
+    }
+    if (batch_len > 0 && g_sock_udp != -1 && graphite_online())
+        graphite_flush_();
+    GRAPHITE_EXIT();
+}
+
+// "prefix+metric;tag1=tag " is formatted once per metric
+static list_t metrics = {0};
+
+graphite_metric_t *graphite_metric(char *prefix, char *metric, char *tag)
+{
+    char key[GRAPHITE_KEY_MAX];
+    int len = snprintf(key, sizeof(key), "%s%s;tag1=%s ", prefix, metric, tag);
+    if (len < 0 || len >= sizeof(key)) {
+        ESP_LOGE(TAG, "metric key too long: %s%s, %s", prefix, metric, tag);
+        return NULL;
+    }
+
+    graphite_metric_t *m = NULL;
+    GRAPHITE_ENTER();
+    for (list_t *item = metrics.next; item != NULL; item = item->next) {
+        graphite_metric_t *i = item->data;
+        if (i->len == len && memcmp(i->key, key, len) == 0) {
+            m = i;
+            goto CLEANUP;
+        }
+    }
+
+    if ((m = malloc(sizeof(graphite_metric_t) + len)) == NULL)
+        goto CLEANUP;
+    m->key = (char *) (m + 1);
+    m->len = len;
+    memcpy(m->key, key, len);
+    list_prepend(&metrics, m);
+
+CLEANUP:
+    GRAPHITE_EXIT();
+    return m;
+}
+
+// adds formatted line to batch or backlog
+static int graphite_line(char *line, int len, int online)
+{
+    int ret = 0;
+
+    ESP_LOGD(TAG, "%.*s", len - 1, line);
+    GRAPHITE_ENTER();
+    graphite_sent += 1;
+    if (!online) {
+        graphite_backlog_add(line, len);
+        goto CLEANUP;
+    }
+
+    if (batch == NULL && (batch = malloc(GRAPHITE_BATCH_SIZE)) == NULL) {
+        ret = 1;
+        goto CLEANUP;
+    }
+
+    if (batch_len + len > GRAPHITE_BATCH_SIZE)
+        ret = graphite_flush_();
+
+    TickType_t tick_now = xTaskGetTickCount();
+    if (batch_len == 0) {
+        batch_start = tick_now;
+        if (batch_timer == NULL)
+            batch_timer = xTimerCreate("graphite", MS_TO_TICK(GRAPHITE_FLUSH_MS), pdFALSE, NULL, graphite_batch_timer);
+        // starts dormant timer too
+        if (batch_timer != NULL)
+            xTimerReset(batch_timer, 0);
+    }
+    memcpy(batch + batch_len, line, len);
+    batch_len += len;
+
+    // timer above covers quiet period after last metric
+    if (tick_now - batch_start >= MS_TO_TICK(GRAPHITE_FLUSH_MS))
+        ret = graphite_flush_();
+
+CLEANUP:
+    GRAPHITE_EXIT();
+    return ret;
+}
+
+int graphite_value(graphite_metric_t *m, float val, int now, time_t ts)
+{
+    if (m == NULL)
+        return 2;
+
+    int online = graphite_online();
+    // timestamp is needed for backfill
+    if ((!now || !online) && (ntp_synced || api_synced)) {
+        if (!ts)
+            time(&ts);
+    } else if (online)
+        ts = 0;
+    else {
+        graphite_dropped += 1;
+        return 5;
+    }
+
+    // key is limited, value and timestamp always fit
+    char line[GRAPHITE_KEY_MAX + FORMAT_FIXED_SIZE + 1 + 21 + 1];
+    char *p = line;
+    memcpy(p, m->key, m->len);
+    p += m->len;
+    p += format_fixed(p, val, 2);
+    if (ts) {
+        *p++ = ' ';
+        p += format_int(p, ts);
+    }
+    *p++ = '\n';
+
+    return graphite_line(line, p - line, online);
+}
+
+int graphite_udp(char *prefix, char *metric, char *tag, float val, int now, time_t ts)
+{
+    return graphite_value(graphite_metric(prefix, metric, tag), val, now, ts);
+}
+
+int graphite_backlog()
+{
+    return backlog_len;
+}
@@ -8,24 +8,106 @@
 #include "api.h"
 #include "nv.h"
 #include "util.h"
+#include "graphite.h"
+#include "outdoor.h"
+#include "adc2.h"
+#include "zone.h"
 
 #include <string.h>
 #include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/atomic.h"
+#include "freertos/semphr.h"
 
 #include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_mac.h"
+#if HEATING_UDP_AEAD
+#include "mbedtls/gcm.h"
+#endif
 
 static const char *TAG = "heating";
 
-static list_t zones = {0};
+// zones are never removed, lookup is lock-free and index slot is published
+// after the zone is initialized
+// table is allocated with the first zone and never freed, size comes
+// from Kconfig (thermostat needs fewer than controller)
+static heating_t *zones = NULL;
+static volatile uint32_t zones_cnt = 0;
+// open addressing, zone index + 1 (0 is empty), load is at most 1/2
+#define HEATING_INDEX_SIZE (2*HEATING_ZONES_MAX)
+static volatile uint32_t zones_index[HEATING_INDEX_SIZE];
 static char *heating_hc_url = NULL;
 static int hc_url_reload = 0;
 // last known status - 0 if globally off or API unavailable
 static int hc_status = 0;
 
+// incremented on every zone change, clients ask for changes after
+// generation they have seen
+static volatile uint32_t heating_gen = 0;
+// controller pushes changes to subscribed clients
+static task_t *th_push_task = NULL;
+
+static SemaphoreHandle_t zones_mutex = NULL;
+static void HEATING_ENTER()
+{
+    if (zones_mutex == NULL) {
+        zones_mutex = xSemaphoreCreateMutex();
+        assert(zones_mutex != NULL);
+    }
+
+    xSemaphoreTake(zones_mutex, portMAX_DELAY);
+}
+
+static void HEATING_EXIT()
+{
+    xSemaphoreGive(zones_mutex);
+}
+
+static void heating_changed(heating_t *data)
+{
+    // returns previous value
+    data->gen = Atomic_Increment_u32(&heating_gen) + 1;
+    if (th_push_task != NULL)
+        xTaskNotifyGive(th_push_task->task);
+}
+
+// FNV-1a
+static uint32_t heating_hash(char *name)
+{
+    uint32_t h = 2166136261u;
+    for (int i=0; i<member_size(heating_t, name) && name[i] != '\0'; i++) {
+        h ^= (uint8_t) name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// returns zone or index slot where it would be added
+static heating_t *heating_lookup(char *name, uint32_t hash, volatile uint32_t **empty)
+{
+    for (int i=0; i<HEATING_INDEX_SIZE; i++) {
+        volatile uint32_t *slot = &zones_index[(hash + i) % HEATING_INDEX_SIZE];
+        if (*slot == 0) {
+            *empty = slot;
+            return NULL;
+        }
+
+        heating_t *data = &zones[*slot - 1];
+        if (strncmp(data->name, name, sizeof(data->name)) == 0)
+            return data;
+    }
+
+    // can't happen with load 1/2
+    *empty = NULL;
+    return NULL;
+}
+
 heating_t *heating_find(char *name, int create)
 {
-    list_t *item = &zones;
     heating_t *data = NULL;
+    volatile uint32_t *slot = NULL;
 
     if (name[0] == '\0'){
         ESP_LOGE(TAG, "empty name");
@@ -37,62 +119,109 @@ heating_t *heating_find(char *name, int create)
         return NULL;
     }
 
-    while ((item = list_iter(item)) != NULL) {
-        if (strncmp(LIST(heating_t, item, name), name, sizeof(data->name)) == 0) {
-            data = (heating_t *) item->data;
-            break;
-        }
+    uint32_t hash = heating_hash(name);
+    data = heating_lookup(name, hash, &slot);
+    if (data != NULL || !create)
+        return data;
+
+    HEATING_ENTER();
+    // someone could be faster
+    if ((data = heating_lookup(name, hash, &slot)) != NULL)
+        goto CLEANUP;
+
+    if (zones_cnt >= HEATING_ZONES_MAX || slot == NULL) {
+        ESP_LOGE(TAG, "too many zones, can't add '%s'", name);
+        goto CLEANUP;
     }
 
-    if (data == NULL && create) {
-        ESP_LOGI(TAG, "adding '%s'", name);
-        data = calloc(1, sizeof(heating_t));
-        assert(data != NULL);
-        strncpy(data->name, name, sizeof(data->name));
-        data->valid = xTaskGetTickCount();
-        data->val = NAN;
-        data->set = NAN;
-        data->fix = 0;
-        for (int i=0; i<COUNT_OF(data->vals); i++)
-            data->vals[i] = NAN;
-        data->relay = -1;
-        data->state = !HEATING_ON;
-
-        char skey[5+member_size(heating_t, name)] = "tset.";
-        strncpy(skey+5, data->name, strlen(data->name));
-        size_t size = 0;
-        char *set = NULL;
-        nv_read_str(skey, &set, &size);
-        if (set != NULL) {
-            data->set = strtof(set, NULL);
-            free(set);
-        }
+    // nobody reads the table before the first index slot is published
+    if (zones == NULL && (zones = calloc(HEATING_ZONES_MAX, sizeof(heating_t))) == NULL) {
+        ESP_LOGE(TAG, "no memory for %d zones", HEATING_ZONES_MAX);
+        goto CLEANUP;
+    }
 
-        char fkey[5+member_size(heating_t, name)] = "tfix.";
-        strncpy(fkey+5, data->name, strlen(data->name));
-        //size_t size = 0;
-        char *fix = NULL;
-        nv_read_str(fkey, &fix, &size);
-        if (fix != NULL) {
-            data->fix = strtof(fix, NULL);
-            free(fix);
-        }
+    ESP_LOGI(TAG, "adding '%s'", name);
+    data = &zones[zones_cnt];
+    memset(data, 0, sizeof(heating_t));
+    strncpy(data->name, name, sizeof(data->name));
+    data->valid = xTaskGetTickCount();
+    data->val = NAN;
+    data->set = NAN;
+    data->fix = 0;
+    for (int i=0; i<COUNT_OF(data->vals); i++)
+        data->vals[i] = NAN;
+    data->relay = -1;
+    data->want = !HEATING_ON;
+    data->state = !HEATING_ON;
+    ctl_init(&data->ctl);
+    est_init(&data->est, EST_DEFAULT);
+    // new zone is a change too
+    heating_changed(data);
+
+    char skey[5+member_size(heating_t, name)] = "tset.";
+    strncpy(skey+5, data->name, strlen(data->name));
+    size_t size = 0;
+    char *set = NULL;
+    nv_read_str(skey, &set, &size);
+    if (set != NULL) {
+        data->set = strtof(set, NULL);
+        free(set);
+    }
 
-        //temp_zone_init(name);
-        list_prepend(&zones, data);
+    char fkey[5+member_size(heating_t, name)] = "tfix.";
+    strncpy(fkey+5, data->name, strlen(data->name));
+    //size_t size = 0;
+    char *fix = NULL;
+    nv_read_str(fkey, &fix, &size);
+    if (fix != NULL) {
+        data->fix = strtof(fix, NULL);
+        free(fix);
     }
 
+    char ckey[5+member_size(heating_t, name)] = "tctl.";
+    strncpy(ckey+5, data->name, strlen(data->name));
+    char *ctl = NULL;
+    nv_read_str(ckey, &ctl, &size);
+    if (ctl != NULL) {
+        if (!ctl_parse(ctl, &data->ctl.cfg))
+            ESP_LOGE(TAG, "invalid controller '%s'=%s", data->name, ctl);
+        free(ctl);
+    }
+
+    char ekey[5+member_size(heating_t, name)] = "tflt.";
+    strncpy(ekey+5, data->name, strlen(data->name));
+    int8_t est;
+    if (nv_read_i8(ekey, &est) == ESP_OK && est >= 0 && est < EST_MODE_CNT)
+        data->est.mode = est;
+
+    //temp_zone_init(name);
+    // atomic also orders the writes above
+    Atomic_CompareAndSwap_u32(slot, zones_cnt + 1, 0);
+    Atomic_Increment_u32(&zones_cnt);
+
+CLEANUP:
+    HEATING_EXIT();
     return data;
 }
 
+// iterator points to next zone
 inline iter_t heating_iter()
 {
-    return (iter_t) &zones;
+    return (iter_t) zones;
 }
 
 inline iter_t heating_next(iter_t iter, heating_t **zone)
 {
-    return iter_next(iter, (void**) zone);
+    heating_t *next = (heating_t *) iter;
+    assert(zone != NULL);
+    // NULL before the first zone
+    if (next != NULL && next < zones + zones_cnt) {
+        *zone = next;
+        return (iter_t) (next + 1);
+    }
+
+    *zone = NULL;
+    return NULL;
 }
 
 static void heating_action(heating_t *data)
@@ -112,21 +241,25 @@ static void heating_action(heating_t *data)
         return;
     }
 
-    // heating is not available
+    // controller state and relay are updated from several tasks
+    HEATING_ENTER();
+    // heating is not available, off without waiting for relay dwell
     int state = !HEATING_ON;
+    int force = 1;
     if (!hc_status) {
         goto ACTION;
     }
 
     if (data->val >= 45.0 || data->val <= 0.0) {
         // something's wrong with data, close
-        state = !HEATING_ON;
         goto ACTION;
     }
 
     float set = data->set;
     if (isnanf(data->set))
         set = HEATING_TEMP_DEFAULT;
+    // heating curve, warmer when it's (getting) cold outside
+    set += outdoor_offset();
 
     // with all levels of filtering and softening, in 5 minutes the jump
     // can be as much as 0.6 or maybe more
@@ -135,11 +268,11 @@ static void heating_action(heating_t *data)
 #define HEATING_MIN_TIME_RUN 0
 #define HEATING_IMMEDIATE_DIFF_ON 0.1
 #define HEATING_IMMEDIATE_DIFF_OFF 0.1
-    state = (set > data->val)? HEATING_ON : !HEATING_ON;
-    // this can happen if sensor goes bad or is not connected
-    if (isnanf(data->val))
-        state = !HEATING_ON;
-    if (data->state == state) {
+    // off with NAN, this can happen if sensor goes bad or is not connected
+    int64_t uptime = esp_timer_get_time() / 1000000;
+    state = ctl_update(&data->ctl, set, data->val, uptime)? HEATING_ON : !HEATING_ON;
+    force = isnanf(data->val);
+    if (force || data->want == state) {
         goto ACTION;
     }
 
@@ -151,31 +284,44 @@ static void heating_action(heating_t *data)
     float diff = data->val - set;
     if (state != HEATING_ON && diff < HEATING_IMMEDIATE_DIFF_OFF) {
         if (data->change + HEATING_MIN_TIME_AFTER > now)
-            return;
+            goto CLEANUP;
     }
 
     if (state == HEATING_ON && diff > -1.0*HEATING_IMMEDIATE_DIFF_ON) {
         if (data->change + HEATING_MIN_TIME_RUN > now)
-            return;
+            goto CLEANUP;
     }
 
-    if (data->state != state) {
+    if (data->want != state) {
         data->change = now;
         data->triggered = 0;
     }
 
 ACTION:
-    if (data->relay < 0)
-        return;
+    data->want = state;
+    // staggered with other relays, may be applied later or not at all
+    if (force)
+        state = relay_force(data->relay, state);
+    else
+        state = relay_schedule(data->relay, state);
+    // reported as applied, nothing before first switch
+    data->state = (state < 0)? !HEATING_ON : state;
 
-    data->state = state;
+CLEANUP:
+    HEATING_EXIT();
+}
 
-#ifdef RELAY_3V3
-    relay_init_gpio(data->relay);
-    relay_set_gpio(data->relay, state);
-#else
-    relay_set_gpio_5v(data->relay, state);
-#endif
+// first zones with measurements get history, zones are never removed
+static int history_cnt = 0;
+static void heating_history(heating_t *data)
+{
+    HEATING_ENTER();
+    if (data->history == NULL && history_cnt < HISTORY_ZONES_MAX) {
+        data->history = history_new();
+        if (data->history != NULL)
+            history_cnt += 1;
+    }
+    HEATING_EXIT();
 }
 
 static void th_send(int req, char *name, float val, float set);
@@ -185,24 +331,35 @@ heating_t *heating_temp_val(char *name, float val, int apply)
     if (data == NULL)
         return NULL;
 
-    if (strncmp(data->name, "external", member_size(heating_t, name)) == 0)
+    if (strncmp(data->name, "external", member_size(heating_t, name)) == 0) {
         oled_update.external = val;
+        outdoor_update(OUTDOOR_ZONE, val);
+    }
+
+    if (data->history == NULL && history_cnt < HISTORY_ZONES_MAX && esp.dev->controller && !isnanf(val))
+        heating_history(data);
+    time_t now;
+    history_add(data->history, val, time(&now));
 
-    // circular buffer, select lowest value
+    // circular buffer of measurements, value used is estimate
     data->vals[data->i] = val;
     data->i = (data->i + 1) % COUNT_OF(data->vals);
     if (data->c < COUNT_OF(data->vals))
         data->c += 1;
-    for (int i=0; i<data->c; i++)
-        if (!isnanf(data->vals[i]) && data->vals[i] < val)
-            val = data->vals[i];
+    // estimator can be reset by API meanwhile
+    HEATING_ENTER();
+    val = est_update(&data->est, val, esp_timer_get_time()/1000000);
+    HEATING_EXIT();
 
     // displayed val is not last measurement but value used for action
     if (val != data->val)
         oled_update.temp = 1;
+    int changed = val != data->val && !(isnanf(val) && isnanf(data->val));
     data->prev = data->val;
     data->val = val;
     data->valid = xTaskGetTickCount();
+    if (changed)
+        heating_changed(data);
 
     ESP_LOGI(TAG, "saving temp val '%s'=%.1f => %.1f", name, data->prev, data->val);
     // measuring was supposed to happen on controller
@@ -225,9 +382,15 @@ heating_t *heating_temp_set(char *name, float set, int apply)
         return NULL;
 
     if (set <= HEATING_TEMP_MAX + .1) {
-        if (set != data->set)
+        int changed = set != data->set;
+        if (changed)
             oled_update.temp = 1;
         data->set = set;
+        if (changed) {
+            // new duty right away, not at the end of window
+            data->ctl.start = -1;
+            heating_changed(data);
+        }
 
         ESP_LOGI(TAG, "saving temp set '%s'=%.1f", name, set);
         // only "xx.x"
@@ -267,12 +430,16 @@ heating_t *heating_temp_fix(char *name, float fix, int apply)
     for (int i=0; i<data->c; i++)
         if (!isnanf(data->vals[i]))
             data->vals[i] += (fix - data->fix);
+    HEATING_ENTER();
+    est_shift(&data->est, fix - data->fix);
+    HEATING_EXIT();
 
     oled_update.temp = 1;
     data->prev += (fix - data->fix);
     data->val += (fix - data->fix);
     data->fix = fix;
     data->valid = xTaskGetTickCount();
+    heating_changed(data);
 
     // measuring was supposed to happen on controller
     // but now measuring can be anywhere
@@ -352,6 +519,75 @@ heating_t *heating_relay(char *name, int relay)
     return data;
 }
 
+// "onoff" or "pi,kp,ti,td,window" (see control.h)
+heating_t *heating_ctl(char *name, char *value)
+{
+    heating_t *data = heating_find(name, 1);
+    if (data == NULL)
+        return NULL;
+
+    ctl_cfg_t cfg;
+    if (!ctl_parse(value, &cfg)) {
+        ESP_LOGE(TAG, "invalid controller '%s'=%s", name, value);
+        return NULL;
+    }
+
+    char ckey[5+member_size(heating_t, name)] = "tctl.";
+    strncpy(ckey+5, data->name, strlen(data->name));
+    char cval[32];
+    char prev[32];
+    ctl_format(&cfg, cval, sizeof(cval));
+    ctl_format(&data->ctl.cfg, prev, sizeof(prev));
+    if (strcmp(cval, prev) == 0)
+        return data;
+
+    ESP_LOGI(TAG, "saving controller '%s'=%s", name, cval);
+    if (cfg.mode == CTL_ONOFF)
+        nv_remove(ckey);
+    else
+        nv_write_str(ckey, cval);
+
+    HEATING_ENTER();
+    int mode = data->ctl.cfg.mode;
+    data->ctl.cfg = cfg;
+    if (mode != cfg.mode)
+        ctl_reset(&data->ctl);
+    else
+        data->ctl.start = -1;
+    HEATING_EXIT();
+    heating_action(data);
+    return data;
+}
+
+heating_t *heating_est(char *name, char *value)
+{
+    heating_t *data = heating_find(name, 1);
+    if (data == NULL)
+        return NULL;
+
+    int mode = est_mode(value);
+    if (mode < 0) {
+        ESP_LOGE(TAG, "invalid estimator '%s'=%s", name, value);
+        return NULL;
+    }
+    if (mode == data->est.mode)
+        return data;
+
+    ESP_LOGI(TAG, "saving estimator '%s'=%s", name, value);
+    char ekey[5+member_size(heating_t, name)] = "tflt.";
+    strncpy(ekey+5, data->name, strlen(data->name));
+    if (mode == EST_DEFAULT)
+        nv_remove(ekey);
+    else
+        nv_write_i8(ekey, mode);
+
+    // estimate starts over with next measurement
+    HEATING_ENTER();
+    est_init(&data->est, mode);
+    HEATING_EXIT();
+    return data;
+}
+
 // this will leak APIKEY periodically, only solution is digest auth
 // or no authorization (or no proactive updates)
 /*
@@ -374,13 +610,195 @@ static char UDP_IV[16];
 #define UDP_SECRET HEATING_UDP_SECRET
 // type + zone+\0 + 2xfloat + secret (or maybe just crc32)
 #define HEATING_DATA_SIZE (1+member_size(heating_t, name)+member_size(heating_t, val)+member_size(heating_t, set))
+#if !HEATING_UDP_AEAD
 #define HEATING_DGRAM_SIZE AES_PADDED_SIZE(HEATING_DATA_SIZE + strlen(UDP_SECRET)+1)
-static mbedtls_aes_context udp_aes = {0};
+#define TH_PAYLOAD(buf) (buf)
+static aes_key_t udp_aes = {0};
+#else
+// nonce (sender MAC + 48-bit counter) + payload + tag, no secret or padding
+#define TH_NONCE_SIZE 12
+#define TH_TAG_SIZE 16
+#define TH_AEAD_OVERHEAD (TH_NONCE_SIZE + TH_TAG_SIZE)
+#define HEATING_DGRAM_SIZE (TH_AEAD_OVERHEAD + HEATING_DATA_SIZE)
+#define TH_PAYLOAD(buf) ((buf) + TH_NONCE_SIZE)
+static mbedtls_gcm_context udp_gcm = {0};
+// counter is boot epoch (24 bits, stored in NVS) and sequence (24 bits)
+static uint8_t th_id[6];
+static uint32_t th_epoch = 0;
+static uint64_t th_ctr = 0;
+
+// replay window of last TH_REPLAY_WINDOW counters per sender
+// floor is highest epoch seen (stored in NVS), window is only trusted
+// once sender starts epoch above it, counters from before reboot or
+// eviction of the sender are unknown
+typedef struct {
+    uint8_t id[6];
+    uint8_t trusted;
+    uint32_t floor;
+    uint64_t last;
+    uint64_t mask;
+    TickType_t seen;
+} th_peer_t;
+static th_peer_t th_peers[TH_PEERS_MAX];
+#endif
+#else
+#define TH_PAYLOAD(buf) (buf)
 #endif
 
+// receiving task, last valid datagram came from sender with unknown window
+static int th_untrusted = 0;
+
+#if HEATING_UDP_AEAD
+static void th_epoch_next()
+{
+    th_epoch = (th_epoch + 1) & 0xffffff;
+    nv_write_u32("th.epoch", th_epoch);
+    th_ctr = (uint64_t) th_epoch << 24;
+}
+
+static void th_nonce_init()
+{
+    esp_read_mac(th_id, ESP_MAC_WIFI_STA);
+    nv_read_u32("th.epoch", &th_epoch);
+    th_epoch_next();
+}
+
+// counter is never reused with the same key (unless epoch wraps after 16M boots)
+static void th_nonce(uint8_t *nonce)
+{
+    HEATING_ENTER();
+    if ((th_ctr & 0xffffff) == 0xffffff)
+        th_epoch_next();
+    uint64_t ctr = th_ctr++;
+    HEATING_EXIT();
+
+    memcpy(nonce, th_id, sizeof(th_id));
+    for (int i=TH_NONCE_SIZE-1; i>=sizeof(th_id); i--, ctr >>= 8)
+        nonce[i] = ctr & 0xff;
+}
+
+// NVS key of sender epoch floor
+static void th_floor_key(char *key, uint8_t *id)
+{
+    snprintf(key, 16, "thf%02x%02x%02x%02x%02x%02x", id[0], id[1], id[2], id[3], id[4], id[5]);
+}
+
+// only called from receiving task, evicts least recently seen sender
+static th_peer_t *th_peer(uint8_t *id)
+{
+    TickType_t now = xTaskGetTickCount();
+    th_peer_t *peer = &th_peers[0];
+    for (int i=0; i<COUNT_OF(th_peers); i++) {
+        if (memcmp(th_peers[i].id, id, sizeof(th_peers[i].id)) == 0) {
+            peer = &th_peers[i];
+            peer->seen = now;
+            return peer;
+        }
+        if (now - th_peers[i].seen > now - peer->seen)
+            peer = &th_peers[i];
+    }
+
+    memcpy(peer->id, id, sizeof(peer->id));
+    peer->trusted = 0;
+    peer->floor = 0;
+    peer->last = 0;
+    peer->mask = 0;
+    peer->seen = now;
+    char key[16];
+    th_floor_key(key, peer->id);
+    nv_read_u32(key, &peer->floor);
+    return peer;
+}
+
+// 1 if counter was already seen or is too old
+static int th_replay(th_peer_t *peer, uint64_t ctr)
+{
+    uint32_t epoch = ctr >> 24;
+    if (epoch > peer->floor) {
+        // written once per sender epoch
+        char key[16];
+        th_floor_key(key, peer->id);
+        nv_write_u32(key, epoch);
+        peer->floor = epoch;
+        if (!peer->trusted) {
+            peer->trusted = 1;
+            peer->last = ctr;
+            peer->mask = 1;
+            return 0;
+        }
+    } else if (!peer->trusted && peer->mask == 0) {
+        // anything before first counter may have been seen already
+        peer->last = ctr;
+        peer->mask = ~0ULL;
+        return 0;
+    }
+
+    if (ctr > peer->last) {
+        uint64_t shift = ctr - peer->last;
+        peer->mask = (shift >= TH_REPLAY_WINDOW)? 0 : peer->mask << shift;
+        peer->mask |= 1;
+        peer->last = ctr;
+        return 0;
+    }
+
+    uint64_t diff = peer->last - ctr;
+    if (diff >= TH_REPLAY_WINDOW || (peer->mask & (1ULL << diff)))
+        return 1;
+    peer->mask |= 1ULL << diff;
+    return 0;
+}
+#endif
+
+// fresh nonce epoch when receiver lost our replay window
+static void th_rekey()
+{
+#if HEATING_UDP_AEAD
+    HEATING_ENTER();
+    th_epoch_next();
+    uint32_t epoch = th_epoch;
+    HEATING_EXIT();
+    ESP_LOGI(TAG, "nonce epoch %" PRIu32, epoch);
+#endif
+}
+
+// encrypts len bytes of cleartext at TH_PAYLOAD(buf) in place,
+// returns datagram size
+// buf needs space for secret and padding (CBC) or tag (AEAD)
+static int th_seal(char *buf, int len)
+{
+#if !HEATING_UDP_ENC
+    return len;
+
+#elif !HEATING_UDP_AEAD
+    aes_iov_t iov[] = {
+        {buf, len},
+        {UDP_SECRET, strlen(UDP_SECRET)+1},
+    };
+    char iv[16];
+    memcpy(iv, UDP_IV, sizeof(iv));
+    return aes_cbc_iov(&udp_aes, iv, iov, COUNT_OF(iov), buf, AES_PADDED_SIZE(len + iov[1].len));
+
+#else
+    uint8_t *nonce = (uint8_t *) buf;
+    uint8_t *payload = (uint8_t *) TH_PAYLOAD(buf);
+    th_nonce(nonce);
+    mbedtls_gcm_crypt_and_tag(&udp_gcm, MBEDTLS_GCM_ENCRYPT, len,
+                              nonce, TH_NONCE_SIZE, NULL, 0,
+                              payload, payload, TH_TAG_SIZE, payload + len);
+    return TH_AEAD_OVERHEAD + len;
+#endif
+}
+
 // buf should be HEATING_DGRAM_SIZE if HEATING_UDP_ENC
-static int th_prepare(char *buf, int req, char *name, float val, float set)
+// datagram is built in place
+int th_prepare(char *buf, int req, char *name, float val, float set)
 {
+    char *out = buf;
+    buf = TH_PAYLOAD(out);
+#if HEATING_UDP_ENC
+    // cleartext is always full size
+    memset(buf, 0, HEATING_DATA_SIZE);
+#endif
     //char buf[1+member_size(heating_t, name)];
     buf[0] = req;
     int len = 1+member_size(heating_t, name)+sizeof(val)+sizeof(set);
@@ -404,22 +822,229 @@ static int th_prepare(char *buf, int req, char *name, float val, float set)
     return len;
 
 #else
-    //int inlen = len + strlen(UDP_SECRET);
-    //int padded = AES_PADDED_SIZE(inlen);
-    char in[HEATING_DGRAM_SIZE];
-    memcpy(in, buf, len);
-    memcpy(in + len, UDP_SECRET, strlen(UDP_SECRET)+1);
+    //ESP_LOG_BUFFER_CHAR(TAG, buf, HEATING_DGRAM_SIZE);
+    return th_seal(out, HEATING_DATA_SIZE);
+#endif
+}
+
+// zones fitting into one batch datagram
+static int th_batch_zones()
+{
+    int size = TH_BATCH_SIZE - TH_BATCH_HEADER;
+#if HEATING_UDP_AEAD
+    size -= TH_AEAD_OVERHEAD;
+#elif HEATING_UDP_ENC
+    size -= strlen(UDP_SECRET)+1;
+#endif
+    if (size < 0)
+        return 0;
+    // count is single byte
+    size /= TH_BATCH_ENTRY;
+    return (size > UINT8_MAX)? UINT8_MAX : size;
+}
+
+// dec is cleartext of batch with n bytes
+static int th_batch_valid(char *dec, int n)
+{
+    if (n < TH_BATCH_HEADER)
+        return 0;
+    return TH_BATCH_HEADER + (uint8_t) dec[2] * TH_BATCH_ENTRY <= n;
+}
+
+// next zone changed after since
+static heating_t *th_batch_next(iter_t *iter, uint32_t since)
+{
+    heating_t *data;
+    while (*iter != NULL) {
+        *iter = heating_next(*iter, &data);
+        if (data != NULL && data->gen > since)
+            return data;
+    }
+    return NULL;
+}
+
+// '&' datagram with zones changed after hdr->since from iter
+// request without zones when iter is NULL
+// iter is advanced and set to NULL after last zone
+// datagram is built in place in buf of TH_BATCH_SIZE
+int th_batch(char *buf, iter_t *iter, th_batch_t *hdr)
+{
+    char *dec = TH_PAYLOAD(buf);
+    int max = th_batch_zones();
+    int cnt = 0;
+    heating_t *data;
+    char *p = dec + TH_BATCH_HEADER;
+
+    while (iter != NULL && cnt < max && (data = th_batch_next(iter, hdr->since)) != NULL) {
+        p += zone_format(data, ZONE_BIN, 0, p, TH_BATCH_ENTRY);
+        cnt++;
+    }
+
+    // peek whether there are zones left for another datagram
+    if (iter != NULL && *iter != NULL) {
+        iter_t peek = *iter;
+        if (th_batch_next(&peek, hdr->since) == NULL)
+            *iter = NULL;
+    }
+
+    dec[0] = '&';
+    dec[1] = TH_BATCH_VERSION;
+    dec[2] = cnt;
+    dec[3] = hdr->flags & TH_BATCH_REKEY;
+    if (iter != NULL) {
+        dec[3] |= TH_BATCH_REPLY | TH_BATCH_SEQ_SET(hdr->seq);
+        hdr->seq++;
+        if (*iter != NULL)
+            dec[3] |= TH_BATCH_MORE;
+    }
+    memcpy(dec+4, &hdr->boot, sizeof(hdr->boot));
+    memcpy(dec+8, &hdr->since, sizeof(hdr->since));
+    memcpy(dec+12, &hdr->gen, sizeof(hdr->gen));
+    return th_seal(buf, p - dec);
+}
+
+// header of received batch
+static void th_batch_header(char *dec, th_batch_t *hdr)
+{
+    memcpy(&hdr->boot, dec+4, sizeof(hdr->boot));
+    memcpy(&hdr->since, dec+8, sizeof(hdr->since));
+    memcpy(&hdr->gen, dec+12, sizeof(hdr->gen));
+    hdr->seq = TH_BATCH_SEQ(dec[3]);
+    hdr->flags = dec[3] & TH_BATCH_REKEY;
+}
+
+// decrypts and validates datagram of n bytes in place, 0 = valid
+// 1 = wrong size, 2 = wrong secret (or tag), 3 = unsupported batch version,
+// 4 = replayed, 5 = changes state but sender window is unknown (AEAD)
+// dec points to cleartext in buf
+int th_decode(char *buf, int n, char **dec)
+{
+    char *payload = *dec = TH_PAYLOAD(buf);
+#if HEATING_UDP_AEAD
+    if (n <= TH_AEAD_OVERHEAD || n > TH_BATCH_SIZE)
+        return 1;
+
+    int len = n - TH_AEAD_OVERHEAD;
+    uint8_t *nonce = (uint8_t *) buf;
+    if (mbedtls_gcm_auth_decrypt(&udp_gcm, len, nonce, TH_NONCE_SIZE, NULL, 0,
+                                 (uint8_t *) payload + len, TH_TAG_SIZE,
+                                 (uint8_t *) payload, (uint8_t *) payload) != 0)
+        return 2;
+
+    if (payload[0] == '&') {
+        if (!th_batch_valid(payload, len))
+            return 1;
+        if (payload[1] != TH_BATCH_VERSION)
+            return 3;
+    } else if (len != HEATING_DATA_SIZE)
+        return 1;
+
+    // only authentic datagrams move the window
+    uint64_t ctr = 0;
+    for (int i=sizeof(th_id); i<TH_NONCE_SIZE; i++)
+        ctr = (ctr << 8) | nonce[i];
+    th_peer_t *peer = th_peer(nonce);
+    if (th_replay(peer, ctr))
+        return 4;
+
+    // until sender moves to fresh epoch only requests are accepted,
+    // never reboot, zone updates or replies
+    th_untrusted = !peer->trusted;
+    if (th_untrusted && payload[0] != '*' && payload[0] != '?' &&
+        !(payload[0] == '&' && !(payload[3] & TH_BATCH_REPLY)))
+        return 5;
+    return 0;
+
+#elif !HEATING_UDP_ENC
+    if (n < 1 || payload[0] != '&')
+        return 0;
+    if (payload[1] != TH_BATCH_VERSION)
+        return 3;
+    return th_batch_valid(payload, n)? 0 : 1;
+
+#else
+    // batches have variable size
+    if (n != HEATING_DGRAM_SIZE && (n <= 0 || n % 16 != 0 || n > TH_BATCH_SIZE))
+        return 1;
 
     char iv[16];
     memcpy(iv, UDP_IV, sizeof(iv));
-    aes_cbc(1, &udp_aes, iv, HEATING_DGRAM_SIZE, in, sizeof(in), buf);
-    //ESP_LOG_BUFFER_CHAR(TAG, in, HEATING_DGRAM_SIZE);
-    //ESP_LOG_BUFFER_HEX(TAG, buf, HEATING_DGRAM_SIZE);
-    return HEATING_DGRAM_SIZE;
+    aes_cbc(0, &udp_aes, iv, buf, n);
+
+    int secret = HEATING_DATA_SIZE;
+    if (payload[0] == '&') {
+        if (!th_batch_valid(payload, n))
+            return 2;
+        // secret is checked first, garbage is more likely than old version
+        secret = TH_BATCH_HEADER + (uint8_t) payload[2] * TH_BATCH_ENTRY;
+    } else if (n != HEATING_DGRAM_SIZE)
+        return 1;
+
+    if (secret + strlen(UDP_SECRET)+1 > n)
+        return 2;
+    if (memcmp(payload+secret, UDP_SECRET, strlen(UDP_SECRET)+1) != 0)
+        return 2;
+    if (payload[0] == '&' && payload[1] != TH_BATCH_VERSION)
+        return 3;
+    return 0;
 #endif
 }
 
 static int th_sock = -1;
+// controller boot and subscribed clients
+static uint32_t th_boot = 0;
+typedef struct {
+    struct in_addr addr;
+    TickType_t seen;
+    // between last two polls, 0 unknown
+    TickType_t period;
+} th_sub_t;
+static th_sub_t th_subs[TH_SUBSCRIBERS_MAX];
+// client, last complete reply from controller
+static th_batch_t th_seen = {0};
+static uint8_t th_seen_seq = 0;
+static int th_seen_lost = 0;
+// client, controller doesn't know our window, next request asks for rekey
+static volatile int th_rekey_ask = 0;
+static volatile TickType_t th_replied = 0;
+
+// subscribed by every batch request, oldest subscriber is replaced
+// returns next expected poll of any subscriber (0 unknown)
+static TickType_t th_subscribe(struct in_addr addr)
+{
+    TickType_t now = xTaskGetTickCount();
+    th_sub_t *sub = &th_subs[0];
+    HEATING_ENTER();
+    for (int i=0; i<COUNT_OF(th_subs); i++) {
+        if (th_subs[i].addr.s_addr == addr.s_addr) {
+            sub = &th_subs[i];
+            break;
+        }
+        if (now - th_subs[i].seen > now - sub->seen)
+            sub = &th_subs[i];
+    }
+    if (sub->addr.s_addr != addr.s_addr) {
+        ESP_LOGI(TAG, "subscribed 0x%08" PRIx32, addr.s_addr);
+        sub->period = 0;
+    } else
+        sub->period = now - sub->seen;
+    sub->addr = addr;
+    sub->seen = now;
+
+    // clients poll with their own period, late ones are unknown
+    TickType_t next = 0;
+    for (int i=0; i<COUNT_OF(th_subs); i++) {
+        sub = &th_subs[i];
+        TickType_t at = sub->seen + sub->period;
+        if (sub->period == 0 || (int32_t) (at - now) <= 0)
+            continue;
+        // known poll at tick 0 isn't unknown
+        if (next == 0 || (int32_t) (at - next) < 0)
+            next = at? at : 1;
+    }
+    HEATING_EXIT();
+    return next;
+}
 
 static void th_send(int req, char *name, float val, float set)
 {
@@ -438,11 +1063,78 @@ static void th_send(int req, char *name, float val, float set)
 #else
     char buf[HEATING_DGRAM_SIZE];
 #endif
-    int len = th_prepare(buf, req, name, val, set);
+    int len;
+    if (req == '&') {
+        // request is batch without zones, smaller than any other datagram
+        th_batch_t hdr = th_seen;
+        hdr.flags = th_rekey_ask? TH_BATCH_REKEY : 0;
+        len = th_batch(buf, NULL, &hdr);
+    } else
+        len = th_prepare(buf, req, name, val, set);
     sendto(th_sock, buf, len,
            MSG_DONTWAIT, (struct sockaddr *) &sa, sizeof(sa));
 }
 
+// zone state received from another device
+static void th_update(heating_t *data, float val, float set)
+{
+    // TODO this can be any zone... is that ok?
+    time(&oled_update.temp_last);
+    th_zone_t *zone = temp_zone_find(data->name);
+    int local = !esp.dev->controller && (strncmp(data->name, esp.dev->hostname, member_size(heating_t, name)) == 0);
+
+    if (esp.dev->controller) {
+        int apply = 0;
+        if (!isnan(set)) {
+            heating_temp_set(data->name, set, 0);
+            apply = 1;
+        }
+        if (zone == NULL) {
+            heating_temp_val(data->name, val, 0);
+            apply = 1;
+        }
+        // remotely measured, apply and enact
+        // but original proposal was to measure on controller only
+        if (zone == NULL && apply)
+            heating_action(data);
+        // no display to handle
+        return;
+    }
+
+    // non-local zones on client device
+    if (!local) {
+        data->val = val;
+        data->set = set;
+        if (strncmp(data->name, "external", member_size(heating_t, name)) == 0)
+            oled_update.external = data->val;
+        return;
+    }
+
+    if (!isnan(val)) {
+        if (val != data->val) {
+            data->val = val;
+            oled_update.temp = 1;
+        }
+    }
+
+    if (!isnan(set)) {
+        if (set <= HEATING_TEMP_MAX + .1)
+            data->set = set;
+        if (set == oled_update.temp_set) {
+            oled_update.temp_pending = 0;
+            oled_update.temp = 1;
+        }
+        if (isnanf(oled_update.temp_mod) || !oled_update.temp_pending) {
+            // initialize UI with controller value
+            // or update keep set value updated if not pending
+            // if update comes from controller mod will be editable
+            oled_update.temp_set = set;
+            if (isnanf(oled_update.temp_mod))
+                oled_update.temp_mod = oled_update.temp_set;
+        }
+    }
+}
+
 static void thermostat_udp(void *pvParameter)
 {
     struct sockaddr_in sa, claddr;
@@ -474,21 +1166,19 @@ static void thermostat_udp(void *pvParameter)
     socklen_t claddrlen = sizeof(claddr);
     int n;
     heating_t *data;
-#if !HEATING_UDP_ENC
-    char buf[1 + member_size(heating_t, name) + sizeof(data->val)+sizeof(data->set)];
-#define dec buf
-#else
-    char buf[HEATING_DGRAM_SIZE];
-    char dec[HEATING_DGRAM_SIZE];
-#endif
+    // batches don't fit on task stack, decrypted and replied in place
+    static char buf[TH_BATCH_SIZE];
+    char *dec;
+    // last '&' request, for ADC2 outage planning
     // thudp.py is useful for debugging:
-    // # = reboot, ! = set, * = get all zones, ? = get zone name
+    // # = reboot, ! = set, * = get all zones, ? = get zone name, & = batch
     // this is all very ugly, datagram payload format is
     // 1 byte = * or ? or ! or #
     // sizeof name (including '\0')
     // sizeof val (little endian)
     // sizeof set (little endian)
     // secret
+    // batch format is in heating.h
     while (1) {
         //bzero(buf, sizeof(buf));
         n = recvfrom(th_sock, buf, sizeof(buf), 0,
@@ -497,136 +1187,212 @@ static void thermostat_udp(void *pvParameter)
         if (n < 0)
             continue;
 
-#if HEATING_UDP_ENC
-        if (n != HEATING_DGRAM_SIZE)
-            continue;
-
-        char iv[16];
-        memcpy(iv, UDP_IV, sizeof(iv));
-        aes_cbc(0, &udp_aes, iv, n, buf, sizeof(dec), dec);
-        if (memcmp(dec+HEATING_DATA_SIZE, UDP_SECRET, strlen(UDP_SECRET)+1) != 0) {
+        int invalid = th_decode(buf, n, &dec);
+        if (invalid == 2)
             ESP_LOGI(TAG, "invalid datagram from 0x%08" PRIx32, claddr.sin_addr.s_addr);
-            continue;
+        else if (invalid == 3)
+            ESP_LOGW(TAG, "unsupported batch version %d from 0x%08" PRIx32, dec[1], claddr.sin_addr.s_addr);
+        else if (invalid == 4)
+            ESP_LOGW(TAG, "replayed datagram from 0x%08" PRIx32, claddr.sin_addr.s_addr);
+        else if (invalid == 5) {
+            ESP_LOGW(TAG, "'%c' from 0x%08" PRIx32 " before rekey", dec[0], claddr.sin_addr.s_addr);
+            if (!esp.dev->controller)
+                th_rekey_ask = 1;
         }
-#endif
+        if (invalid)
+            continue;
 
         if (dec[0] == '#') {
             // ugly hack but better than stuck httpd without any remote reboot
             api_reboot(NULL);
         }
 
-        dec[1+member_size(heating_t, name)-1] = '\0';
-        if (dec[0] != '*') {
+        if (dec[0] != '*' && dec[0] != '&') {
+            dec[1+member_size(heating_t, name)-1] = '\0';
             data = heating_find(dec+1, dec[0] == '!');
             if (data == NULL)
                 continue;
         }
 
         if (dec[0] == '?' || dec[0] == '*') {
+            // reply is built over request
+            int req = dec[0];
             iter_t iter = NULL;
-            if (dec[0] == '*') {
+            if (req == '*') {
                 iter = heating_iter();
                 iter = heating_next(iter, &data);
             }
 
             while (data != NULL) {
-                th_prepare(dec, '!', data->name, data->val, data->set);
+                n = th_prepare(buf, '!', data->name, data->val, data->set);
                 // send back to listening port
                 claddr.sin_port = htons(HEATING_UDP_PORT);
-#if !HEATING_UDP_ENC
-                n = sendto(th_sock, buf, 1+member_size(heating_t, name)+sizeof(data->val)+sizeof(data->set),
-                           MSG_DONTWAIT, (struct sockaddr *) &claddr, claddrlen);
-#else
-                n = sendto(th_sock, dec, HEATING_DGRAM_SIZE,
+                n = sendto(th_sock, buf, n,
                            MSG_DONTWAIT, (struct sockaddr *) &claddr, claddrlen);
-#endif
                 if (n < 0)
                     ESP_LOGE(TAG, "sendto: %s", strerror(errno));
 
                 ESP_LOGD(TAG, "sending '%s'", data->name);
-                if (dec[0] == '?')
+                if (req == '?')
                     break;
                 data = NULL;
                 if (iter != NULL)
                     iter = heating_next(iter, &data);
              }
         } else if (dec[0] == '!') {
-            // TODO this can be any zone... is that ok?
-            time(&oled_update.temp_last);
             typeof(data->val) val = NAN;
             typeof(data->set) set;
             memcpy(&set, dec+1+member_size(heating_t, name)+sizeof(data->set), sizeof(data->set));
             memcpy(&val, dec+1+member_size(heating_t, name), sizeof(data->val));
-
-            th_zone_t *zone = temp_zone_find(data->name);
-            int local = !esp.dev->controller && (strncmp(data->name, esp.dev->hostname, member_size(heating_t, name)) == 0);
-
-            if (esp.dev->controller) {
-                int apply = 0;
-                if (!isnan(set)) {
-                    heating_temp_set(data->name, set, 0);
-                    apply = 1;
-                }
-                if (zone == NULL) {
-                    heating_temp_val(data->name, val, 0);
-                    apply = 1;
-                }
-                // remotely measured, apply and enact
-                // but original proposal was to measure on controller only
-                if (zone == NULL && apply)
-                    heating_action(data);
-                // no display to handle
+            th_update(data, val, set);
+        } else if (dec[0] == '&' && !(dec[3] & TH_BATCH_REPLY)) {
+            // batch request, replies are never answered so devices can't ping-pong
+            if (!esp.dev->controller)
                 continue;
-            }
-
-            // non-local zones on client device
-            if (!local) {
-                data->val = val;
-                data->set = set;
-                if (strncmp(data->name, "external", member_size(heating_t, name)) == 0)
-                    oled_update.external = data->val;
+            th_batch_t hdr;
+            th_batch_header(dec, &hdr);
+            TickType_t next = th_subscribe(claddr.sin_addr);
+            // client lost our window, reply already uses fresh epoch
+            if (hdr.flags & TH_BATCH_REKEY)
+                th_rekey();
+            // everything after reboot or when client is confused
+            uint32_t gen = heating_gen;
+            if (hdr.boot != th_boot || hdr.gen > gen)
+                hdr.gen = 0;
+            hdr = (th_batch_t) {.boot = th_boot, .since = hdr.gen, .gen = gen};
+            // we lost client window, it has to move on before sending changes
+            if (th_untrusted)
+                hdr.flags = TH_BATCH_REKEY;
+            claddr.sin_port = htons(HEATING_UDP_PORT);
+            iter_t iter = heating_iter();
+            // reply without zones says nothing changed
+            do {
+                n = th_batch(buf, &iter, &hdr);
+                hdr.flags = 0;
+                n = sendto(th_sock, buf, n,
+                           MSG_DONTWAIT, (struct sockaddr *) &claddr, claddrlen);
+                if (n < 0)
+                    ESP_LOGE(TAG, "sendto: %s", strerror(errno));
+            } while (iter != NULL);
+            adc2_net_next(ADC2_NET_UDP, next);
+        } else if (dec[0] == '&') {
+            // batch reply or push, zones only come from controller
+            if (esp.dev->controller)
                 continue;
+            if (dec[3] & TH_BATCH_REKEY)
+                th_rekey();
+            th_rekey_ask = 0;
+            char *p = dec + TH_BATCH_HEADER;
+            for (int i=0; i<(uint8_t) dec[2]; i++, p+=TH_BATCH_ENTRY) {
+                char name[member_size(heating_t, name)];
+                memcpy(name, p, sizeof(name));
+                name[sizeof(name)-1] = '\0';
+                float val, set;
+                memcpy(&val, p+sizeof(name), sizeof(val));
+                memcpy(&set, p+sizeof(name)+sizeof(val), sizeof(set));
+                data = heating_find(name, 1);
+                if (data != NULL)
+                    th_update(data, val, set);
             }
 
-            if (!isnan(val)) {
-                if (val != data->val) {
-                    data->val = val;
-                    oled_update.temp = 1;
-                }
+            // generation is seen only when all datagrams arrived
+            // and they continue what was seen before
+            th_batch_t hdr;
+            th_batch_header(dec, &hdr);
+            if (hdr.seq == 0) {
+                th_seen_seq = 0;
+                th_seen_lost = 0;
             }
-
-            if (!isnan(set)) {
-                if (set <= HEATING_TEMP_MAX + .1)
-                    data->set = set;
-                if (set == oled_update.temp_set) {
-                    oled_update.temp_pending = 0;
-                    oled_update.temp = 1;
-                }
-                if (isnanf(oled_update.temp_mod) || !oled_update.temp_pending) {
-                    // initialize UI with controller value
-                    // or update keep set value updated if not pending
-                    // if update comes from controller mod will be editable
-                    oled_update.temp_set = set;
-                    if (isnanf(oled_update.temp_mod))
-                        oled_update.temp_mod = oled_update.temp_set;
-                }
+            if (hdr.seq != TH_BATCH_SEQ(TH_BATCH_SEQ_SET(th_seen_seq)))
+                th_seen_lost = 1;
+            th_seen_seq++;
+            if (dec[3] & TH_BATCH_MORE)
+                continue;
+            if (!th_seen_lost && (hdr.since == 0 || (hdr.boot == th_seen.boot && hdr.since <= th_seen.gen))) {
+                th_seen.boot = hdr.boot;
+                th_seen.gen = hdr.gen;
             }
+            th_replied = xTaskGetTickCount();
         } else {
             ESP_LOGW(TAG, "received unknown request type '%c' from 0x%08" PRIx32, dec[0], claddr.sin_addr.s_addr);
         }
     }
 }
 
+static task_t *th_update_task = NULL;
+
+// clients poll less while controller answers and pushes changes
 static void thermostat_update(void *pvParameter)
 {
+    TickType_t interval = S_TO_TICK(TH_POLL_MIN_S);
+    int unanswered = 0;
     while (1) {
         if (oled_update.temp_pending)
             th_send('!', esp.dev->hostname, NAN, oled_update.temp_set);
         //th_send('?', esp.dev->hostname, 0, 0);
-        // requesting all zones from controller - good for displaying
-        th_send('*', NULL, 0, 0);
+        // requesting changed zones from controller - good for displaying
+        TickType_t sent = xTaskGetTickCount();
+        th_send('&', NULL, 0, 0);
+        // old controller drops batches, all zones as before
+        if (unanswered >= TH_BATCH_TRIES)
+            th_send('*', NULL, 0, 0);
+
+        // woken up by thermostat_wake when new value is set
+        ulTaskNotifyTake(pdTRUE, (oled_update.temp_pending)? S_TO_TICK(1) : interval);
+        if ((int32_t) (th_replied - sent) >= 0 && th_replied != 0) {
+            unanswered = 0;
+            interval = (2*interval < S_TO_TICK(TH_POLL_MAX_S))? 2*interval : S_TO_TICK(TH_POLL_MAX_S);
+        } else {
+            if (unanswered < TH_BATCH_TRIES)
+                unanswered++;
+            interval = S_TO_TICK(TH_POLL_MIN_S);
+        }
+        adc2_net_next(ADC2_NET_UDP, xTaskGetTickCount() + interval);
+    }
+}
+
+void thermostat_wake()
+{
+    if (th_update_task != NULL)
+        xTaskNotifyGive(th_update_task->task);
+}
+
+// sends zone changes to subscribed clients
+static void thermostat_push(void *pvParameter)
+{
+    static char buf[TH_BATCH_SIZE];
+    uint32_t pushed = heating_gen;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        _vTaskDelay(MS_TO_TICK(TH_PUSH_DELAY_MS));
+        ulTaskNotifyTake(pdTRUE, 0);
+
+        struct in_addr addrs[TH_SUBSCRIBERS_MAX];
+        int cnt = 0;
+        TickType_t now = xTaskGetTickCount();
+        HEATING_ENTER();
+        for (int i=0; i<COUNT_OF(th_subs); i++)
+            if (th_subs[i].addr.s_addr != 0 && now - th_subs[i].seen < S_TO_TICK(TH_SUBSCRIBE_S))
+                addrs[cnt++] = th_subs[i].addr;
+        HEATING_EXIT();
+
+        th_batch_t hdr = {.boot = th_boot, .since = pushed, .gen = heating_gen};
+        pushed = hdr.gen;
+        if (cnt == 0 || th_sock < 0)
+            continue;
 
-        _vTaskDelay((oled_update.temp_pending)? S_TO_TICK(1) : S_TO_TICK(5));
+        struct sockaddr_in sa = {0};
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons(HEATING_UDP_PORT);
+        iter_t iter = heating_iter();
+        do {
+            int n = th_batch(buf, &iter, &hdr);
+            for (int i=0; i<cnt; i++) {
+                sa.sin_addr = addrs[i];
+                if (sendto(th_sock, buf, n, MSG_DONTWAIT, (struct sockaddr *) &sa, sizeof(sa)) < 0)
+                    ESP_LOGE(TAG, "sendto: %s", strerror(errno));
+            }
+        } while (iter != NULL);
     }
 }
 
@@ -673,6 +1439,23 @@ CLEANUP:
 #define CHECK_PERIOD_S 10
 // reboot will prevent aging, timestamp can't be relied on
 #define MAX_AGE_S (OFFLINE_REBOOT-(2*CHECK_PERIOD_S))
+// "zone.temp" without dot is what dashboards already use
+static void heating_metrics(heating_t *data)
+{
+    static char *prefix[HEATING_M_CNT] = {
+        [HEATING_M_TVAL] = "zone.tval.",
+        [HEATING_M_TSET] = "zone.tset.",
+        [HEATING_M_TFIX] = "zone.tfix.",
+        [HEATING_M_TEMP] = "zone.temp",
+        [HEATING_M_RELAY] = "relay.",
+        [HEATING_M_SWITCHES] = "relay.switches.",
+    };
+
+    for (int i=0; i<HEATING_M_CNT; i++)
+        if (data->metrics[i] == NULL)
+            data->metrics[i] = graphite_metric(prefix[i], data->name, "espire");
+}
+
 static void thermostat_aging(void *pvParameter)
 {
     while (1) {
@@ -690,6 +1473,8 @@ static void thermostat_aging(void *pvParameter)
                 // enforce action
                 data->prev = data->val;
                 data->val = NAN;
+                if (!isnanf(data->prev))
+                    heating_changed(data);
                 heating_action(data);
                 /*
 #ifdef RELAY_3V3
@@ -702,19 +1487,32 @@ static void thermostat_aging(void *pvParameter)
             } else {
                 //ESP_LOGI(TAG, "temperature for '%s' is ok %d", data->name, data->valid);
                 // TODO send from here?
-                graphite_udp("zone.tval.", data->name, "espire", data->val, 1, 0);
-                graphite_udp("zone.tset.", data->name, "espire", data->set, 1, 0);
-                graphite_udp("zone.tfix.", data->name, "espire", data->fix, 1, 0);
+                heating_metrics(data);
+                graphite_value(data->metrics[HEATING_M_TVAL], data->val, 1, 0);
+                graphite_value(data->metrics[HEATING_M_TSET], data->set, 1, 0);
+                graphite_value(data->metrics[HEATING_M_TFIX], data->fix, 1, 0);
                 if (data->c > 0) {
-                    graphite_udp("zone.temp", data->name, "espire", data->vals[HEATING_LAST_VAL_I(data)], 1, 0);
+                    graphite_value(data->metrics[HEATING_M_TEMP], data->vals[HEATING_LAST_VAL_I(data)], 1, 0);
+                }
+                // duty cycle switches relay without new measurement
+                if (data->ctl.cfg.mode != CTL_ONOFF)
+                    heating_action(data);
+                if (data->relay != -1) {
+                    // relay task may have switched since last action
+                    HEATING_ENTER();
+                    int state = relay_state(data->relay);
+                    data->state = (state < 0)? !HEATING_ON : state;
+                    HEATING_EXIT();
+                    graphite_value(data->metrics[HEATING_M_RELAY], data->state == HEATING_ON, 1, 0);
+                    graphite_value(data->metrics[HEATING_M_SWITCHES], relay_switches(data->relay), 1, 0);
                 }
-                if (data->relay != -1)
-                    graphite_udp("relay.", data->name, "espire", data->state == HEATING_ON, 1, 0);
             }
 
             if (data->state == HEATING_ON)
                 ++on_cnt;
         }
+        graphite_flush();
+        adc2_net_next(ADC2_NET_GRAPHITE, xTaskGetTickCount() + S_TO_TICK(CHECK_PERIOD_S));
 
         if (hc_url_reload) {
             free(heating_hc_url);
@@ -750,6 +1548,12 @@ void th_aes_init()
 {
     b64_decode(HEATING_UDP_KEY_B64, sizeof(HEATING_UDP_KEY_B64), UDP_KEY, sizeof(UDP_KEY));
     b64_decode(HEATING_UDP_IV_B64, sizeof(HEATING_UDP_IV_B64), UDP_IV, sizeof(UDP_IV));
+#if HEATING_UDP_AEAD
+    // first call at boot, key changes keep the counter going
+    if (th_epoch == 0)
+        th_nonce_init();
+    mbedtls_gcm_setkey(&udp_gcm, MBEDTLS_CIPHER_ID_AES, (unsigned char *) UDP_KEY, 8*sizeof(UDP_KEY));
+#else
     /*
     static int inited = 0;
     if (inited)
@@ -757,17 +1561,24 @@ void th_aes_init()
     mbedtls_aes_init(&udp_aes);
     inited = 1;
     */
-    mbedtls_aes_setkey_enc(&udp_aes, (unsigned char *) UDP_KEY, 8*sizeof(UDP_KEY));
+    // both schedules once, nothing is set up per datagram
+    aes_key_set(&udp_aes, UDP_KEY, 8*sizeof(UDP_KEY));
+#endif
 }
 #endif
 
 void thermostat_init()
 {
 #if HEATING_UDP_ENC
+#if HEATING_UDP_AEAD
+    ESP_LOGI(TAG, "authenticated encryption enabled");
+    mbedtls_gcm_init(&udp_gcm);
+#else
     ESP_LOGI(TAG, "encryption enabled");
-    mbedtls_aes_init(&udp_aes);
+#endif
     th_aes_init();
 #endif
+    outdoor_init();
 
     // initialize all known relays
     nvs_iterator_t iter = NULL;
@@ -816,7 +1627,12 @@ void thermostat_init()
 
     xxTaskCreate((void (*)(void*))thermostat_udp, "th_udp", 2*1024, NULL, 0, NULL);
     if (!esp.dev->controller)
-        xxTaskCreate((void (*)(void*))thermostat_update, "th_update", 2*1024, NULL, 0, NULL);
-    else
+        xxTaskCreate((void (*)(void*))thermostat_update, "th_update", 2*1024, NULL, 0, &th_update_task);
+    else {
+        // zero is what clients send before they've seen controller
+        while (th_boot == 0)
+            th_boot = esp_random();
         xxTaskCreate((void (*)(void*))thermostat_aging, "th_aging", 2*1024, NULL, 0, NULL);
+        xxTaskCreate((void (*)(void*))thermostat_push, "th_push", 2*1024, NULL, 0, &th_push_task);
+    }
 }
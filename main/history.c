@@ -0,0 +1,132 @@
+#include "history.h"
+#include "util.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+static const char *TAG = "history";
+
+_Static_assert(sizeof(history_t) <= HISTORY_ZONE_BUDGET, "history over per zone budget");
+
+static const struct {
+    uint16_t step;
+    uint16_t cnt;
+} history_tiers[HISTORY_TIER_CNT] = {
+    [HISTORY_FINE] = {HISTORY_FINE_S, HISTORY_FINE_CNT},
+    [HISTORY_COARSE] = {HISTORY_COARSE_S, HISTORY_COARSE_CNT},
+};
+
+// one lock for all zones, writes are once per measurement
+static SemaphoreHandle_t history_mutex = NULL;
+static void HISTORY_ENTER()
+{
+    if (history_mutex == NULL) {
+        history_mutex = xSemaphoreCreateMutex();
+        assert(history_mutex != NULL);
+    }
+
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+}
+
+static void HISTORY_EXIT()
+{
+    xSemaphoreGive(history_mutex);
+}
+
+static int16_t *history_buf(history_t *h, int tier)
+{
+    return (tier == HISTORY_FINE)? h->fine : h->coarse;
+}
+
+history_t *history_new()
+{
+    history_t *h = malloc(sizeof(history_t));
+    if (h == NULL) {
+        ESP_LOGE(TAG, "can't allocate %d bytes", sizeof(history_t));
+        return NULL;
+    }
+
+    memset(h->ring, 0, sizeof(h->ring));
+    for (int i=0; i<COUNT_OF(h->fine); i++)
+        h->fine[i] = HISTORY_NONE;
+    for (int i=0; i<COUNT_OF(h->coarse); i++)
+        h->coarse[i] = HISTORY_NONE;
+    return h;
+}
+
+// skipped slots are missing, time going back (NTP sync) drops everything
+static void history_advance(history_ring_t *r, int16_t *buf, int cnt, uint32_t slot)
+{
+    if (slot == r->slot)
+        return;
+
+    uint32_t steps = slot - r->slot;
+    if (slot < r->slot || steps >= cnt) {
+        for (int i=0; i<cnt; i++)
+            buf[i] = HISTORY_NONE;
+    } else {
+        for (int i=0; i<steps; i++) {
+            r->i = (r->i + 1) % cnt;
+            buf[r->i] = HISTORY_NONE;
+        }
+    }
+
+    r->slot = slot;
+    r->sum = 0;
+    r->cnt = 0;
+}
+
+void history_add(history_t *h, float val, time_t now)
+{
+    if (h == NULL || isnanf(val))
+        return;
+
+    float scaled = roundf(val * HISTORY_SCALE);
+    if (scaled <= HISTORY_NONE || scaled > INT16_MAX)
+        return;
+
+    HISTORY_ENTER();
+    for (int tier=0; tier<HISTORY_TIER_CNT; tier++) {
+        history_ring_t *r = &h->ring[tier];
+        int16_t *buf = history_buf(h, tier);
+        history_advance(r, buf, history_tiers[tier].cnt, now / history_tiers[tier].step);
+
+        // newest slot is running average
+        r->sum += (int16_t) scaled;
+        r->cnt += 1;
+        buf[r->i] = (r->sum + ((r->sum >= 0)? r->cnt/2 : -r->cnt/2)) / r->cnt;
+    }
+    HISTORY_EXIT();
+}
+
+int history_read(history_t *h, int tier, int64_t from, int16_t *out, int cnt, history_header_t *hdr)
+{
+    assert(tier >= 0 && tier < HISTORY_TIER_CNT);
+    int size = history_tiers[tier].cnt;
+    int16_t *buf = history_buf(h, tier);
+
+    HISTORY_ENTER();
+    history_ring_t *r = &h->ring[tier];
+    if (hdr != NULL) {
+        *hdr = (history_header_t) {
+            .magic = 'H',
+            .version = HISTORY_VERSION,
+            .step = history_tiers[tier].step,
+            .cnt = size,
+            .time = (r->slot + 1) * history_tiers[tier].step,
+        };
+    }
+
+    // by slot number so that reads in chunks aren't shifted by adds
+    int n = 0;
+    for (; n < cnt; n++) {
+        int64_t age = (int64_t) r->slot - (from + n);
+        out[n] = (age >= 0 && age < size)? buf[(r->i + size - age) % size] : HISTORY_NONE;
+    }
+    HISTORY_EXIT();
+    return n;
+}
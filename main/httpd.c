@@ -5,6 +5,7 @@
 #include "module.h"
 #include "httpd.h"
 #include "util.h"
+#include "metrics.h"
 #include <stddef.h>
 
 /* based on Simple HTTP Server Example (Public Domain or CC0 licensed) */
@@ -603,20 +604,119 @@ void httpd_unregister(httpd_t *self, list_t *item)
     }
 }
 
+// server with output buffer, NULL if handler has no server context
+// or buffer can't be allocated, output is sent directly then
+static httpd_t *http_out(httpd_req_t *req)
+{
+    httpd_t *self = req->user_ctx;
+    if (self == NULL)
+        return NULL;
+
+    if (self->out == NULL) {
+        self->out = malloc(HTTP_OUT_BUFSIZE);
+        if (self->out == NULL) {
+            ESP_LOGE(TAG, "can't allocate %d bytes", HTTP_OUT_BUFSIZE);
+            return NULL;
+        }
+        self->out_len = 0;
+    }
+    return self;
+}
+
+esp_err_t http_flush(httpd_req_t *req)
+{
+    if (req == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    httpd_t *self = http_out(req);
+    if (self == NULL || self->out_len == 0)
+        return ESP_OK;
+
+    esp_err_t res = httpd_resp_send_chunk(req, self->out, self->out_len);
+    // dropped on failure, next request starts empty
+    self->out_len = 0;
+    return res;
+}
+
+esp_err_t http_write(httpd_req_t *req, const char *buf, ssize_t len)
+{
+    if (req == NULL)
+        return ESP_ERR_INVALID_ARG;
+    if (len == HTTPD_RESP_USE_STRLEN)
+        len = strlen(buf);
+
+    httpd_t *self = http_out(req);
+    if (self == NULL)
+        return httpd_resp_send_chunk(req, buf, len);
+
+    if (self->out_len + len > HTTP_OUT_BUFSIZE) {
+        esp_err_t res = http_flush(req);
+        if (res != ESP_OK)
+            return res;
+        // not copying what is a chunk anyway
+        if (len > HTTP_OUT_BUFSIZE / 2)
+            return httpd_resp_send_chunk(req, buf, len);
+    }
+
+    memcpy(self->out + self->out_len, buf, len);
+    self->out_len += len;
+    return ESP_OK;
+}
+
 esp_err_t http_printf(httpd_req_t *req, const char *format, ...)
 {
-    // formatted strings are usually not long
-    char buf[HTTP_PRINT_BUFSIZE];
+    if (req == NULL)
+        return ESP_ERR_INVALID_ARG;
 
     va_list args;
+    httpd_t *self = http_out(req);
+    // formatted in place, again after flush if it doesn't fit
+    for (int i=0; self != NULL && i<2; i++) {
+        int room = HTTP_OUT_BUFSIZE - self->out_len;
+        va_start(args, format);
+        int len = vsnprintf(self->out + self->out_len, room, format, args);
+        va_end(args);
+
+        if (len < 0)
+            return ESP_FAIL;
+        if (len < room) {
+            self->out_len += len;
+            return ESP_OK;
+        }
+        if (self->out_len == 0)
+            break;
+        esp_err_t res = http_flush(req);
+        if (res != ESP_OK)
+            return res;
+    }
+
+    // longer than buffer or no buffer
+    char *buf = NULL;
     va_start(args, format);
-    int len = vsnprintf(buf, sizeof(buf), format, args);
+    int len = vasprintf(&buf, format, args);
     va_end(args);
-
-    if (len >= sizeof(buf)) {
-        ESP_LOGE(TAG, "http_printf needs more than %d bytes", HTTP_PRINT_BUFSIZE);
-        return ESP_FAIL;
+    if (len < 0) {
+        ESP_LOGE(TAG, "http_printf can't allocate");
+        return ESP_ERR_NO_MEM;
     }
 
-    return httpd_resp_send_chunk(req, buf, len);
+    // buffer is empty here
+    esp_err_t res = httpd_resp_send_chunk(req, buf, len);
+    free(buf);
+    return res;
+}
+
+esp_err_t http_end(httpd_req_t *req)
+{
+    if (req == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    static metric_t *responses = NULL;
+    if (responses == NULL)
+        responses = metric_counter("espire_http_responses_total", "Chunked HTTP API responses");
+    metric_add(responses, 1);
+
+    esp_err_t res = http_flush(req);
+    esp_err_t end = httpd_resp_send_chunk(req, NULL, 0);
+    return (res != ESP_OK)? res : end;
 }
@@ -23,6 +23,31 @@ typedef struct {
     TaskHandle_t task;
 } wifi_owner_t;
 
-extern list_t wifi_owner;
+// copies current owners, returns count
+int wifi_owners(wifi_owner_t *owners, int max);
+
+// known network activity ADC2 outages are planned around
+enum {
+    ADC2_NET_GRAPHITE,
+    ADC2_NET_UDP,
+    ADC2_NET_CNT
+};
+
+typedef struct {
+    uint32_t cnt;
+    uint32_t total_ms;
+    uint32_t max_ms;
+    uint32_t last_ms;
+} adc2_outage_t;
+
+extern adc2_outage_t adc2_outage;
+
+// next expected activity of user, 0 is unknown
+void adc2_net_next(int user, TickType_t at);
+// waits for gap of expected outage length (at most max_wait),
+// returns ticks waited
+TickType_t adc2_slot(TickType_t max_wait);
+// wifi is back after ADC2 use
+void adc2_outage_end();
 
 #endif /* __ADC2_H__ */
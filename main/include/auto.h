@@ -36,6 +36,7 @@ void generic_key_handler(auto_handler_t *self, char *value);
 
 void controller_ip_handler(auto_handler_t *self, char *value);
 void hostname_handler(auto_handler_t *self, char *value);
+char *config_pair(char *start, char *stop, char **name, char **value);
 void config_apply(auto_t *self, char *buf, int bufsize, int commit, int auth);
 
 #endif /* __AUTO_H__ */
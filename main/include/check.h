@@ -3,6 +3,7 @@
 
 #include "config.h"
 #include "adc2.h"
+#include "emit.h"
 
 typedef enum {
     NONE=0,
@@ -32,6 +33,7 @@ gpio_owner_t gpio_owner(int gpio);
 const char *gpio_owner_str(gpio_owner_t owner);
 void check_gpio(int gpio, gpio_owner_t owner);
 void check_gpio_clear(int gpio);
-void check_report(void *req, int (*func)(void *req, const char *fmt, ...));
+// gpio.N keys into e, logged if e is NULL
+void check_report(emit_t *e);
 
 #endif /* __CHECK_H__ */
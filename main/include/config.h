@@ -17,6 +17,15 @@
 #else
 #define HEATING_UDP_ENC 1
 #endif
+// AES-GCM instead of AES-CBC with secret
+#ifndef CONFIG_ESP_HEATING_UDP_AEAD
+#define HEATING_UDP_AEAD 0
+#else
+#define HEATING_UDP_AEAD HEATING_UDP_ENC
+#endif
+// senders with replay window, window size in datagrams (at most 64)
+#define TH_PEERS_MAX 16
+#define TH_REPLAY_WINDOW 64
 //#define HEATING_UDP_SECRET CONFIG_ESP_HEATING_UDP_SECRET
 //#define HEATING_UDP_KEY_B64 CONFIG_ESP_HEATING_UDP_KEY_B64
 //#define HEATING_UDP_IV_B64 CONFIG_ESP_HEATING_UDP_IV_B64
@@ -27,6 +36,34 @@ extern char HEATING_UDP_IV_B64[24];
 extern uint16_t HEATING_UDP_PORT;
 
 #define HEATING_HC_URL_KEY "hc.url"
+#define OUTDOOR_CURVE_KEY "hc.curve"
+// clients refresh probe metrics on scrape instead of in background
+#ifndef CONFIG_ESP_METRICS_PROBE_CLIENTS
+#define METRICS_PROBE_CLIENTS 0
+#else
+#define METRICS_PROBE_CLIENTS 1
+#endif
+// zones are in table allocated with the first zone
+#ifndef HEATING_ZONES_MAX
+#ifdef CONFIG_ESP_HEATING_ZONES_MAX
+#define HEATING_ZONES_MAX CONFIG_ESP_HEATING_ZONES_MAX
+#else
+#define HEATING_ZONES_MAX 32
+#endif
+#endif
+// clients poll for zone changes between min and max interval,
+// controller pushes changes to clients which polled within subscribe time
+#define TH_POLL_MIN_S 5
+#define TH_POLL_MAX_S 60
+#define TH_SUBSCRIBE_S (3*TH_POLL_MAX_S)
+#define TH_SUBSCRIBERS_MAX 8
+// clients also poll with '*' after this many unanswered '&' polls
+// (controller with firmware without batches)
+#define TH_BATCH_TRIES 3
+// changes from one measurement round are pushed together
+#define TH_PUSH_DELAY_MS 200
+// zones with temperature history on controller (HISTORY_ZONE_BUDGET each)
+#define HISTORY_ZONES_MAX 8
 
 #define HTTPD_SSL
 #define API_KEY "test"
@@ -84,8 +121,8 @@ extern char HOSTNAME[member_size(heating_t, name)];
 // 1000 is too much lag when switching modes
 #define LVGL_TICK_PERIOD_MS_SLOW 200
 
-// only use for formatted chunked responses
-#define HTTP_PRINT_BUFSIZE 100
+// chunked response buffer per server, each flush is a chunk (TLS record)
+#define HTTP_OUT_BUFSIZE 1536
 // adding more handlers will require httpd restart and will add the same amount
 #ifdef HTTPD_SSL
 // restart seems to break SSL, getting two handshakes and a failure
@@ -122,7 +159,20 @@ extern char HOSTNAME[member_size(heating_t, name)];
 #define AUTO_CONFIG_URL_PASSWORD CONFIG_ESP_AUTO_CONFIG_URL_PASSWORD
 
 //#define ADC2_MUTEX_BYPASS
+// ADC2 outage (wifi off) is planned into a gap between known network
+// activity, collection waits at most ADC2_SLOT_MAX_MS for it
+#define ADC2_SLOT_MAX_MS 10000
+// expected outage (measurement and reconnect) until one is measured
+#define ADC2_OUTAGE_INIT_MS 3000
+// tasks holding wifi at the same time
+#define WIFI_OWNERS_MAX 8
 #define RELAY_CNT CONFIG_ESP_RELAY_CNT
+// relays are switched one at a time (inrush on shared supply) and stay
+// on/off for minimum time (valves), flip-flops in between are dropped
+#define RELAY_SCHED_MAX 16
+#define RELAY_STAGGER_MS 1500
+#define RELAY_MIN_ON_S 120
+#define RELAY_MIN_OFF_S 120
 
 #define BUTTON_DEBOUNCE_MS CONFIG_ESP_BUTTON_DEBOUNCE_MS
 #define BUTTON_REPEAT_MS CONFIG_ESP_BUTTON_REPEAT_MS
@@ -187,6 +237,12 @@ extern char WIFI_PASSWORD[64];
 #else
 #define GRAPHITE_IP_DEFAULT CONFIG_ESP_GRAPHITE_IP
 #endif
+// lines are packed into datagrams up to this size
+#define GRAPHITE_BATCH_SIZE 1400
+// datagram is sent when older even if not full
+#define GRAPHITE_FLUSH_MS 2000
+// timestamped lines kept while offline, sent after reconnect
+#define GRAPHITE_BACKLOG_SIZE (8*1024)
 
 // example for wifi connect/disconnect handler, not required
 //#define CONFIG_EXAMPLE_CONNECT_WIFI
@@ -0,0 +1,66 @@
+#ifndef __CONTROL_H__
+#define __CONTROL_H__
+
+#include <stdint.h>
+
+// heating zone controller, decides if relay should be on
+// on/off is a comparator (set > val)
+// PI/PID output is a duty cycle (0..1) of relay over window,
+// duty is taken at window start and pulses alternate between window start
+// and end, relay switches about once per window
+enum {
+    CTL_ONOFF,
+    CTL_PI,
+    CTL_PID,
+    CTL_MODE_CNT
+};
+
+// floor heating reacts in hours, degree below set is full duty
+// (tuned with host/sim.c)
+#define CTL_KP_DEFAULT 1.0
+#define CTL_TI_DEFAULT 7200
+#define CTL_TD_DEFAULT 3600
+#define CTL_WINDOW_DEFAULT 1800
+#define CTL_WINDOW_MIN 600
+#define CTL_WINDOW_MAX 7200
+// shorter pulses are dropped (or extended to full window), thermal
+// valve actuators take minutes to open
+#define CTL_PULSE_MIN_S 300
+
+typedef struct {
+    uint8_t mode;
+    // duty per degree of error
+    float kp;
+    // integral and derivative time, s
+    float ti;
+    float td;
+    // duty cycle window, s
+    uint16_t window;
+} ctl_cfg_t;
+
+typedef struct {
+    ctl_cfg_t cfg;
+    // integral term as duty, kept in 0..1
+    float integral;
+    // previous value for derivative (on measurement, not on set change)
+    float prev;
+    // output and duty used in current window
+    float out;
+    float duty;
+    int64_t last;
+    int64_t start;
+    // pulse at the end of window
+    uint8_t late;
+} ctl_t;
+
+void ctl_init(ctl_t *ctl);
+void ctl_reset(ctl_t *ctl);
+// "onoff" or "pi[,kp[,ti[,td[,window]]]]" ("pid" same), missing are defaults
+int ctl_parse(char *value, ctl_cfg_t *cfg);
+int ctl_format(ctl_cfg_t *cfg, char *buf, int size);
+char *ctl_mode_name(int mode);
+int ctl_mode(char *name);
+// now is monotonic time in s, returns 1 to heat
+int ctl_update(ctl_t *ctl, float set, float val, int64_t now);
+
+#endif /* __CONTROL_H__ */
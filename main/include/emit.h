@@ -0,0 +1,63 @@
+#ifndef __EMIT_H__
+#define __EMIT_H__
+
+#include <stdint.h>
+
+// streaming key=value text, JSON or CBOR output without allocations,
+// text is flat (maps only group keys, arrays of scalars are space separated
+// values on key line), JSON and CBOR nest (CBOR has indefinite lengths)
+enum {
+    EMIT_TEXT,
+    EMIT_JSON,
+    EMIT_CBOR,
+    EMIT_FMT_CNT
+};
+
+#define EMIT_DEPTH 4
+// composed keys (emit_keyf) and emit_printf values are cut
+#define EMIT_KEY_MAX 48
+#define EMIT_PRINTF_MAX 96
+
+// returns 0 on success, e.g. http_write
+typedef int (*emit_write_t)(void *ctx, const char *buf, int len);
+
+typedef struct {
+    uint8_t fmt;
+    uint8_t depth;
+    // container at depth 1..EMIT_DEPTH, nothing written into it yet
+    uint8_t array[EMIT_DEPTH+1];
+    uint8_t first[EMIT_DEPTH+1];
+    emit_write_t write;
+    void *ctx;
+    // first write error, later output is dropped
+    int err;
+    char key[EMIT_KEY_MAX];
+} emit_t;
+
+void emit_init(emit_t *e, int fmt, emit_write_t write, void *ctx);
+// closes open maps and arrays, returns first write error
+int emit_finish(emit_t *e);
+// key NULL inside arrays
+void emit_map(emit_t *e, const char *key);
+void emit_array(emit_t *e, const char *key);
+void emit_close(emit_t *e);
+// formatted into e->key, valid until next emit_keyf
+char *emit_keyf(emit_t *e, const char *format, ...);
+void emit_int(emit_t *e, const char *key, int64_t val);
+void emit_uint(emit_t *e, const char *key, uint64_t val);
+// prec digits after point in text/JSON (-1 for %f), CBOR float is exact,
+// NaN is null in JSON/CBOR
+void emit_float(emit_t *e, const char *key, double val, int prec);
+void emit_str(emit_t *e, const char *key, const char *val);
+void emit_printf(emit_t *e, const char *key, const char *format, ...);
+// verbatim in text output (lines which were never key=value), nothing
+// in JSON/CBOR, caller emits keys for those
+void emit_text(emit_t *e, const char *format, ...);
+// hex string in text/JSON, byte string in CBOR
+void emit_hex(emit_t *e, const char *key, const uint8_t *val, int len);
+char *emit_fmt_name(int fmt);
+int emit_fmt(char *name);
+// Content-Type
+char *emit_type(int fmt);
+
+#endif /* __EMIT_H__ */
@@ -0,0 +1,65 @@
+#ifndef __ESTIMATOR_H__
+#define __ESTIMATOR_H__
+
+#include <stdint.h>
+
+// zone temperature estimate from noisy measurements
+// min is lowest of last EST_MIN_CNT measurements (biased low)
+// ewma is exponential average with outlier rejection
+// kalman is 1-D Kalman filter (random walk) with measurement noise
+// estimated from innovations and outlier rejection
+enum {
+    EST_MIN,
+    EST_EWMA,
+    EST_KALMAN,
+    EST_MODE_CNT
+};
+
+#define EST_DEFAULT EST_KALMAN
+#define EST_MIN_CNT 5
+// room temperature drift, about 0.01 degree per minute (variance per s)
+#define EST_Q (0.01*0.01/60.0)
+// measurement noise variance, initial and bounds
+#define EST_R_INIT (0.1*0.1)
+#define EST_R_MIN (0.01*0.01)
+#define EST_R_MAX (2.0*2.0)
+#define EST_R_ALPHA 0.1
+#define EST_EWMA_ALPHA 0.3
+// measurement over EST_GATE sigma is an outlier, EST_REJECT_MAX outliers
+// in a row are a step (sensor moved, heating started) and restart estimate
+#define EST_GATE 4
+#define EST_REJECT_MAX 3
+// measurements before gating and stable
+#define EST_WARMUP 3
+// noise below this is stable, one sensor read is enough
+#define EST_STABLE_SD 0.1
+
+typedef struct {
+    uint8_t mode;
+    // measurements since reset, capped
+    uint8_t n;
+    // outliers in a row
+    uint8_t reject;
+    // estimate and its variance, measurement noise variance
+    float x;
+    float p;
+    float r;
+    int64_t last;
+    // min
+    uint8_t i;
+    float vals[EST_MIN_CNT];
+} est_t;
+
+void est_init(est_t *est, int mode);
+void est_reset(est_t *est);
+char *est_mode_name(int mode);
+int est_mode(char *name);
+// now is monotonic time in s, NAN measurement is NAN estimate
+float est_update(est_t *est, float z, int64_t now);
+// fix (offset) change
+void est_shift(est_t *est, float delta);
+// measurement noise standard deviation, NAN if unknown
+float est_noise(est_t *est);
+int est_stable(est_t *est);
+
+#endif /* __ESTIMATOR_H__ */
@@ -0,0 +1,27 @@
+#ifndef __GRAPHITE_H__
+#define __GRAPHITE_H__
+
+#include <stdint.h>
+#include <time.h>
+#include <netinet/in.h>
+
+extern struct sockaddr_in GRAPHITE_SA;
+extern uint32_t graphite_sent;
+extern uint32_t graphite_datagrams;
+extern uint32_t graphite_dropped;
+
+// preformatted key, registered once and kept forever
+typedef struct {
+    char *key;
+    int len;
+} graphite_metric_t;
+
+int graphite_init(char *host, int port);
+graphite_metric_t *graphite_metric(char *prefix, char *metric, char *tag);
+// batched, call graphite_flush() after last metric
+int graphite_value(graphite_metric_t *m, float val, int now, time_t ts);
+int graphite_udp(char *prefix, char *metric, char *tag, float val, int now, time_t ts);
+int graphite_flush();
+int graphite_backlog();
+
+#endif /* __GRAPHITE_H__ */
@@ -2,28 +2,55 @@
 #define __HEATING_H__
 
 #include "util.h"
+#include "graphite.h"
+#include "control.h"
+#include "estimator.h"
+#include "history.h"
+
+enum {
+    HEATING_M_TVAL,
+    HEATING_M_TSET,
+    HEATING_M_TFIX,
+    HEATING_M_TEMP,
+    HEATING_M_RELAY,
+    HEATING_M_SWITCHES,
+    HEATING_M_CNT
+};
 
 typedef struct {
     char name[10];
     float prev;
+    // last measurements, val is estimate from them
     int i;
     int c;
     float vals[5];
+    est_t est;
     float val;
     float set;
     float fix;
     int relay;
 
     time_t triggered;
+    // wanted by controller and applied by relay (may wait for dwell)
+    int want;
     int state;
     time_t change;
     TickType_t valid;
+    // on/off or PI/PID duty cycle
+    ctl_t ctl;
+    // heating_gen of last val/set change, for thermostat UDP updates
+    uint32_t gen;
+    // allocated for first HISTORY_ZONES_MAX zones on controller
+    history_t *history;
+    // graphite keys, registered on first send
+    graphite_metric_t *metrics[HEATING_M_CNT];
 } heating_t;
 
 // last measured value
 #define HEATING_LAST_VAL_I(data) ((data->i + COUNT_OF(data->vals) - 1) % COUNT_OF(data->vals))
 
 void thermostat_init();
+void thermostat_wake();
 heating_t *heating_find(char *name, int create);
 heating_t *heating_temp_val(char *name, float val, int apply);
 heating_t *heating_temp_set(char *name, float set, int apply);
@@ -31,8 +58,43 @@ heating_t *heating_temp_fix(char *name, float fix, int apply);
 int heating_hc_url_set(char *url);
 char *heating_hc_url_get();
 heating_t *heating_relay(char *name, int relay);
+heating_t *heating_ctl(char *name, char *value);
+heating_t *heating_est(char *name, char *value);
 iter_t heating_iter();
 iter_t heating_next(iter_t iter, heating_t **zone);
 void th_aes_init();
 
+// thermostat UDP batch ('&') layout, version 2:
+// '&', version, zone count, flags (more, reply, rekey, datagram sequence)
+// boot, since and gen (uint32_t little endian)
+// count x (name, val, set) as in single zone datagram
+// secret (if encrypted)
+// request is batch without zones with last seen boot and gen,
+// reply has zones changed after since up to gen
+// rekey asks receiver to move to fresh nonce epoch, its window is unknown
+#define TH_BATCH_VERSION 2
+#define TH_BATCH_MORE 0x01
+#define TH_BATCH_REPLY 0x02
+#define TH_BATCH_REKEY 0x04
+#define TH_BATCH_SEQ(flags) (((uint8_t) (flags)) >> 4)
+#define TH_BATCH_SEQ_SET(seq) (((seq) & 0x0f) << 4)
+#define TH_BATCH_HEADER 16
+#define TH_BATCH_ENTRY (member_size(heating_t, name)+member_size(heating_t, val)+member_size(heating_t, set))
+#define TH_BATCH_SIZE 512
+
+typedef struct {
+    // random per controller boot
+    uint32_t boot;
+    uint32_t since;
+    uint32_t gen;
+    uint8_t seq;
+    // TH_BATCH_REKEY
+    uint8_t flags;
+} th_batch_t;
+
+// datagram payload for thermostat UDP protocol
+int th_prepare(char *buf, int req, char *name, float val, float set);
+int th_batch(char *buf, iter_t *iter, th_batch_t *hdr);
+int th_decode(char *buf, int n, char **dec);
+
 #endif /* __HEATING_H__ */
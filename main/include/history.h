@@ -0,0 +1,61 @@
+#ifndef __HISTORY_H__
+#define __HISTORY_H__
+
+#include <stdint.h>
+#include <time.h>
+
+// per zone temperature history in two round-robin tiers:
+// minute averages for a day and 15 minute averages of those for a week,
+// samples are 1/100 degree, missing slots are HISTORY_NONE
+#define HISTORY_NONE INT16_MIN
+#define HISTORY_SCALE 100
+
+enum {
+    HISTORY_FINE,
+    HISTORY_COARSE,
+    HISTORY_TIER_CNT
+};
+
+#define HISTORY_FINE_S 60
+#define HISTORY_FINE_CNT (24*60*60/HISTORY_FINE_S)
+#define HISTORY_COARSE_S (15*60)
+#define HISTORY_COARSE_CNT (7*24*60*60/HISTORY_COARSE_S)
+// allocated per zone, checked at compile time
+#define HISTORY_ZONE_BUDGET 4352
+
+typedef struct {
+    // slot number (time / step) of newest slot
+    uint32_t slot;
+    uint16_t i;
+    // sum and count for newest slot
+    int32_t sum;
+    uint16_t cnt;
+} history_ring_t;
+
+typedef struct {
+    history_ring_t ring[HISTORY_TIER_CNT];
+    int16_t fine[HISTORY_FINE_CNT];
+    int16_t coarse[HISTORY_COARSE_CNT];
+} history_t;
+
+// /history binary response, little endian header and cnt samples
+// from oldest to newest
+#define HISTORY_VERSION 1
+typedef struct __attribute__((packed)) {
+    char magic;
+    uint8_t version;
+    uint16_t step;
+    uint16_t cnt;
+    uint16_t reserved;
+    // end of newest slot
+    uint32_t time;
+} history_header_t;
+
+history_t *history_new();
+void history_add(history_t *h, float val, time_t now);
+// copies cnt samples of tier starting at slot number from (oldest in
+// header is time / step - cnt), slots no longer in the ring are
+// HISTORY_NONE, returns number of samples copied
+int history_read(history_t *h, int tier, int64_t from, int16_t *out, int cnt, history_header_t *hdr);
+
+#endif /* __HISTORY_H__ */
@@ -19,6 +19,9 @@ typedef struct
     httpd_config_t config;
 #endif
     list_t handlers;
+    // response buffer, server task handles one request at a time
+    char *out;
+    int out_len;
 } httpd_t;
 
 extern httpd_uri_t httpd_default_handlers[];
@@ -29,10 +32,14 @@ void httpd_run(httpd_t *self, int run);
 list_t *httpd_register(httpd_t *self, httpd_uri_t *uri);
 void httpd_unregister(httpd_t *self, list_t *item);
 
-// \0 terminated string only
-#define http_snprintf(REQ, BUF, ...) httpd_resp_send_chunk(REQ, (BUF[0]='\0', snprintf(BUF, sizeof(BUF), __VA_ARGS__), BUF), HTTPD_RESP_USE_STRLEN)
-#define http_write(REQ, BUF, LEN) httpd_resp_send_chunk(REQ, BUF, LEN)
+// chunked response output is collected in buffer of server (from .user_ctx)
+// and sent when full, on http_flush or by http_end, which ends response
+#define http_snprintf(REQ, BUF, ...) http_write(REQ, (BUF[0]='\0', snprintf(BUF, sizeof(BUF), __VA_ARGS__), BUF), HTTPD_RESP_USE_STRLEN)
 
 esp_err_t http_printf(httpd_req_t *req, const char *format, ...);
+// len can be HTTPD_RESP_USE_STRLEN
+esp_err_t http_write(httpd_req_t *req, const char *buf, ssize_t len);
+esp_err_t http_flush(httpd_req_t *req);
+esp_err_t http_end(httpd_req_t *req);
 
 #endif /* __HTTPD_H__ */
@@ -2,6 +2,10 @@
 #define __LOG_H__
 
 #include <stdarg.h>
+#include <stdint.h>
+
+// fixed ring buffer for network logging, power of 2
+#define LOG_SIZE (16*1024)
 
 void log_init();
 int log_add(char *ip, int port);
@@ -10,4 +14,15 @@ int log_local(char *fmt, ...);
 int log_inet(const char *fmt, va_list args);
 extern int (*log_orig)(const char *fmt, va_list vargs);
 
+// send compact records instead of text, see util/collect.py --fmt
+extern int log_binary;
+
+void log_limit(const char *tag, int rate, int burst);
+
+uint32_t log_used();
+extern uint32_t log_dropped;
+extern uint32_t log_dropped_lines;
+extern uint32_t log_high_water;
+extern uint32_t log_suppressed;
+
 #endif /* __LOG_H__ */
@@ -52,5 +52,6 @@ struct metar {
 
 metar_t *metar_new(char *icao, uint16_t station);
 void metar_run(metar_t *self, int run);
+char *metar_decode(metar_t *self, char *buf, size_t len, metar_t *parent);
 
 #endif /* __UTIL_H__ */
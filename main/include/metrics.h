@@ -0,0 +1,63 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "emit.h"
+
+// registry of counters, gauges and histograms for /metrics (Prometheus
+// text format), subsystems update them as things happen, expensive
+// probes are refreshed by probe task every METRICS_PERIOD_S (controller)
+// or on scrape
+enum {
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM,
+    METRIC_TYPE_CNT
+};
+
+#ifdef CONFIG_ESP_METRICS_MAX
+#define METRICS_MAX CONFIG_ESP_METRICS_MAX
+#else
+#define METRICS_MAX 64
+#endif
+// bucket counts of all histograms
+#define METRICS_BUCKETS_MAX 32
+#define METRICS_PERIOD_S 15
+#define METRIC_LABELS_MAX 32
+
+typedef struct {
+    const char *name;
+    const char *help;
+    uint8_t type;
+    uint8_t buckets;
+    // not exported, slot is reused by metric of the same name
+    uint8_t dropped;
+    // preformatted, e.g. task="th_udp"
+    char labels[METRIC_LABELS_MAX];
+    // counter, gauge or histogram sum
+    double value;
+    uint32_t cnt;
+    // histogram upper bounds and counts (not cumulative)
+    const float *bounds;
+    uint32_t *counts;
+} metric_t;
+
+// registered once and kept until dropped, same name and labels return
+// the same metric, NULL if registry is full (updates are ignored)
+metric_t *metric_counter(const char *name, const char *help);
+metric_t *metric_gauge(const char *name, const char *help);
+// bounds ascending, +Inf is implicit
+metric_t *metric_histogram(const char *name, const char *help, const float *bounds, int cnt);
+// label is key and value, e.g. "task", "th_udp"
+metric_t *metric_labeled(int type, const char *name, const char *help, const char *key, const char *value);
+// labeled metric of something gone (e.g. task), m can't be used after
+void metric_drop(metric_t *m);
+void metric_add(metric_t *m, double val);
+void metric_set(metric_t *m, double val);
+void metric_observe(metric_t *m, double val);
+// Prometheus text exposition, returns first write error
+int metrics_write(emit_write_t write, void *ctx);
+int metrics_count();
+
+#endif /* __METRICS_H__ */
@@ -0,0 +1,53 @@
+#ifndef __OUTDOOR_H__
+#define __OUTDOOR_H__
+
+#include <time.h>
+
+// outdoor temperature for weather compensated heating,
+// sources in order of preference
+enum {
+    OUTDOOR_ZONE,
+    OUTDOOR_SHMU,
+    OUTDOOR_METAR,
+    OUTDOOR_SRC_CNT
+};
+
+// older measurements are ignored
+#define OUTDOOR_MAX_AGE_S (2*60*60)
+// OWM forecast is 5 days in 3 hour steps, only first day matters
+#define OUTDOOR_FORECAST_MAX 8
+// heating curve limits, lead is within forecast
+#define OUTDOOR_CURVE_SLOPE_MAX 2.0
+#define OUTDOOR_CURVE_REF_MIN -20.0
+#define OUTDOOR_CURVE_REF_MAX 30.0
+#define OUTDOOR_CURVE_LEAD_H_MAX 24.0
+#define OUTDOOR_CURVE_MAX_MAX 10.0
+
+typedef struct {
+    // setpoint offset per degree of outdoor temperature below ref
+    float slope;
+    float ref;
+    // forecast lookahead, about slab response time
+    float lead_h;
+    // offset limit both ways
+    float max;
+} outdoor_curve_t;
+
+extern outdoor_curve_t outdoor_curve;
+
+void outdoor_update(int source, float temp);
+// points sorted by time, replaces previous forecast
+void outdoor_forecast(time_t *t, float *temp, int cnt);
+// NAN if no source is fresh
+float outdoor_temp();
+// interpolated forecast, NAN if outside of forecast
+float outdoor_ahead(time_t ahead);
+// effective outdoor temperature for heating over lead time
+float outdoor_effective();
+// setpoint offset from heating curve, 0 if disabled or unknown
+float outdoor_offset();
+// "SLOPE[,REF[,LEAD_H[,MAX]]]", slope 0 disables
+int outdoor_curve_set(char *value);
+void outdoor_init();
+
+#endif /* __OUTDOOR_H__ */
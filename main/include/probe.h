@@ -0,0 +1,11 @@
+#ifndef __PROBE_H__
+#define __PROBE_H__
+
+// refreshes heap, NVS, task and module gauges of /metrics every
+// METRICS_PERIOD_S so scrapes only format cached values, clients
+// without METRICS_PROBE_CLIENTS refresh on scrape instead
+void probe_init();
+// before /metrics is written
+void probe_scrape();
+
+#endif /* __PROBE_H__ */
@@ -1,6 +1,8 @@
 #ifndef __RELAY_H__
 #define __RELAY_H__
 
+#include <stdint.h>
+
 void relay_init(int count, int v5);
 void relay_init_pin(int pin, int v5);
 void relay_init_gpio(int gpio, int v5);
@@ -9,5 +11,11 @@ void relay_set_pin_5v(int pin, int state);
 void relay_set_gpio(int gpio, int state);
 void relay_set_gpio_5v(int gpio, int state);
 void relay_reset_gpio(int gpio);
+// queued, applied by relay task, returns applied state (-1 before first)
+int relay_schedule(int gpio, int state);
+// now, without dwell or stagger (safety off)
+int relay_force(int gpio, int state);
+int relay_state(int gpio);
+uint32_t relay_switches(int gpio);
 
 #endif /* __RELAY_H__ */
@@ -60,7 +60,12 @@ char *get_mac();
 void hostname_set(char *hostname);
 
 #include <time.h>
+#include <stdint.h>
 size_t format_time(time_t time, char *strftime_buf, int size, char *fmt);
+// enough for any float
+#define FORMAT_FIXED_SIZE 16
+int format_fixed(char *buf, float val, int decimals);
+int format_int(char *buf, int64_t v);
 char *set_time(char *dt);
 
 #include "freertos/FreeRTOSConfig.h"
@@ -94,8 +99,21 @@ BaseType_t xxTaskCreate(TaskFunction_t pvTaskCode, const char *const pcName,
 #include "mbedtls/aes.h"
 
 #define AES_PADDED_SIZE(len) ((len < 16) ? 16 : (((len-1) / 16 + 1) * 16))
-void aes_init(mbedtls_aes_context *aes, char *aes_key, int len);
-int aes_cbc(int enc, mbedtls_aes_context *aes, char *iv, int len, char *buf, int bufsiz, char *out);
+// key schedules for both directions, set once per key
+typedef struct {
+    mbedtls_aes_context enc;
+    mbedtls_aes_context dec;
+} aes_key_t;
+
+// part of cleartext gathered for encryption
+typedef struct {
+    const void *buf;
+    int len;
+} aes_iov_t;
+
+int aes_key_set(aes_key_t *key, char *data, int bits);
+int aes_cbc(int enc, aes_key_t *key, char *iv, char *buf, int len);
+int aes_cbc_iov(aes_key_t *key, char *iv, aes_iov_t *iov, int cnt, char *out, int size);
 
 #define B64_ENC_LEN(n) (((4 * n / 3) + 3) & ~3)
 #define B64_DEC_LEN(n) (3*n/4)
@@ -109,10 +127,6 @@ void wall_clock_wait(int s, TickType_t wait);
 void wall_clock_wait_until_ms(uint32_t ms, TickType_t wait);
 void wall_clock_wait_until(struct timeval tv_end, TickType_t wait);
 
-extern struct sockaddr_in GRAPHITE_SA;
-int graphite_init(char *host, int port);
-int graphite_udp(char *prefix, char *metric, char *tag, float val, int now, time_t ts);
-
 #define _vTaskDelay(x) vTaskDelay(x)
 #define __vTaskDelay(x) {                                                \
         vTaskDelay(x);                                                  \
@@ -0,0 +1,34 @@
+#ifndef __ZONE_H__
+#define __ZONE_H__
+
+#include "heating.h"
+#include "emit.h"
+
+// heating zone serialization for HTTP API and thermostat UDP
+// emit formats keep their values, zone is passed to emit as is
+enum {
+    // key=value lines of /temp/get
+    ZONE_TEXT = EMIT_TEXT,
+    // map with the same keys (emit.h), NaN is null
+    ZONE_JSON = EMIT_JSON,
+    ZONE_CBOR = EMIT_CBOR,
+    // name, val and set as in thermostat UDP batch (TH_BATCH_ENTRY)
+    ZONE_BIN = EMIT_FMT_CNT,
+    ZONE_FMT_CNT
+};
+
+// fix, state, triggered and change (controller)
+#define ZONE_STATE 0x01
+// controller mode, duty, estimator and heating curve
+#define ZONE_CTL 0x02
+// enough for any zone in any format
+#define ZONE_SIZE 512
+
+// writes zone into buf, returns length or -1 if it doesn't fit
+int zone_format(heating_t *data, int fmt, int flags, char *buf, int size);
+// zone map (JSON/CBOR) into e
+void zone_emit(emit_t *e, heating_t *data, int flags);
+char *zone_fmt_name(int fmt);
+int zone_fmt(char *name);
+
+#endif /* __ZONE_H__ */
@@ -8,25 +8,126 @@
 #include <netinet/in.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stddef.h>
+#include <inttypes.h>
 
+#include "freertos/atomic.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_memory_utils.h"
 #include "esp_log.h"
 static const char *TAG = "log";
 
-// ideally it can withstand boot until wifi is connected without realloc
-#define LOG_MAX (32*1024)
-#define LOG_SIZE (16*1024)
-#define LOG_GROW_ADD 1024
-// enough for steady connection
-#define LOG_SHRINK_SIZE 1024
+// ideally it can withstand boot until wifi is connected, LOG_SIZE in log.h
+// deliberate limit on length of single message
+#define LOG_LINE_MAX 256
+// lines are formatted in static buffers, not on stack of logging task
+// (many have 2K stacks), more concurrent loggers allocate
+#define LOG_LINES 4
 // both smaller possibility of loss and smaller possible loss
 #define CHUNK 1024
 
+// binary record: mark, length, level, format address, arguments
+// mark is not valid UTF-8 so it can't appear in text lines
+#define LOG_BIN_MARK 0xff
+#define LOG_BIN_HEADER (1+1+1+4)
+// length is single byte
+#define LOG_BIN_MAX (LOG_LINE_MAX - 1)
+_Static_assert(LOG_BIN_MAX <= 0xff, "binary record length doesn't fit");
+
+// tail of the ring is mirrored to RTC memory, survives reset but not power
+// loss, power of 2 and ESP32 has 8K of RTC slow memory
+#define LOG_RTC_SIZE 2048
+#define LOG_RTC_MAGIC 0x4c4f4732
+_Static_assert((LOG_RTC_SIZE & (LOG_RTC_SIZE - 1)) == 0 && LOG_RTC_SIZE <= LOG_SIZE,
+               "LOG_RTC_SIZE must be power of 2");
+
+// token bucket per tag, rate in lines per second (0 unlimited)
+// burst covers boot when every module logs its initialization
+#define LOG_RATE_DEFAULT 20
+#define LOG_BURST_DEFAULT 200
+#define LOG_LIMITS 32
+// tokens are in 1/1000 of a line
+#define LOG_TOKEN 1000
+
+// free-running 24-bit positions, ring size must be power of 2
+#define LOG_POS_MASK 0xffffff
+#define LOG_POS(x) ((x) & LOG_POS_MASK)
+// head and number of writers that reserved space but haven't finished copying
+// share one word so the reservation is a single compare-and-swap
+#define LOG_STATE(head, writers) ((LOG_POS(head) << 8) | (writers))
+#define LOG_HEAD(state) ((state) >> 8)
+#define LOG_WRITERS(state) ((state) & 0xff)
+#define LOG_WRITERS_MAX 0xff
+_Static_assert((LOG_SIZE & (LOG_SIZE - 1)) == 0 && LOG_SIZE <= LOG_POS_MASK/2,
+               "LOG_SIZE must be power of 2");
+
 //vprintf_like_t *log_orig;
 int (*log_orig)(const char *fmt, va_list vargs) = NULL;
 
-static int log_size = 0;
-static char *log_buf = NULL;
-static char *log_ptr = NULL;
+// allocated once, never resized
+static char *log_ring = NULL;
+static volatile uint32_t log_state = 0;
+// only written by log_task
+static volatile uint32_t log_tail = 0;
+
+uint32_t log_dropped = 0;
+uint32_t log_dropped_lines = 0;
+uint32_t log_high_water = 0;
+
+int log_binary = 0;
+
+static char log_lines[LOG_LINES][LOG_LINE_MAX];
+// bit per buffer in log_lines
+static volatile uint32_t log_lines_used = 0;
+_Static_assert(LOG_LINES <= 32, "log_lines_used is 32 bits");
+
+// positions are same as in ring, head can be behind by last line
+typedef struct {
+    uint32_t magic;
+    uint32_t head;
+    uint32_t tail;
+    // binary records were mirrored, replay resyncs on them
+    uint32_t binary;
+    char data[LOG_RTC_SIZE];
+} log_rtc_t;
+
+static RTC_NOINIT_ATTR log_rtc_t log_rtc;
+static int log_rtc_valid = 0;
+
+// slot is claimed once and initialized before it's published
+enum {
+    LOG_LIMIT_FREE,
+    LOG_LIMIT_CLAIMED,
+    LOG_LIMIT_READY,
+};
+
+typedef struct {
+    volatile uint32_t state;
+    // pointer of tag passed to ESP_LOGx, matched first
+    const char * volatile tag;
+    // configured before tag was seen, never freed
+    char *name;
+    // -1 for defaults
+    int rate;
+    int burst;
+    int32_t tokens;
+    TickType_t last;
+    uint32_t suppressed;
+} log_limit_t;
+
+static log_limit_t log_limits[LOG_LIMITS];
+// dynamic tags and full table share this one
+static log_limit_t log_limit_other = {
+    .state = LOG_LIMIT_READY,
+    .tag = "*",
+    .rate = -1,
+    .burst = -1,
+    .tokens = LOG_BURST_DEFAULT * LOG_TOKEN,
+};
+static int log_rate = LOG_RATE_DEFAULT;
+static int log_burst = LOG_BURST_DEFAULT;
+uint32_t log_suppressed = 0;
 
 typedef struct {
     char *ip;
@@ -51,22 +152,6 @@ static log_info_t default_targets[] = {
 
 list_t log_targets = {0};
 
-static SemaphoreHandle_t mutex = NULL;
-static int LOG_ENTER(int nonblock)
-{
-    if (mutex == NULL) {
-        mutex = xSemaphoreCreateMutex();
-        assert(mutex != NULL);
-    }
-
-    return xSemaphoreTake(mutex, (nonblock)? 0 : portMAX_DELAY) == pdTRUE;
-}
-
-static void LOG_EXIT()
-{
-    xSemaphoreGive(mutex);
-}
-
 static inline int log_socket()
 {
     static int sock = -1;
@@ -112,66 +197,63 @@ static inline int log_socket()
     return sock;
 }
 
+uint32_t log_used()
+{
+    return LOG_POS(LOG_HEAD(log_state) - log_tail);
+}
+
+static void log_send(int sock, const char *data, int size)
+{
+    // this call could hang when disconnected
+    list_t *item = &log_targets;
+    while ((item = list_iter(item)) != NULL) {
+        log_info_t *l = (log_info_t *) item->data;
+        if (l->sa.sin_addr.s_addr == 0) {
+            assert(l->ip != NULL);
+            // it's probably a hostname
+            if (!wifi_connected || init_sa(l->ip, l->port, &l->sa) == 0)
+                continue;
+        }
+
+        for (int i=0; i<size; i+=CHUNK)
+            sendto(sock, data + i, (size - i > CHUNK)? CHUNK : size - i,
+                   MSG_DONTWAIT,
+                   (struct sockaddr *) &LIST(log_info_t, item, sa),
+                   sizeof(LIST(log_info_t, item, sa)));
+        // whatever could get out, everything else is lost now
+    }
+}
+
+static void log_suppressed_flush(log_limit_t *l);
+
 static void log_task(void *pvParameter)
 {
     while (1) {
+        for (int i=0; i<LOG_LIMITS; i++)
+            log_suppressed_flush(&log_limits[i]);
+        log_suppressed_flush(&log_limit_other);
+
         int sock = log_socket();
-        if (sock >= 0 && log_ptr > log_buf && wifi_connected) {
-            char *log_send = NULL;
-            int size = log_ptr-log_buf;
-
-            if (list_count(&log_targets) == 0)
-                goto SKIP;
-
-            LOG_ENTER(0);
-            log_send = malloc(size);
-            if (log_send != NULL) {
-                memcpy(log_send, log_buf, size);
-                log_ptr = log_buf;
-            }
-            LOG_EXIT();
-
-        SKIP:
-            // shrink when connected
-            int new_size = LOG_SHRINK_SIZE;
-            if (log_size > new_size) {
-                LOG_ENTER(0);
-                char *shrunk = realloc(log_buf, new_size);
-                if (shrunk != NULL) {
-                    log_size = new_size;
-                    log_buf = shrunk;
-                    log_ptr = log_buf;
-                }
-                LOG_EXIT();
-                if (log_buf == shrunk)
-                    ESP_LOGW(TAG, "buffer shrunk to %d", new_size);
+        if (sock >= 0 && wifi_connected && list_count(&log_targets) > 0) {
+            uint32_t state = log_state;
+            // somebody is still copying, it's quick so try again shortly
+            for (int i=0; i<10 && LOG_WRITERS(state) != 0; i++) {
+                _vTaskDelay(MS_TO_TICK(10));
+                state = log_state;
             }
 
-            // this call could hang when disconnected
-            if (log_send != NULL) {
-                list_t *item = &log_targets;
-                while ((item = list_iter(item)) != NULL) {
-                    log_info_t *l = (log_info_t *) item->data;
-                    if (l->sa.sin_addr.s_addr == 0) {
-                        assert(l->ip != NULL);
-                        // it's probably a hostname
-                        if (!wifi_connected || init_sa(l->ip, l->port, &l->sa) == 0)
-                            continue;
-                    }
-                    /*
-                    sendto(sock, log_send, size, MSG_DONTWAIT,
-                           (struct sockaddr *) &LIST(log_info_t, item, sa),
-                           sizeof(LIST(log_info_t, item, sa)));
-                    */
-                    for (int i=0; i<(size/CHUNK)+1; i++)
-                        sendto(sock, log_send + i*CHUNK,
-                               ((i+1)*CHUNK > size)? size % CHUNK : CHUNK,
-                               MSG_DONTWAIT,
-                               (struct sockaddr *) &LIST(log_info_t, item, sa),
-                               sizeof(LIST(log_info_t, item, sa)));
-                    // whatever could get out, everything else is lost now
-                }
-                free(log_send);
+            uint32_t tail = log_tail;
+            uint32_t size = LOG_POS(LOG_HEAD(state) - tail);
+            if (LOG_WRITERS(state) == 0 && size > 0) {
+                // sent in place, producers can't reach anything before head
+                uint32_t start = tail & (LOG_SIZE - 1);
+                uint32_t first = (start + size > LOG_SIZE)? LOG_SIZE - start : size;
+                log_send(sock, log_ring + start, first);
+                if (first < size)
+                    log_send(sock, log_ring, size - first);
+                log_tail = LOG_POS(tail + size);
+                if (log_rtc_valid)
+                    log_rtc.tail = log_tail;
             }
         }
 
@@ -181,41 +263,413 @@ static void log_task(void *pvParameter)
     }
 }
 
-int log_inet(const char *fmt, va_list vargs)
+// returns ring position or -1 if there's no space
+static int log_reserve(uint32_t len)
+{
+    uint32_t state, used;
+    do {
+        state = log_state;
+        used = LOG_POS(LOG_HEAD(state) - log_tail);
+        if (used + len > LOG_SIZE || LOG_WRITERS(state) == LOG_WRITERS_MAX)
+            return -1;
+    } while (Atomic_CompareAndSwap_u32(&log_state,
+                                       LOG_STATE(LOG_HEAD(state) + len, LOG_WRITERS(state) + 1),
+                                       state) != ATOMIC_COMPARE_AND_SWAP_SUCCESS);
+
+    // not exact with concurrent writers but good enough for statistics
+    if (used + len > log_high_water)
+        log_high_water = used + len;
+    return LOG_HEAD(state);
+}
+
+static void log_commit(uint32_t pos, const char *data, uint32_t len)
+{
+    uint32_t start = pos & (LOG_SIZE - 1);
+    uint32_t first = (start + len > LOG_SIZE)? LOG_SIZE - start : len;
+    memcpy(log_ring + start, data, first);
+    if (first < len)
+        memcpy(log_ring, data + first, len - first);
+
+    if (log_rtc_valid) {
+        start = pos & (LOG_RTC_SIZE - 1);
+        first = (start + len > LOG_RTC_SIZE)? LOG_RTC_SIZE - start : len;
+        memcpy(log_rtc.data + start, data, first);
+        if (first < len)
+            memcpy(log_rtc.data, data + first, len - first);
+    }
+
+    // writers count is in the lowest bits
+    uint32_t state = Atomic_Decrement_u32(&log_state);
+    // everything up to head is written when we were the last one
+    if (log_rtc_valid && LOG_WRITERS(state) == 1)
+        log_rtc.head = LOG_HEAD(state);
+}
+
+static void log_write(const char *data, uint32_t len)
+{
+    int pos = log_reserve(len);
+    if (pos < 0) {
+        // that's too much, keep the older lines
+        Atomic_Add_u32(&log_dropped, len);
+        Atomic_Increment_u32(&log_dropped_lines);
+        return;
+    }
+
+    log_commit(pos, data, len);
+}
+
+// skips color
+static const char *log_prefix(const char *fmt)
+{
+    if (fmt[0] == '\033' && (fmt = strchr(fmt, 'm')) != NULL)
+        fmt += 1;
+    return fmt;
+}
+
+// ESP_LOGx format starts with level, timestamp and tag
+static const char *log_tag(const char *fmt, va_list vargs)
+{
+    fmt = log_prefix(fmt);
+    if (fmt == NULL || fmt[0] == '\0' || strchr("EWIDV", fmt[0]) == NULL ||
+        strncmp(fmt + 1, " (%", 3) != 0)
+        return NULL;
+
+    // system time is a string
+    if (fmt[4 + strspn(fmt + 4, "l")] == 's')
+        va_arg(vargs, const char *);
+    else
+        va_arg(vargs, uint32_t);
+    return va_arg(vargs, const char *);
+}
+
+static log_limit_t *log_limit_claim()
+{
+    for (int i=0; i<LOG_LIMITS; i++) {
+        log_limit_t *l = &log_limits[i];
+        if (l->state == LOG_LIMIT_FREE &&
+            Atomic_CompareAndSwap_u32(&l->state, LOG_LIMIT_CLAIMED, LOG_LIMIT_FREE) == ATOMIC_COMPARE_AND_SWAP_SUCCESS)
+            return l;
+    }
+    return NULL;
+}
+
+static void log_limit_publish(log_limit_t *l)
+{
+    // compare-and-swap is a barrier, fields are visible before state
+    Atomic_CompareAndSwap_u32(&l->state, LOG_LIMIT_READY, LOG_LIMIT_CLAIMED);
+}
+
+static log_limit_t *log_limit_find(const char *tag)
+{
+    if (tag == NULL)
+        return &log_limit_other;
+
+    for (int i=0; i<LOG_LIMITS; i++)
+        if (log_limits[i].state == LOG_LIMIT_READY && log_limits[i].tag == tag)
+            return &log_limits[i];
+
+    for (int i=0; i<LOG_LIMITS; i++) {
+        log_limit_t *l = &log_limits[i];
+        if (l->state == LOG_LIMIT_READY && l->name != NULL && strcmp(l->name, tag) == 0) {
+            // rebinding is harmless
+            if (esp_ptr_in_drom(tag))
+                l->tag = tag;
+            return l;
+        }
+    }
+
+    // pointer is kept so it can't be freed later
+    if (!esp_ptr_in_drom(tag))
+        return &log_limit_other;
+
+    log_limit_t *l = log_limit_claim();
+    if (l == NULL)
+        return &log_limit_other;
+
+    l->tag = tag;
+    l->rate = -1;
+    l->burst = -1;
+    l->last = xTaskGetTickCount();
+    l->tokens = log_burst * LOG_TOKEN;
+    log_limit_publish(l);
+    return l;
+}
+
+// not exact with concurrent callers of the same tag, it doesn't need to be
+static int log_limit_take(log_limit_t *l)
+{
+    int rate = (l->rate < 0)? log_rate : l->rate;
+    if (rate == 0)
+        return 1;
+    int32_t burst = ((l->burst < 0)? log_burst : l->burst) * LOG_TOKEN;
+
+    TickType_t now = xTaskGetTickCount();
+    uint32_t ms = TICK_TO_MS(now - l->last);
+    // avoid overflow after a long pause
+    if (ms > burst / rate + 1)
+        ms = burst / rate + 1;
+    int32_t tokens = l->tokens + ms * rate;
+    if (tokens > burst)
+        tokens = burst;
+    l->last = now;
+
+    if (tokens < LOG_TOKEN) {
+        l->tokens = tokens;
+        Atomic_Increment_u32(&l->suppressed);
+        Atomic_Increment_u32(&log_suppressed);
+        return 0;
+    }
+
+    l->tokens = tokens - LOG_TOKEN;
+    return 1;
+}
+
+static void log_suppressed_flush(log_limit_t *l)
+{
+    uint32_t n = l->suppressed;
+    if (n == 0 || l->state != LOG_LIMIT_READY)
+        return;
+    // configured tag seen only as copy
+    const char *tag = (l->tag != NULL)? l->tag : l->name;
+    Atomic_Subtract_u32(&l->suppressed, n);
+
+    char line[64];
+    int len = snprintf(line, sizeof(line), "W (%" PRIu32 ") %s: suppressed %" PRIu32 " lines\n",
+                       esp_log_timestamp(), tag, n);
+    if (len >= sizeof(line)) {
+        len = sizeof(line) - 1;
+        line[len - 1] = '\n';
+    }
+    if (len > 0)
+        log_write(line, len);
+}
+
+// rate -1 and burst -1 keep defaults, tag "*" changes defaults
+void log_limit(const char *tag, int rate, int burst)
 {
-    log_orig(fmt, vargs);
-
-    LOG_ENTER(0);
-    int ret = vsnprintf(log_ptr, (log_buf+log_size) - log_ptr, fmt, vargs);
-    if (ret > 0 && log_ptr+ret < log_buf+log_size - 100)
-        log_ptr += ret;
-    else if (log_size >= LOG_MAX) {
-        // that's too much
+    if (strcmp(tag, "*") == 0) {
+        log_rate = (rate < 0)? LOG_RATE_DEFAULT : rate;
+        log_burst = (burst < 0)? LOG_BURST_DEFAULT : burst;
+        return;
+    }
+
+    log_limit_t *l = NULL;
+    for (int i=0; i<LOG_LIMITS && l == NULL; i++)
+        if (log_limits[i].state == LOG_LIMIT_READY &&
+            ((log_limits[i].name != NULL && strcmp(log_limits[i].name, tag) == 0) ||
+             (log_limits[i].tag != NULL && strcmp(log_limits[i].tag, tag) == 0)))
+            l = &log_limits[i];
+
+    if (l != NULL) {
+        l->rate = rate;
+        l->burst = burst;
     } else {
-        // grow
-        int new_size = log_size + LOG_GROW_ADD;
-        char *grown = realloc(log_buf, new_size);
-        if (grown != NULL) {
-            log_local("log buffer(%d) grown to %d\n", log_size, new_size);
-            log_ptr = grown + (log_ptr - log_buf);
-            log_buf = grown;
-            log_size = new_size;
-        } else {
-            LOG_EXIT();
-            log_local("log buffer(%d) failed to increase\n", log_size);
+        l = log_limit_claim();
+        if (l == NULL) {
+            ESP_LOGE(TAG, "no space to limit %s", tag);
+            return;
+        }
+
+        // matched by name, log_limit_find will bind the pointer
+        l->name = strdup(tag);
+        assert(l->name != NULL);
+        l->rate = rate;
+        l->burst = burst;
+        l->last = xTaskGetTickCount();
+        l->tokens = ((burst < 0)? log_burst : burst) * LOG_TOKEN;
+        log_limit_publish(l);
+    }
+    ESP_LOGI(TAG, "limit %s to %d/s burst %d", tag, rate, burst);
+}
+
+#define LOG_BIN_PUT(VAL, SIZE) do {                                     \
+        if (p + (SIZE) > end)                                           \
+            return -1;                                                  \
+        memcpy(p, (VAL), (SIZE));                                       \
+        p += (SIZE);                                                    \
+    } while (0)
+
+// only arguments are sent, host renders them with format string found in
+// ELF by address (util/logfmt.py), anything unusual is sent as text
+static int log_encode(char *out, int size, const char *fmt, va_list vargs)
+{
+    if (!esp_ptr_in_drom(fmt))
+        return -1;
+
+    char *p = out + LOG_BIN_HEADER;
+    char *end = out + size;
+    const char *f = log_prefix(fmt);
+    char level = (f != NULL && f[0] != '\0')? f[0] : '?';
+
+    for (f = fmt; (f = strchr(f, '%')) != NULL; ) {
+        f += 1;
+        f += strspn(f, "-+ #0");
+        for (int i=0; i<2; i++) {
+            if (*f == '*') {
+                int v = va_arg(vargs, int);
+                LOG_BIN_PUT(&v, 4);
+                f += 1;
+            } else
+                f += strspn(f, "0123456789");
+            if (i > 0 || *f != '.')
+                break;
+            f += 1;
+        }
+
+        char len = '\0';
+        if ((f[0] == 'l' && f[1] == 'l') || (f[0] == 'h' && f[1] == 'h')) {
+            len = (f[0] == 'l')? 'q' : 'c';
+            f += 2;
+        } else if (*f != '\0' && strchr("hlzjtL", *f) != NULL)
+            len = *f++;
+
+        switch (*f) {
+        case '%':
+            break;
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            if (len == 'q' || len == 'j') {
+                long long v = va_arg(vargs, long long);
+                LOG_BIN_PUT(&v, 8);
+            } else {
+                int32_t v;
+                if (len == 'l')
+                    v = va_arg(vargs, long);
+                else if (len == 'z')
+                    v = va_arg(vargs, size_t);
+                else if (len == 't')
+                    v = va_arg(vargs, ptrdiff_t);
+                else
+                    v = va_arg(vargs, int);
+                LOG_BIN_PUT(&v, 4);
+            }
+            break;
+        case 'c': {
+            char v = va_arg(vargs, int);
+            LOG_BIN_PUT(&v, 1);
+            break;
+        }
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A': {
+            // precision of sensors doesn't need double
+            float v = (len == 'L')? va_arg(vargs, long double) : va_arg(vargs, double);
+            LOG_BIN_PUT(&v, 4);
+            break;
+        }
+        case 'p': {
+            uint32_t v = (uintptr_t) va_arg(vargs, void *);
+            LOG_BIN_PUT(&v, 4);
+            break;
+        }
+        case 's': {
+            const char *v = va_arg(vargs, const char *);
+            if (v == NULL)
+                v = "(null)";
+            if (esp_ptr_in_drom(v)) {
+                // mostly tags, sent as address same as format
+                uint8_t mark = LOG_BIN_MARK;
+                uint32_t addr = (uintptr_t) v;
+                LOG_BIN_PUT(&mark, 1);
+                LOG_BIN_PUT(&addr, 4);
+            } else {
+                int n = strnlen(v, end - p);
+                if (p + n >= end)
+                    return -1;
+                memcpy(p, v, n);
+                p += n;
+                *p++ = '\0';
+            }
+            break;
+        }
+        default:
+            // %n or something broken
             return -1;
         }
 
-        // one more attempt, if it's longer than 1024 then you deserve it
-        ret = vsnprintf(log_ptr, (log_buf+log_size) - log_ptr, fmt, vargs);
-        if (ret > 0)
-            log_ptr += ret;
+        if (*f != '\0')
+            f += 1;
+    }
+
+    uint32_t addr = (uintptr_t) fmt;
+    out[0] = LOG_BIN_MARK;
+    out[1] = p - out;
+    out[2] = level;
+    memcpy(out + 3, &addr, sizeof(addr));
+    return p - out;
+}
+
+// NULL if there's neither free buffer nor heap
+static char *log_line_get()
+{
+    uint32_t used;
+    while ((used = log_lines_used) != (1U << LOG_LINES) - 1) {
+        int i = __builtin_ctz(~used);
+        if (Atomic_CompareAndSwap_u32(&log_lines_used, used | (1U << i), used) == ATOMIC_COMPARE_AND_SWAP_SUCCESS)
+            return log_lines[i];
+    }
+    return malloc(LOG_LINE_MAX);
+}
+
+static void log_line_put(char *line)
+{
+    if (line >= log_lines[0] && line < log_lines[LOG_LINES])
+        Atomic_AND_u32(&log_lines_used, ~(1U << ((line - log_lines[0]) / LOG_LINE_MAX)));
+    else
+        free(line);
+}
+
+int log_inet(const char *fmt, va_list vargs)
+{
+    va_list copy;
+    va_copy(copy, vargs);
+    log_orig(fmt, copy);
+    va_end(copy);
+
+    if (log_ring == NULL)
+        return 0;
+
+    va_copy(copy, vargs);
+    const char *tag = log_tag(fmt, copy);
+    va_end(copy);
+    if (!log_limit_take(log_limit_find(tag)))
+        return 0;
+
+    char *line = log_line_get();
+    if (line == NULL) {
+        Atomic_Increment_u32(&log_dropped_lines);
+        return 0;
+    }
 
-        if (log_size >= LOG_MAX)
-            log_local("log buffer(%d) limited to %d\n", log_size, LOG_MAX);
+    int ret = -1;
+    if (log_binary) {
+        va_copy(copy, vargs);
+        ret = log_encode(line, LOG_BIN_MAX, fmt, copy);
+        va_end(copy);
+        if (ret >= 0 && log_rtc_valid)
+            log_rtc.binary = 1;
+    }
+
+    if (ret < 0) {
+        ret = vsnprintf(line, LOG_LINE_MAX, fmt, vargs);
+        if (ret >= LOG_LINE_MAX) {
+            ret = LOG_LINE_MAX - 1;
+            line[ret - 1] = '\n';
+        }
     }
 
-    LOG_EXIT();
+    if (ret > 0)
+        log_write(line, ret);
+    log_line_put(line);
     return ret;
 }
 
@@ -245,10 +699,146 @@ int log_add(char *ip, int port)
     return 1;
 }
 
+#define LOG_RTC_AT(pos) ((uint8_t) log_rtc.data[(pos) & (LOG_RTC_SIZE - 1)])
+
+// length of binary record or text line at pos, 0 if it isn't one,
+// partial is set when it continues past left bytes
+static uint32_t log_rtc_entry(uint32_t pos, uint32_t left, int *partial)
+{
+    if (LOG_RTC_AT(pos) != LOG_BIN_MARK) {
+        // text starts with level or color and never has the mark
+        if (strchr("EWIDV\033", LOG_RTC_AT(pos)) == NULL || LOG_RTC_AT(pos) == '\0')
+            return 0;
+        for (uint32_t i=0; i<left && i<LOG_LINE_MAX; i++) {
+            if (LOG_RTC_AT(pos + i) == LOG_BIN_MARK)
+                return 0;
+            if (LOG_RTC_AT(pos + i) == '\n')
+                return i + 1;
+        }
+        if (left >= LOG_LINE_MAX)
+            return 0;
+        *partial = 1;
+        return left;
+    }
+
+    if (left < LOG_BIN_HEADER) {
+        *partial = 1;
+        return left;
+    }
+    uint32_t len = LOG_RTC_AT(pos + 1);
+    uint8_t level = LOG_RTC_AT(pos + 2);
+    uint32_t addr = 0;
+    for (int i=0; i<4; i++)
+        addr |= (uint32_t) LOG_RTC_AT(pos + 3 + i) << (8*i);
+    if (len < LOG_BIN_HEADER || strchr("EWIDV?", level) == NULL || level == '\0' ||
+        !esp_ptr_in_drom((void *) (uintptr_t) addr))
+        return 0;
+    if (len > left) {
+        *partial = 1;
+        return left;
+    }
+    return len;
+}
+
+// complete bytes from pos if entries follow each other up to the end
+// (last one may be cut), 0 if pos isn't start of an entry
+static uint32_t log_rtc_chain(uint32_t pos, uint32_t left)
+{
+    uint32_t complete = 0;
+    while (left > 0) {
+        int partial = 0;
+        uint32_t n = log_rtc_entry(pos, left, &partial);
+        if (n == 0)
+            return 0;
+        if (partial)
+            break;
+        pos = LOG_POS(pos + n);
+        left -= n;
+        complete += n;
+    }
+    return complete;
+}
+
+// unsent lines from before reset go first into the ring
+static void log_rtc_replay()
+{
+    esp_reset_reason_t reason = esp_reset_reason();
+    uint32_t unsent = LOG_POS(log_rtc.head - log_rtc.tail);
+    int binary = 0;
+    if (log_rtc.magic == LOG_RTC_MAGIC && reason != ESP_RST_POWERON &&
+        reason != ESP_RST_BROWNOUT && unsent > 0 && unsent <= LOG_SIZE) {
+        uint32_t pos = log_rtc.tail;
+        int cut = unsent > LOG_RTC_SIZE;
+        if (cut) {
+            pos = LOG_POS(log_rtc.head - LOG_RTC_SIZE);
+            unsent = LOG_RTC_SIZE;
+        }
+        binary = log_rtc.binary;
+        if (binary) {
+            // record payload can have newline or mark, first position
+            // from which records and lines follow each other to the end
+            uint32_t skip = 0, complete = 0;
+            for (; skip < unsent; skip++) {
+                uint32_t at = LOG_POS(pos + skip);
+                if (skip == 0 && cut)
+                    continue;
+                if (skip > 0 && LOG_RTC_AT(at) != LOG_BIN_MARK && LOG_RTC_AT(at - 1) != '\n')
+                    continue;
+                if ((complete = log_rtc_chain(at, unsent - skip)) > 0)
+                    break;
+            }
+            // cut record at the end is dropped too
+            pos = LOG_POS(pos + skip);
+            unsent = (skip < unsent)? complete : 0;
+        } else if (cut) {
+            // skip partial line
+            while (unsent > 0 && log_rtc.data[pos & (LOG_RTC_SIZE - 1)] != '\n') {
+                pos = LOG_POS(pos + 1);
+                unsent -= 1;
+            }
+            if (unsent > 0) {
+                pos = LOG_POS(pos + 1);
+                unsent -= 1;
+            }
+        }
+
+        char line[80];
+        int len = snprintf(line, sizeof(line), "W (%" PRIu32 ") %s: replaying %" PRIu32 " bytes from before reset (reason %d)\n",
+                           esp_log_timestamp(), TAG, unsent, reason);
+        log_write(line, len);
+
+        uint32_t start = pos & (LOG_RTC_SIZE - 1);
+        uint32_t first = (start + unsent > LOG_RTC_SIZE)? LOG_RTC_SIZE - start : unsent;
+        log_write(log_rtc.data + start, first);
+        if (first < unsent)
+            log_write(log_rtc.data, unsent - first);
+        // in case last line was cut, binary output never gets one
+        if (!binary && unsent > 0 && log_rtc.data[(pos + unsent - 1) & (LOG_RTC_SIZE - 1)] != '\n')
+            log_write("\n", 1);
+    }
+
+    // start mirroring the new ring including what was replayed, nothing else
+    // is logging yet and ring didn't wrap
+    uint32_t head = LOG_HEAD(log_state);
+    uint32_t tail = (head > LOG_RTC_SIZE)? head - LOG_RTC_SIZE : 0;
+    log_rtc.magic = 0;
+    for (uint32_t i=tail; i<head; i++)
+        log_rtc.data[i & (LOG_RTC_SIZE - 1)] = log_ring[i];
+    log_rtc.tail = tail;
+    log_rtc.head = head;
+    log_rtc.binary = binary;
+    log_rtc.magic = LOG_RTC_MAGIC;
+    log_rtc_valid = 1;
+}
+
 void log_init()
 {
     if (log_orig != NULL)
         return;
+
+    log_ring = malloc(LOG_SIZE);
+    assert(log_ring != NULL);
+    log_rtc_replay();
     log_orig = esp_log_set_vprintf(log_inet);
 
     for (int i=0; i<COUNT_OF(default_targets); i++) {
@@ -261,11 +851,5 @@ void log_init()
         ESP_LOGI(TAG, "logging to %s:%d", t->ip, t->port);
     }
 
-    // we need more at boot and then we can shrink
-    log_size = LOG_SIZE;
-    log_buf = malloc(log_size);
-    log_ptr = log_buf;
-    assert(log_buf != NULL);
-
     xxTaskCreate((void (*)(void*))log_task, "log_task", 5*1024, NULL, 0, NULL);
 }
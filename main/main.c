@@ -152,6 +152,7 @@ void button_handler(button_t *b)
                         // set on controller - can't do it here though
                         // thermostat_update will keep updating and refresh ui
                         oled_update.temp_pending = 1;
+                        thermostat_wake();
                         ESP_LOGI(TAG, "value set: %f", oled_update.temp_set);
                         // oled_update.temp = 1;
                         //heating_temp_set(name, temp_set);
@@ -165,6 +166,7 @@ void button_handler(button_t *b)
                         oled_update.temp_mod *= -1;
                         oled_update.temp_set = oled_update.temp_mod;
                         oled_update.temp_pending = 1;
+                        thermostat_wake();
                         ESP_LOGI(TAG, "value set: %f", oled_update.temp_set);
                         oled_update.invalidate = 1;
                     }
@@ -12,6 +12,7 @@
 #include "ntp.h"
 #include "ping.h"
 #include "module.h"
+#include "outdoor.h"
 #include "config.h"
 
 #include "esp_log.h"
@@ -738,6 +739,8 @@ char *metar_decode(metar_t *self, char *buf, size_t len, metar_t *parent)
                             int T = atoi(token);
                             int Td = atoi(dewp);
                             self->celsius = T;
+                            if (parent == NULL)
+                                outdoor_update(OUTDOOR_METAR, T);
                             self->dew = Td;
                             self->rh = RH(T, Td);
                             ESP_LOGW(TAG, "%s Temperature: %d/%d %.1f%% %.1f%%", self->icao, T, Td, RH(T, Td), RH_(T, Td));
@@ -914,6 +917,7 @@ void shmu_decode(shmu_t *self, char *buf, size_t len, metar_t *metar)
     //char *wd_avg = strtok_r(NULL, ";", &saveptr);
 
     self->ta_2m = ta_2m;
+    outdoor_update(OUTDOOR_SHMU, ta_2m);
     //self->pa = pa;
     self->rh = rh;
     self->pr_1h = pr_1h;
@@ -0,0 +1,286 @@
+#include "metrics.h"
+#include "util.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+static const char *TAG = "metrics";
+
+static char *metric_types[METRIC_TYPE_CNT] = {
+    [METRIC_COUNTER] = "counter",
+    [METRIC_GAUGE] = "gauge",
+    [METRIC_HISTOGRAM] = "histogram",
+};
+
+static metric_t metrics[METRICS_MAX];
+static int metrics_cnt = 0;
+static uint32_t metrics_buckets[METRICS_BUCKETS_MAX];
+static int metrics_buckets_cnt = 0;
+
+// updates are short, scrape copies one metric at a time
+static SemaphoreHandle_t metrics_mutex = NULL;
+static void METRICS_ENTER()
+{
+    if (metrics_mutex == NULL) {
+        metrics_mutex = xSemaphoreCreateMutex();
+        assert(metrics_mutex != NULL);
+    }
+
+    xSemaphoreTake(metrics_mutex, portMAX_DELAY);
+}
+
+static void METRICS_EXIT()
+{
+    xSemaphoreGive(metrics_mutex);
+}
+
+// label value is quoted, quotes and backslashes are replaced
+static void metric_labels(char *buf, const char *key, const char *value)
+{
+    buf[0] = '\0';
+    if (key == NULL || value == NULL)
+        return;
+
+    int len = snprintf(buf, METRIC_LABELS_MAX, "%s=\"%s\"", key, value);
+    if (len >= METRIC_LABELS_MAX) {
+        len = METRIC_LABELS_MAX - 1;
+        buf[len - 1] = '"';
+    }
+    for (int i=strlen(key)+2; i<len-1; i++)
+        if (buf[i] == '"' || buf[i] == '\\')
+            buf[i] = '_';
+}
+
+static metric_t *metric_new(int type, const char *name, const char *help, const char *key, const char *value,
+                            const float *bounds, int cnt)
+{
+    assert(type >= 0 && type < METRIC_TYPE_CNT);
+    char labels[METRIC_LABELS_MAX];
+    metric_labels(labels, key, value);
+
+    metric_t *m = NULL;
+    metric_t *reuse = NULL;
+    METRICS_ENTER();
+    for (int i=0; i<metrics_cnt; i++) {
+        if (strcmp(metrics[i].name, name) != 0)
+            continue;
+        // names never change, scrape compares them without lock
+        if (metrics[i].dropped) {
+            if (reuse == NULL && cnt == 0)
+                reuse = &metrics[i];
+        } else if (strcmp(metrics[i].labels, labels) == 0) {
+            m = &metrics[i];
+            goto CLEANUP;
+        }
+    }
+
+    if (reuse != NULL) {
+        m = reuse;
+        *m = (metric_t) {
+            .name = name,
+            .help = help,
+            .type = type,
+        };
+        strcpy(m->labels, labels);
+        goto CLEANUP;
+    }
+
+    if (metrics_cnt >= METRICS_MAX || metrics_buckets_cnt + cnt > METRICS_BUCKETS_MAX) {
+        ESP_LOGE(TAG, "no space for %s{%s}", name, labels);
+        goto CLEANUP;
+    }
+
+    m = &metrics[metrics_cnt];
+    *m = (metric_t) {
+        .name = name,
+        .help = help,
+        .type = type,
+        .buckets = cnt,
+        .bounds = bounds,
+        .counts = (cnt > 0)? &metrics_buckets[metrics_buckets_cnt] : NULL,
+    };
+    strcpy(m->labels, labels);
+    metrics_buckets_cnt += cnt;
+    metrics_cnt++;
+
+CLEANUP:
+    METRICS_EXIT();
+    return m;
+}
+
+metric_t *metric_counter(const char *name, const char *help)
+{
+    return metric_new(METRIC_COUNTER, name, help, NULL, NULL, NULL, 0);
+}
+
+metric_t *metric_gauge(const char *name, const char *help)
+{
+    return metric_new(METRIC_GAUGE, name, help, NULL, NULL, NULL, 0);
+}
+
+metric_t *metric_histogram(const char *name, const char *help, const float *bounds, int cnt)
+{
+    return metric_new(METRIC_HISTOGRAM, name, help, NULL, NULL, bounds, cnt);
+}
+
+metric_t *metric_labeled(int type, const char *name, const char *help, const char *key, const char *value)
+{
+    assert(type != METRIC_HISTOGRAM);
+    return metric_new(type, name, help, key, value, NULL, 0);
+}
+
+void metric_drop(metric_t *m)
+{
+    if (m == NULL)
+        return;
+    assert(m->buckets == 0);
+    METRICS_ENTER();
+    m->dropped = 1;
+    METRICS_EXIT();
+}
+
+void metric_add(metric_t *m, double val)
+{
+    if (m == NULL)
+        return;
+    METRICS_ENTER();
+    m->value += val;
+    METRICS_EXIT();
+}
+
+void metric_set(metric_t *m, double val)
+{
+    if (m == NULL)
+        return;
+    METRICS_ENTER();
+    m->value = val;
+    METRICS_EXIT();
+}
+
+void metric_observe(metric_t *m, double val)
+{
+    if (m == NULL || isnan(val))
+        return;
+
+    // few buckets, linear
+    int i = 0;
+    while (i < m->buckets && val > m->bounds[i])
+        i++;
+
+    METRICS_ENTER();
+    if (i < m->buckets)
+        m->counts[i]++;
+    m->value += val;
+    m->cnt++;
+    METRICS_EXIT();
+}
+
+int metrics_count()
+{
+    return metrics_cnt;
+}
+
+// integers without exponent, counters get large
+static int metric_value(char *buf, int size, double val)
+{
+    if (isnan(val))
+        return snprintf(buf, size, "NaN");
+    if (val == floor(val) && fabs(val) < 1e15)
+        return snprintf(buf, size, "%.0f", val);
+    return snprintf(buf, size, "%g", val);
+}
+
+// one metric, header only before first of its name
+static int metric_write(metric_t *m, int header, emit_write_t write, void *ctx)
+{
+    char line[160];
+    char num[24];
+    int len;
+    int res = 0;
+#define METRIC_LINE(...) do {                                          \
+        len = snprintf(line, sizeof(line), __VA_ARGS__);               \
+        if (len >= sizeof(line))                                       \
+            len = sizeof(line) - 1;                                    \
+        if (res == 0)                                                  \
+            res = write(ctx, line, len);                               \
+    } while (0)
+
+    if (header) {
+        METRIC_LINE("# HELP %s %s\n", m->name, m->help);
+        METRIC_LINE("# TYPE %s %s\n", m->name, metric_types[m->type]);
+    }
+
+    char *sep = (m->labels[0] != '\0')? "," : "";
+    if (m->type != METRIC_HISTOGRAM) {
+        metric_value(num, sizeof(num), m->value);
+        if (m->labels[0] != '\0')
+            METRIC_LINE("%s{%s} %s\n", m->name, m->labels, num);
+        else
+            METRIC_LINE("%s %s\n", m->name, num);
+        return res;
+    }
+
+    uint32_t sum = 0;
+    for (int i=0; i<m->buckets; i++) {
+        sum += m->counts[i];
+        METRIC_LINE("%s_bucket{%s%sle=\"%g\"} %" PRIu32 "\n", m->name, m->labels, sep, m->bounds[i], sum);
+    }
+    METRIC_LINE("%s_bucket{%s%sle=\"+Inf\"} %" PRIu32 "\n", m->name, m->labels, sep, m->cnt);
+    metric_value(num, sizeof(num), m->value);
+    METRIC_LINE("%s_sum%s%s%s %s\n", m->name, m->labels[0]? "{" : "", m->labels, m->labels[0]? "}" : "", num);
+    METRIC_LINE("%s_count%s%s%s %" PRIu32 "\n", m->name, m->labels[0]? "{" : "", m->labels, m->labels[0]? "}" : "", m->cnt);
+    return res;
+#undef METRIC_LINE
+}
+
+// copy taken under lock, formatting and writes are outside
+// header is cleared once written, dropped metrics are skipped
+static int metric_copy_write(int i, int *header, emit_write_t write, void *ctx)
+{
+    metric_t m;
+    uint32_t counts[METRICS_BUCKETS_MAX];
+    METRICS_ENTER();
+    m = metrics[i];
+    if (m.buckets > 0) {
+        memcpy(counts, m.counts, m.buckets * sizeof(uint32_t));
+        m.counts = counts;
+    }
+    METRICS_EXIT();
+    if (m.dropped)
+        return 0;
+    int res = metric_write(&m, *header, write, ctx);
+    *header = 0;
+    return res;
+}
+
+int metrics_write(emit_write_t write, void *ctx)
+{
+    METRICS_ENTER();
+    int cnt = metrics_cnt;
+    METRICS_EXIT();
+
+    // samples of one name have to be together, labeled metrics
+    // may be registered between others
+    int res = 0;
+    for (int i=0; i<cnt && res == 0; i++) {
+        int first = 1;
+        for (int j=0; j<i && first; j++)
+            if (strcmp(metrics[j].name, metrics[i].name) == 0)
+                first = 0;
+        if (!first)
+            continue;
+
+        int header = 1;
+        res = metric_copy_write(i, &header, write, ctx);
+        for (int j=i+1; j<cnt && res == 0; j++)
+            if (strcmp(metrics[j].name, metrics[i].name) == 0)
+                res = metric_copy_write(j, &header, write, ctx);
+    }
+    return res;
+}
@@ -0,0 +1,200 @@
+#include "config.h"
+#include "outdoor.h"
+#include "nv.h"
+#include "util.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+static const char *TAG = "outdoor";
+
+outdoor_curve_t outdoor_curve = {
+    .slope = 0,
+    .ref = 10.0,
+    .lead_h = 4.0,
+    .max = 1.5,
+};
+
+static struct {
+    float temp;
+    TickType_t tick;
+    int valid;
+} outdoor_src[OUTDOOR_SRC_CNT];
+
+static time_t forecast_t[OUTDOOR_FORECAST_MAX];
+static float forecast_temp[OUTDOOR_FORECAST_MAX];
+static int forecast_cnt = 0;
+
+static SemaphoreHandle_t outdoor_mutex = NULL;
+static void OUTDOOR_ENTER()
+{
+    if (outdoor_mutex == NULL) {
+        outdoor_mutex = xSemaphoreCreateMutex();
+        assert(outdoor_mutex != NULL);
+    }
+
+    xSemaphoreTake(outdoor_mutex, portMAX_DELAY);
+}
+
+static void OUTDOOR_EXIT()
+{
+    xSemaphoreGive(outdoor_mutex);
+}
+
+void outdoor_update(int source, float temp)
+{
+    assert(source >= 0 && source < OUTDOOR_SRC_CNT);
+    if (isnanf(temp))
+        return;
+
+    OUTDOOR_ENTER();
+    outdoor_src[source].temp = temp;
+    outdoor_src[source].tick = xTaskGetTickCount();
+    outdoor_src[source].valid = 1;
+    OUTDOOR_EXIT();
+}
+
+void outdoor_forecast(time_t *t, float *temp, int cnt)
+{
+    if (cnt > OUTDOOR_FORECAST_MAX)
+        cnt = OUTDOOR_FORECAST_MAX;
+
+    OUTDOOR_ENTER();
+    memcpy(forecast_t, t, cnt * sizeof(time_t));
+    memcpy(forecast_temp, temp, cnt * sizeof(float));
+    forecast_cnt = cnt;
+    OUTDOOR_EXIT();
+}
+
+float outdoor_temp()
+{
+    float temp = NAN;
+    TickType_t now = xTaskGetTickCount();
+    OUTDOOR_ENTER();
+    for (int i=0; i<OUTDOOR_SRC_CNT; i++) {
+        if (outdoor_src[i].valid && now - outdoor_src[i].tick < S_TO_TICK(OUTDOOR_MAX_AGE_S)) {
+            temp = outdoor_src[i].temp;
+            break;
+        }
+    }
+    OUTDOOR_EXIT();
+    return temp;
+}
+
+float outdoor_ahead(time_t ahead)
+{
+    float temp = NAN;
+    OUTDOOR_ENTER();
+    for (int i=1; i<forecast_cnt; i++) {
+        if (forecast_t[i-1] <= ahead && ahead <= forecast_t[i]) {
+            float k = (float) (ahead - forecast_t[i-1]) / (forecast_t[i] - forecast_t[i-1]);
+            temp = forecast_temp[i-1] + k * (forecast_temp[i] - forecast_temp[i-1]);
+            break;
+        }
+    }
+    OUTDOOR_EXIT();
+    return temp;
+}
+
+// slab heated now gives heat over next hours, so average of current
+// and forecast temperature at lead time
+float outdoor_effective()
+{
+    time_t now;
+    time(&now);
+    float temp = outdoor_temp();
+    float ahead = outdoor_ahead(now + (time_t) (outdoor_curve.lead_h * 60*60));
+    if (isnanf(temp))
+        return ahead;
+    if (isnanf(ahead))
+        return temp;
+    return (temp + ahead) / 2;
+}
+
+float outdoor_offset()
+{
+    if (outdoor_curve.slope == 0)
+        return 0;
+
+    float temp = outdoor_effective();
+    if (isnanf(temp))
+        return 0;
+
+    float offset = outdoor_curve.slope * (outdoor_curve.ref - temp);
+    if (offset > outdoor_curve.max)
+        offset = outdoor_curve.max;
+    else if (offset < -outdoor_curve.max)
+        offset = -outdoor_curve.max;
+    return offset;
+}
+
+static int outdoor_curve_parse(char *value, outdoor_curve_t *curve)
+{
+    float params[] = {0, outdoor_curve.ref, outdoor_curve.lead_h, outdoor_curve.max};
+    char *end = value;
+    for (int i=0; i<COUNT_OF(params); i++) {
+        params[i] = strtof(value, &end);
+        if (end == value)
+            return 0;
+        if (*end != ',')
+            break;
+        value = end + 1;
+    }
+    if (*end != '\0')
+        return 0;
+    // comparisons are false with nan
+    for (int i=0; i<COUNT_OF(params); i++)
+        if (!isfinite(params[i]))
+            return 0;
+    if (!(params[0] >= 0 && params[0] <= OUTDOOR_CURVE_SLOPE_MAX &&
+          params[1] >= OUTDOOR_CURVE_REF_MIN && params[1] <= OUTDOOR_CURVE_REF_MAX &&
+          params[2] >= 0 && params[2] <= OUTDOOR_CURVE_LEAD_H_MAX &&
+          params[3] >= 0 && params[3] <= OUTDOOR_CURVE_MAX_MAX))
+        return 0;
+
+    *curve = (outdoor_curve_t) {
+        .slope = params[0],
+        .ref = params[1],
+        .lead_h = params[2],
+        .max = params[3],
+    };
+    return 1;
+}
+
+int outdoor_curve_set(char *value)
+{
+    outdoor_curve_t curve;
+    if (value == NULL || !outdoor_curve_parse(value, &curve)) {
+        ESP_LOGE(TAG, "invalid heating curve: %s", (value != NULL)? value : "");
+        return 0;
+    }
+
+    // %g is at most 12 chars (-1.23457e-05) and separator
+    char buf[4*(12+1)];
+    int len = snprintf(buf, sizeof(buf), "%g,%g,%g,%g", curve.slope, curve.ref, curve.lead_h, curve.max);
+    assert(len > 0 && len < sizeof(buf));
+    ESP_LOGI(TAG, "saving heating curve %s", buf);
+    if (curve.slope == 0)
+        nv_remove(OUTDOOR_CURVE_KEY);
+    else
+        nv_write_str(OUTDOOR_CURVE_KEY, buf);
+    outdoor_curve = curve;
+    return 1;
+}
+
+void outdoor_init()
+{
+    char *value = NULL;
+    size_t size = 0;
+    nv_read_str(OUTDOOR_CURVE_KEY, &value, &size);
+    if (value != NULL) {
+        if (!outdoor_curve_parse(value, &outdoor_curve))
+            ESP_LOGE(TAG, "invalid heating curve: %s", value);
+        free(value);
+    }
+}
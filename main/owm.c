@@ -1,6 +1,7 @@
 #include "config.h"
 #include "http.h"
 #include "oled.h"
+#include "outdoor.h"
 #include <stdlib.h>
 #include <time.h>
 #include "cJSON.h"
@@ -46,6 +47,10 @@ int owm_parse(char *out, int outsize, char *buf, int len)
     int pressure1 = 0, pressure2 = 0;
     char dow[3 +1+ 2 +1];
     int ret = 0;
+    // for heating curve
+    time_t forecast_t[OUTDOOR_FORECAST_MAX];
+    float forecast_temp[OUTDOOR_FORECAST_MAX];
+    int forecast_cnt = 0;
     cJSON_ArrayForEach(item, list) {
         cJSON *dt = cJSON_GetObjectItemCaseSensitive(item, "dt");
 
@@ -127,6 +132,10 @@ int owm_parse(char *out, int outsize, char *buf, int len)
 
         if (main != NULL) {
             val = cJSON_GetObjectItemCaseSensitive(main, "temp");
+            if (cJSON_IsNumber(val) && forecast_cnt < OUTDOOR_FORECAST_MAX) {
+                forecast_t[forecast_cnt] = t;
+                forecast_temp[forecast_cnt++] = val->valuedouble - 273.15;
+            }
             if (cJSON_IsNumber(val)) {
                 int temp = val->valueint - 273;
                 //ESP_LOGI(TAG, " %d", temp);
@@ -183,6 +192,7 @@ int owm_parse(char *out, int outsize, char *buf, int len)
             }
         }
     }
+    outdoor_forecast(forecast_t, forecast_temp, forecast_cnt);
 CLEANUP:
     cJSON_Delete(json);
     return 1;
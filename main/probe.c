@@ -0,0 +1,157 @@
+#include "config.h"
+#include "probe.h"
+#include "metrics.h"
+#include "device.h"
+#include "module.h"
+#include "graphite.h"
+#include "log.h"
+#include "nv.h"
+#include "ping.h"
+#include "util.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "esp_log.h"
+static const char *TAG = "probe";
+
+static struct {
+    metric_t *uptime;
+    metric_t *heap_free;
+    metric_t *heap_largest;
+    metric_t *heap_min;
+    metric_t *nvs_used;
+    metric_t *nvs_free;
+    metric_t *tasks;
+    metric_t *sockets;
+    metric_t *online;
+    metric_t *nv_writes;
+    metric_t *log_dropped;
+    metric_t *graphite_sent;
+    metric_t *graphite_dropped;
+} probe;
+// task stack gauges, dropped when task ends
+#define PROBE_TASKS_MAX 32
+static metric_t *probe_tasks[PROBE_TASKS_MAX];
+// only on controller (or METRICS_PROBE_CLIENTS)
+static task_t *probe_runner = NULL;
+
+static void probe_update()
+{
+    metric_set(probe.uptime, esp_timer_get_time() / 1000000);
+
+    multi_heap_info_t heap = {0};
+    heap_caps_get_info(&heap, MALLOC_CAP_8BIT);
+    metric_set(probe.heap_free, heap.total_free_bytes);
+    metric_set(probe.heap_largest, heap.largest_free_block);
+    metric_set(probe.heap_min, heap.minimum_free_bytes);
+
+    nvs_stats_t nvs_stats;
+    if (nvs_get_stats(NULL, &nvs_stats) == ESP_OK) {
+        metric_set(probe.nvs_used, nvs_stats.used_entries);
+        metric_set(probe.nvs_free, nvs_stats.free_entries);
+    }
+
+    metric_set(probe.tasks, uxTaskGetNumberOfTasks());
+    if (esp.sockets != NULL)
+        metric_set(probe.sockets, uxSemaphoreGetCount(esp.sockets));
+    metric_set(probe.online, ping_online.connected);
+
+    // counters kept by subsystems themselves
+    metric_set(probe.nv_writes, nv_writes);
+    metric_set(probe.log_dropped, log_dropped);
+    metric_set(probe.graphite_sent, graphite_sent);
+    metric_set(probe.graphite_dropped, graphite_dropped);
+
+    // same name and label returns already registered metric,
+    // tasks of the same name share the lowest high water mark
+    uint32_t stack[PROBE_TASKS_MAX];
+    uint8_t seen[PROBE_TASKS_MAX] = {0};
+    iter_t itask = task_iter();
+    task_t *task;
+    while ((itask = task_next(itask, &task)) != NULL) {
+        metric_t *m = metric_labeled(METRIC_GAUGE, "espire_task_stack_min_bytes", "Task stack high water mark",
+                                     "task", task->name);
+        if (m == NULL)
+            continue;
+        uint32_t min = uxTaskGetStackHighWaterMark(task->task);
+        int i = 0;
+        while (i < PROBE_TASKS_MAX && probe_tasks[i] != m)
+            i++;
+        if (i == PROBE_TASKS_MAX) {
+            i = 0;
+            while (i < PROBE_TASKS_MAX && probe_tasks[i] != NULL)
+                i++;
+            // untracked, kept as it is
+            if (i == PROBE_TASKS_MAX) {
+                metric_set(m, min);
+                continue;
+            }
+            probe_tasks[i] = m;
+        }
+        if (!seen[i] || min < stack[i])
+            stack[i] = min;
+        seen[i] = 1;
+    }
+
+    for (int i=0; i<PROBE_TASKS_MAX; i++) {
+        if (probe_tasks[i] == NULL)
+            continue;
+        if (seen[i]) {
+            metric_set(probe_tasks[i], stack[i]);
+        } else {
+            metric_drop(probe_tasks[i]);
+            probe_tasks[i] = NULL;
+        }
+    }
+
+    module_t *mod;
+    iter_t imod = module_iter();
+    while ((imod = module_next(imod, &mod)) != NULL) {
+        if (mod->name == NULL)
+            continue;
+        metric_t *m = metric_labeled(METRIC_GAUGE, "espire_module_state", "Module state", "module", mod->name);
+        metric_set(m, mod->state);
+    }
+}
+
+static void probe_task(void *pvParameter)
+{
+    while (1) {
+        probe_update();
+        _vTaskDelay(S_TO_TICK(METRICS_PERIOD_S));
+    }
+}
+
+void probe_init()
+{
+    probe.uptime = metric_gauge("espire_uptime_seconds", "Time since boot");
+    probe.heap_free = metric_gauge("espire_heap_free_bytes", "Free 8-bit heap");
+    probe.heap_largest = metric_gauge("espire_heap_largest_free_block_bytes", "Largest free 8-bit heap block");
+    probe.heap_min = metric_gauge("espire_heap_min_free_bytes", "Free 8-bit heap low water mark");
+    probe.nvs_used = metric_gauge("espire_nvs_used_entries", "Used NVS entries");
+    probe.nvs_free = metric_gauge("espire_nvs_free_entries", "Free NVS entries");
+    probe.tasks = metric_gauge("espire_tasks", "FreeRTOS tasks");
+    probe.sockets = metric_gauge("espire_sockets_free", "Free sockets");
+    probe.online = metric_gauge("espire_online", "Internet reachable");
+    probe.nv_writes = metric_counter("espire_nv_writes_total", "NVS writes");
+    probe.log_dropped = metric_counter("espire_log_dropped_bytes_total", "Log bytes dropped");
+    probe.graphite_sent = metric_counter("espire_graphite_sent_total", "Graphite metrics sent");
+    probe.graphite_dropped = metric_counter("espire_graphite_dropped_total", "Graphite metrics dropped");
+
+    if (!esp.dev->controller && !METRICS_PROBE_CLIENTS) {
+        ESP_LOGI(TAG, "metrics on scrape");
+        return;
+    }
+    ESP_LOGI(TAG, "metrics every %ds", METRICS_PERIOD_S);
+    xxTaskCreate(probe_task, "probe_task", 3*1024, NULL, 1, &probe_runner);
+}
+
+void probe_scrape()
+{
+    // scrape only formats what probe task cached
+    if (probe_runner == NULL)
+        probe_update();
+}
@@ -1,9 +1,27 @@
+#include "config.h"
 #include "relay.h"
 #include "check.h"
+#include "util.h"
 #include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 static const char *TAG = "relay";
 
+typedef struct {
+    int gpio;
+    // applied (-1 before first) and requested state
+    int state;
+    int want;
+    TickType_t requested;
+    TickType_t changed;
+    uint32_t switches;
+} relay_sched_t;
+
+static relay_sched_t relay_sched[RELAY_SCHED_MAX];
+static int relay_sched_cnt = 0;
+static task_t *relay_task = NULL;
+
 // with wifi there are
 // 10 outputs + 4 thermistors OR
 //  8 outputs + 6 thermistors
@@ -78,3 +96,151 @@ void relay_init(int count, int v5)
     for (int i=0; i<count; i++)
         relay_init_pin(i, v5);
 }
+
+static SemaphoreHandle_t relay_mutex = NULL;
+static void RELAY_ENTER()
+{
+    if (relay_mutex == NULL) {
+        relay_mutex = xSemaphoreCreateMutex();
+        assert(relay_mutex != NULL);
+    }
+
+    xSemaphoreTake(relay_mutex, portMAX_DELAY);
+}
+
+static void RELAY_EXIT()
+{
+    xSemaphoreGive(relay_mutex);
+}
+
+static void relay_apply(int gpio, int state)
+{
+#ifdef RELAY_3V3
+    relay_init_gpio(gpio, 0);
+    relay_set_gpio(gpio, state);
+#else
+    relay_set_gpio_5v(gpio, state);
+#endif
+}
+
+// one transition per stagger period, oldest request first
+static void relay_sched_task(void *pvParameter)
+{
+    while (1) {
+        TickType_t wait = portMAX_DELAY;
+        TickType_t now = xTaskGetTickCount();
+        relay_sched_t *next = NULL;
+
+        RELAY_ENTER();
+        for (int i=0; i<relay_sched_cnt; i++) {
+            relay_sched_t *r = &relay_sched[i];
+            if (r->want == r->state)
+                continue;
+
+            TickType_t dwell = S_TO_TICK((r->state == HEATING_ON)? RELAY_MIN_ON_S : RELAY_MIN_OFF_S);
+            if (r->state >= 0 && now - r->changed < dwell) {
+                if (r->changed + dwell - now < wait)
+                    wait = r->changed + dwell - now;
+                continue;
+            }
+
+            if (next == NULL || now - r->requested > now - next->requested)
+                next = r;
+        }
+
+        if (next != NULL) {
+            if (next->state >= 0)
+                next->switches += 1;
+            next->state = next->want;
+            next->changed = now;
+            relay_apply(next->gpio, next->state);
+        }
+        RELAY_EXIT();
+
+        if (next != NULL)
+            _vTaskDelay(MS_TO_TICK(RELAY_STAGGER_MS));
+        else
+            ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+static relay_sched_t *relay_sched_find(int gpio)
+{
+    for (int i=0; i<relay_sched_cnt; i++)
+        if (relay_sched[i].gpio == gpio)
+            return &relay_sched[i];
+    return NULL;
+}
+
+// NULL when there are too many relays
+static relay_sched_t *relay_sched_get(int gpio)
+{
+    relay_sched_t *r = relay_sched_find(gpio);
+    if (r == NULL && relay_sched_cnt < RELAY_SCHED_MAX) {
+        r = &relay_sched[relay_sched_cnt++];
+        *r = (relay_sched_t) {.gpio = gpio, .state = -1, .want = -1};
+    }
+    return r;
+}
+
+int relay_schedule(int gpio, int state)
+{
+    RELAY_ENTER();
+    relay_sched_t *r = relay_sched_get(gpio);
+    if (r == NULL) {
+        RELAY_EXIT();
+        ESP_LOGE(TAG, "too many relays, switching GPIO %d now", gpio);
+        relay_apply(gpio, state);
+        return state;
+    }
+
+    if (r->want != state) {
+        r->want = state;
+        r->requested = xTaskGetTickCount();
+    }
+    int applied = r->state;
+
+    if (relay_task == NULL)
+        xxTaskCreate((void (*)(void*)) relay_sched_task, "relay_sched", 2*1024, NULL, 1, &relay_task);
+    RELAY_EXIT();
+    xTaskNotifyGive(relay_task->task);
+    return applied;
+}
+
+int relay_force(int gpio, int state)
+{
+    TickType_t now = xTaskGetTickCount();
+    RELAY_ENTER();
+    relay_sched_t *r = relay_sched_get(gpio);
+    if (r == NULL || r->state != state) {
+        if (r != NULL) {
+            if (r->state >= 0)
+                r->switches += 1;
+            r->state = state;
+            r->changed = now;
+        }
+        relay_apply(gpio, state);
+    }
+    if (r != NULL)
+        r->want = state;
+    RELAY_EXIT();
+    return state;
+}
+
+int relay_state(int gpio)
+{
+    RELAY_ENTER();
+    relay_sched_t *r = relay_sched_find(gpio);
+    int state = (r != NULL)? r->state : -1;
+    RELAY_EXIT();
+    return state;
+}
+
+uint32_t relay_switches(int gpio)
+{
+    RELAY_ENTER();
+    relay_sched_t *r = relay_sched_find(gpio);
+    uint32_t switches = (r != NULL)? r->switches : 0;
+    RELAY_EXIT();
+    return switches;
+}
@@ -5,6 +5,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include <math.h>
+#include <string.h>
 
 #include "nvs.h"
 #include "temp.h"
@@ -15,6 +16,8 @@
 #include "oled.h"
 #include "nv.h"
 #include "util.h"
+#include "metrics.h"
+#include "esp_timer.h"
 
 #include "esp_log.h"
 static const char *TAG = "temp";
@@ -75,14 +78,42 @@ static inline int adc_channel_to_gpio(int adc, int channel)
         return adc2_channel_to_gpio(channel);
 }
 
-static void thermistor_read(thermistor_handle_t *th)
+static th_zone_t *thermistor_zone(thermistor_handle_t *th)
 {
-    // TODO two separate samplings give better result, choose lower temperature
-    // (in addition to filtering)
-    float a = thermistor_get_celsius(th);
-    float b = thermistor_get_celsius(th);
-    //th->celsius = thermistor_get_celsius(th);
-    th->celsius = fminf(a, b);
+    for (int i=0; i<COUNT_OF(ths); i++) {
+        if (temp_zones[i].name[0] != '\0' && temp_zones[i].adc == adc_channel_to_gpio(th->adc_unit, th->channel))
+            return &temp_zones[i];
+    }
+    return NULL;
+}
+
+// second read is needed until zone estimate is stable
+static int thermistor_stable(thermistor_handle_t *th)
+{
+    th_zone_t *zone = thermistor_zone(th);
+    heating_t *data = (zone != NULL)? heating_find(zone->name, 0) : NULL;
+    return data != NULL && est_stable(&data->est);
+}
+
+// two separate samplings give better result, lower one with min
+// estimator (in addition to filtering), otherwise average
+static float thermistor_pair(thermistor_handle_t *th, float a, float b)
+{
+    th_zone_t *zone = thermistor_zone(th);
+    heating_t *data = (zone != NULL)? heating_find(zone->name, 0) : NULL;
+    if (data == NULL || data->est.mode == EST_MIN)
+        return fminf(a, b);
+    return (a + b) / 2;
+}
+
+// scanned is set when celsius is already read in continuous mode
+static void thermistor_read(thermistor_handle_t *th, int scanned)
+{
+    if (!scanned) {
+        th->celsius = thermistor_get_celsius(th);
+        if (!thermistor_stable(th))
+            th->celsius = thermistor_pair(th, th->celsius, thermistor_get_celsius(th));
+    }
     time(&th->time);
 
     // seeing -19 and 49 on disconnected pins
@@ -93,34 +124,73 @@ static void thermistor_read(thermistor_handle_t *th)
         ESP_LOGI(TAG, "GPIO %d seems to be faulty value: %.1f", adc_channel_to_gpio(th->adc_unit, th->channel), th->celsius);
     }
 
-    for (int i=0; i<COUNT_OF(ths); i++) {
-        if (temp_zones[i].name[0] != '\0' && temp_zones[i].adc == adc_channel_to_gpio(th->adc_unit, th->channel)) {
-            // this is fine for now but exterior temperature may be over/under
-            // negating temperature to disable heating may work well but
-            // TODO need some flag to increase range for exterior thermistor
-            //      or use value from ebus
-            if (th->celsius < 45.0 && th->celsius > 0.0)
-                heating_temp_val(temp_zones[i].name, th->celsius, 1);
-            else
-                heating_temp_val(temp_zones[i].name, NAN, 1);
-            // there normally can't be 2 names for gpio
-            break;
-        }
+    // there normally can't be 2 names for gpio
+    th_zone_t *zone = thermistor_zone(th);
+    if (zone != NULL) {
+        // this is fine for now but exterior temperature may be over/under
+        // negating temperature to disable heating may work well but
+        // TODO need some flag to increase range for exterior thermistor
+        //      or use value from ebus
+        if (th->celsius < 45.0 && th->celsius > 0.0)
+            heating_temp_val(zone->name, th->celsius, 1);
+        else
+            heating_temp_val(zone->name, NAN, 1);
     }
 }
 
+// seconds, ADC2 collection waits for network activity
+static const float temp_collection_bounds[] = {0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+
 static void temp_task(temp_t *self)
 {
+    metric_t *duration = metric_histogram("espire_temp_collection_seconds", "Temperature collection duration",
+                                          temp_collection_bounds, COUNT_OF(temp_collection_bounds));
     while (!self->module.stop) {
         ESP_LOGI(TAG, "collection triggered");
+        int64_t start = esp_timer_get_time();
+        // ADC1 doesn't need wifi arbitration, second scan like oneshot
+        uint8_t scanned[COUNT_OF(ths)];
+        if (thermistor_scan(ths, th_count, scanned) == ESP_OK) {
+            float first[COUNT_OF(ths)];
+            int stable = 1;
+            for (int i=0; i<th_count; i++) {
+                first[i] = ths[i].celsius;
+                if (scanned[i] && !thermistor_stable(&ths[i]))
+                    stable = 0;
+            }
+            uint8_t again[COUNT_OF(ths)];
+            if (stable || thermistor_scan(ths, th_count, again) == ESP_OK) {
+                for (int i=0; i<th_count; i++) {
+                    if (!scanned[i] || (!stable && !again[i])) {
+                        scanned[i] = 0;
+                        continue;
+                    }
+                    if (!stable)
+                        ths[i].celsius = thermistor_pair(&ths[i], first[i], ths[i].celsius);
+                    thermistor_read(&ths[i], 1);
+                }
+            } else
+                memset(scanned, 0, sizeof(scanned));
+        }
+
+        // channels scan couldn't take or failed scan
+        for (int i=0; i<th_count; i++)
+            if (ths[i].adc_unit == ADC_UNIT_1 && !scanned[i])
+                thermistor_read(&ths[i], 0);
+
+        // all ADC2 channels in one outage, between network activity
         int had_wifi = adc2_use == ADC2_WIFI;
         if (wifi) {
+            // nothing to plan around without wifi
+            if (had_wifi)
+                adc2_slot(MS_TO_TICK(ADC2_SLOT_MAX_MS));
             // we're trying to be nice but can't ensure collection period
             ADC2_WAIT(ADC2_ADC, 0, MS_TO_TICK(TEMP_FORCE_WIFI_MS), 0, NULL);
         }
 
         for (int i=0; i<th_count; i++) {
-            thermistor_read(&ths[i]);
+            if (ths[i].adc_unit != ADC_UNIT_1)
+                thermistor_read(&ths[i], 0);
         }
         if (wifi) {
             ADC2_FREE();
@@ -130,6 +200,7 @@ static void temp_task(temp_t *self)
                     ESP_LOGE(TAG, "wifi connection not restored");
             }
         }
+        metric_observe(duration, (esp_timer_get_time() - start) / 1e6);
         ESP_LOGI(TAG, "collection finished");
         //_vTaskDelay(S_TO_TICK(TEMP_PERIOD_S));
         wall_clock_wait(TEMP_PERIOD_S, S_TO_TICK(5));
@@ -2,6 +2,7 @@
 #include <assert.h>
 #include <stdint.h>
 #include <string.h>
+#include <math.h>
 #include "config.h"
 #include "device.h"
 #include "ntp.h"
@@ -29,6 +30,67 @@ size_t format_time(time_t time, char *strftime_buf, int size, char *fmt)
     return strftime(strftime_buf, size, fmt, &timeinfo);
 }
 
+static int format_uint(char *buf, uint64_t v)
+{
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v > 0);
+
+    for (int i=0; i<n; i++)
+        buf[i] = tmp[n - 1 - i];
+    buf[n] = '\0';
+    return n;
+}
+
+int format_int(char *buf, int64_t v)
+{
+    if (v < 0) {
+        buf[0] = '-';
+        return 1 + format_uint(buf + 1, -(uint64_t) v);
+    }
+    return format_uint(buf, v);
+}
+
+// replaces "%.*f" of sensor values without printf, returns length
+int format_fixed(char *buf, float val, int decimals)
+{
+    static const uint32_t pow10[] = {1, 10, 100, 1000, 10000};
+    assert(decimals >= 0 && decimals < COUNT_OF(pow10));
+
+    // double keeps rounding same as printf for the usual values
+    double scaled = (double) val * pow10[decimals];
+    if (isnan(val) || !(scaled < 2e9 && scaled > -2e9))
+        return snprintf(buf, FORMAT_FIXED_SIZE, "%g", val);
+
+    char *p = buf;
+    if (scaled < 0) {
+        *p++ = '-';
+        scaled = -scaled;
+    }
+    // ties to even like printf
+    uint32_t v = scaled;
+    double r = scaled - v;
+    if (r > 0.5 || (r == 0.5 && (v & 1)))
+        v += 1;
+
+    p += format_uint(p, v / pow10[decimals]);
+    if (decimals > 0) {
+        uint32_t frac = v % pow10[decimals];
+        *p++ = '.';
+        for (int i=decimals-1; i>=0; i--) {
+            p[i] = '0' + frac % 10;
+            frac /= 10;
+        }
+        p += decimals;
+    }
+
+    *p = '\0';
+    return p - buf;
+}
+
 char *set_time(char *dt)
 {
     struct tm tm = {0};
@@ -291,7 +353,7 @@ void xvTaskDelete(task_t *data)
     assert(data != NULL);
     assert(data->task != NULL);
 
-    ESP_LOGE(TAG, "-%s %" PRIx32, data->name, (uint32_t) data->task);
+    ESP_LOGE(TAG, "-%s %" PRIx32, data->name, (uint32_t) (uintptr_t) data->task);
     assert(list_remove(&tasks, item) != 0);
     TaskHandle_t task = data->task;
     free(data);
@@ -332,7 +394,7 @@ BaseType_t xxTaskCreate(    TaskFunction_t pvTaskCode,
     assert(data->task != NULL);
     strncpy(data->name, pcName, sizeof(data->name)-1);
     list_prepend(&tasks, data);
-    ESP_LOGE(TAG, "+%s %" PRIu32, data->name, (uint32_t) data->task);
+    ESP_LOGE(TAG, "+%s %" PRIu32, data->name, (uint32_t) (uintptr_t) data->task);
     if (pxCreatedTask != NULL)
         *pxCreatedTask = data;
     return res;
@@ -349,24 +411,56 @@ inline iter_t task_next(iter_t iter, task_t **data)
     return iter_next(iter, (void**) data);
 }
 
-// buf and out need to be both padded size
-int aes_cbc(int enc, mbedtls_aes_context *aes, char *iv, int len, char *buf, int bufsiz, char *out) {
-    assert(bufsiz == AES_PADDED_SIZE(len));
+int aes_key_set(aes_key_t *key, char *data, int bits)
+{
+    mbedtls_aes_init(&key->enc);
+    mbedtls_aes_init(&key->dec);
+    int ret = mbedtls_aes_setkey_enc(&key->enc, (uint8_t *) data, bits);
+    if (ret == 0)
+        ret = mbedtls_aes_setkey_dec(&key->dec, (uint8_t *) data, bits);
+    return ret;
+}
 
+// in place, buf needs space for padding when encrypting
+// returns padded size or negative error
+int aes_cbc(int enc, aes_key_t *key, char *iv, char *buf, int len)
+{
+    int bufsiz = AES_PADDED_SIZE(len);
     if (enc) {
         uint8_t pkc5_value = (17 - (bufsiz % 16));
         for (int i = len; i < bufsiz; i++) {
             buf[i] = pkc5_value;
         }
-    }
+    } else if (len % 16 != 0)
+        return -1;
 
-    int ret = mbedtls_aes_crypt_cbc(aes, enc? MBEDTLS_AES_ENCRYPT : MBEDTLS_AES_DECRYPT, bufsiz,
+    int ret = mbedtls_aes_crypt_cbc(enc? &key->enc : &key->dec,
+                                    enc? MBEDTLS_AES_ENCRYPT : MBEDTLS_AES_DECRYPT, bufsiz,
                                     (uint8_t *) iv,
                                     (uint8_t *) buf,
-                                    (uint8_t *) out);
+                                    (uint8_t *) buf);
 
-    //ESP_LOG_BUFFER_HEX("cbc_encrypt", out, bufsiz);
-    return ret;
+    //ESP_LOG_BUFFER_HEX("cbc_encrypt", buf, bufsiz);
+    return (ret == 0)? bufsiz : ret;
+}
+
+// gathers cleartext parts into out and encrypts in place
+// parts already in place are not copied
+int aes_cbc_iov(aes_key_t *key, char *iv, aes_iov_t *iov, int cnt, char *out, int size)
+{
+    int len = 0;
+    for (int i=0; i<cnt; i++)
+        len += iov[i].len;
+    if (AES_PADDED_SIZE(len) > size)
+        return -1;
+
+    char *p = out;
+    for (int i=0; i<cnt; i++) {
+        if (p != iov[i].buf)
+            memmove(p, iov[i].buf, iov[i].len);
+        p += iov[i].len;
+    }
+    return aes_cbc(1, key, iv, out, len);
 }
 
 #include "mbedtls/base64.h"
@@ -407,7 +501,7 @@ inline int init_sa(char *ip, int port, struct sockaddr_in *sa)
         return 0;
     }
 
-    if (inet_aton(ip, &sa->sin_addr.s_addr) == 0) {
+    if (inet_aton(ip, &sa->sin_addr) == 0) {
         ESP_LOGW(TAG, "invalid IP: %s", ip);
         if ((sa->sin_addr.s_addr = resolve_hostname(ip)) == INADDR_ANY) {
             ESP_LOGW(TAG, "could not resolve hostname: %s", ip);
@@ -482,96 +576,3 @@ void wall_clock_wait_until(struct timeval tv_end, TickType_t wait)
         _vTaskDelay(wait);
     }
 }
-
-struct sockaddr_in GRAPHITE_SA = {0};
-static int g_sock_udp = -1;
-
-int graphite_init(char *host, int port)
-{
-    const char *TAG = "graphite";
-    int ret = 0;
-    uint16_t nv;
-
-    if (port == 0) {
-        port = GRAPHITE_UDP_PORT_DEFAULT;
-        if (nv_read_u16("graphite.port", &nv) == ESP_OK)
-            if (port != nv) {
-                port = nv;
-                ret = 1;
-            }
-    }
-
-    if (host == NULL) {
-        size_t size;
-        if (nv_read_str("graphite.ip", &host, &size) != ESP_OK) {
-            ret = init_sa(GRAPHITE_IP_DEFAULT, port, &GRAPHITE_SA);
-        } else {
-            ret = init_sa(host, port, &GRAPHITE_SA);
-            free(host);
-            host = NULL;
-        }
-    } else {
-        ret = init_sa(host, port, &GRAPHITE_SA);
-    }
-
-    if (ret != 0 && g_sock_udp != -1) {
-        close(g_sock_udp);
-        g_sock_udp = -1;
-        xSemaphoreGive(esp.sockets);
-    }
-
-    ESP_LOGI(TAG, "init: %s:%d: %d", (host)? host : GRAPHITE_IP_DEFAULT, port, ret);
-    return ret;
-}
-
-int graphite_udp(char *prefix, char *metric, char *tag, float val, int now, time_t ts)
-{
-    const char *TAG = "graphite";
-    int ret = 0;
-    //WIFI_ADD(xTaskGetCurrentTaskHandle());
-
-    if (g_sock_udp == -1) {
-        graphite_init(NULL, 0);
-        // don't block
-        if (xSemaphoreTake(esp.sockets, 0/*S_TO_TICK(1)*/) == pdFALSE) {
-            ret = 4;
-            ESP_LOGE(TAG, "no sockets available");
-            goto CLEANUP;
-        }
-        if ((g_sock_udp = socket(PF_INET, SOCK_DGRAM, 0)) == -1) {
-            ESP_LOGE(TAG, "socket: %s", strerror(errno));
-            xSemaphoreGive(esp.sockets);
-            ret = 1;
-            goto CLEANUP;
-        }
-    }
-
-    char buf[64];
-    int len;
-    if (!now && (ntp_synced || api_synced)) {
-        time_t now = ts;
-        if (!now)
-            time(&now);
-        len = snprintf(buf, sizeof(buf), "%s%s;tag1=%s %.2f %jd\n", prefix, metric, tag, val, now);
-    } else
-        len = snprintf(buf, sizeof(buf), "%s%s;tag1=%s %.2f\n", prefix, metric, tag, val);
-
-    if (len < 0) {
-        ESP_LOGE(TAG, "failed to format graphite data: %s%s, %s, %.2f, %d, %jd", prefix, metric, tag, val, now, ts);
-        ret = 2;
-        goto CLEANUP;
-    }
-
-    ESP_LOGI(TAG, "%s", buf);
-    ssize_t s = sendto(g_sock_udp, &buf, len,
-                       MSG_DONTWAIT, (struct sockaddr *) &GRAPHITE_SA, sizeof(GRAPHITE_SA));
-    if (s == -1) {
-        ESP_LOGE(TAG, "graphite errno %s", strerror(errno));
-        ret = 3;
-        goto CLEANUP;
-    }
-
-CLEANUP:
-    //WIFI_DEL(xTaskGetCurrentTaskHandle());
-    return ret;
-}
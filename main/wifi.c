@@ -82,6 +82,7 @@ static void event_handler(void* arg, esp_event_base_t event_base,
         s_retry_num = 0;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
         wifi_connected = 1;
+        adc2_outage_end();
         module_network(NET_WIFI);
     }
 }
@@ -0,0 +1,189 @@
+#include "config.h"
+#include "zone.h"
+#include "outdoor.h"
+#include "util.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+static char *zone_fmts[ZONE_FMT_CNT] = {
+    [ZONE_TEXT] = "text",
+    [ZONE_JSON] = "json",
+    [ZONE_CBOR] = "cbor",
+    [ZONE_BIN] = "bin",
+};
+
+char *zone_fmt_name(int fmt)
+{
+    if (fmt < 0 || fmt >= ZONE_FMT_CNT)
+        return "?";
+    return zone_fmts[fmt];
+}
+
+int zone_fmt(char *name)
+{
+    for (int i=0; i<ZONE_FMT_CNT; i++)
+        if (strcmp(zone_fmts[i], name) == 0)
+            return i;
+    return -1;
+}
+
+// output buffer, len is -1 after overflow
+typedef struct {
+    char *buf;
+    int size;
+    int len;
+} zone_out_t;
+
+static void zone_printf(zone_out_t *o, const char *format, ...)
+{
+    if (o->len < 0)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(o->buf + o->len, o->size - o->len, format, args);
+    va_end(args);
+
+    if (n < 0 || n >= o->size - o->len)
+        o->len = -1;
+    else
+        o->len += n;
+}
+
+// measurements from oldest to newest
+static float zone_val(heating_t *data, int i)
+{
+    int last = HEATING_LAST_VAL_I(data);
+    return data->vals[(last + COUNT_OF(data->vals) - i) % COUNT_OF(data->vals)];
+}
+
+static void zone_text(zone_out_t *o, heating_t *data, int flags)
+{
+    zone_printf(o, "heating_relay=%s=%d\n", data->name, data->relay);
+    if (data->c > 0) {
+        zone_printf(o, "temp=%.1f\nvals=", zone_val(data, 0));
+        for (int i=data->c - 1; i>=0; i--)
+            zone_printf(o, "%.1f ", zone_val(data, i));
+        zone_printf(o, "\n");
+    }
+    zone_printf(o, "val=%.1f\nset=%.1f\n", data->val, data->set);
+    if (flags & ZONE_STATE) {
+        zone_printf(o, "fix=%.1f\nstate=%d\ntriggered=%lld\nchange=%lld\n",
+                    data->fix, data->state == HEATING_ON, (long long) data->triggered, (long long) data->change);
+    }
+    if (flags & ZONE_CTL) {
+        if (data->ctl.cfg.mode != CTL_ONOFF) {
+            char ctl[32];
+            ctl_format(&data->ctl.cfg, ctl, sizeof(ctl));
+            zone_printf(o, "heating_ctl=%s=%s\nduty=%.2f\n", data->name, ctl, data->ctl.duty);
+        }
+        if (data->est.mode != EST_DEFAULT)
+            zone_printf(o, "heating_est=%s=%s\n", data->name, est_mode_name(data->est.mode));
+        float noise = est_noise(&data->est);
+        if (!isnanf(noise))
+            zone_printf(o, "noise=%.2f\n", noise);
+        if (outdoor_curve.slope != 0)
+            zone_printf(o, "curve=%.1f\n", outdoor_offset());
+    }
+}
+
+// emitter output into zone buffer
+static int zone_write(void *ctx, const char *buf, int len)
+{
+    zone_out_t *o = ctx;
+    if (o->len < 0 || len > o->size - o->len) {
+        o->len = -1;
+        return -1;
+    }
+
+    memcpy(o->buf + o->len, buf, len);
+    o->len += len;
+    return 0;
+}
+
+void zone_emit(emit_t *e, heating_t *data, int flags)
+{
+    emit_map(e, NULL);
+    emit_str(e, "name", data->name);
+    emit_int(e, "relay", data->relay);
+    if (data->c > 0) {
+        emit_float(e, "temp", zone_val(data, 0), 1);
+        emit_array(e, "vals");
+        for (int i=data->c - 1; i>=0; i--)
+            emit_float(e, NULL, zone_val(data, i), 1);
+        emit_close(e);
+    }
+    emit_float(e, "val", data->val, 1);
+    emit_float(e, "set", data->set, 1);
+    if (flags & ZONE_STATE) {
+        emit_float(e, "fix", data->fix, 1);
+        emit_int(e, "state", data->state == HEATING_ON);
+        emit_int(e, "triggered", data->triggered);
+        emit_int(e, "change", data->change);
+    }
+    if (flags & ZONE_CTL) {
+        if (data->ctl.cfg.mode != CTL_ONOFF) {
+            char ctl[32];
+            ctl_format(&data->ctl.cfg, ctl, sizeof(ctl));
+            emit_str(e, "ctl", ctl);
+            emit_float(e, "duty", data->ctl.duty, 2);
+        }
+        if (data->est.mode != EST_DEFAULT)
+            emit_str(e, "est", est_mode_name(data->est.mode));
+        float noise = est_noise(&data->est);
+        if (!isnanf(noise))
+            emit_float(e, "noise", noise, 2);
+        if (outdoor_curve.slope != 0)
+            emit_float(e, "curve", outdoor_offset(), 1);
+    }
+    emit_close(e);
+}
+
+// native floats, ESP32 is little endian
+static void zone_bin(zone_out_t *o, heating_t *data)
+{
+    if (o->size - o->len < TH_BATCH_ENTRY) {
+        o->len = -1;
+        return;
+    }
+
+    char *p = o->buf + o->len;
+    strncpy(p, data->name, member_size(heating_t, name));
+    p += member_size(heating_t, name);
+    memcpy(p, &data->val, sizeof(data->val));
+    p += sizeof(data->val);
+    memcpy(p, &data->set, sizeof(data->set));
+    o->len += TH_BATCH_ENTRY;
+}
+
+int zone_format(heating_t *data, int fmt, int flags, char *buf, int size)
+{
+    zone_out_t o = {
+        .buf = buf,
+        .size = size,
+        .len = 0,
+    };
+
+    switch (fmt) {
+    case ZONE_TEXT:
+        zone_text(&o, data, flags);
+        break;
+    case ZONE_JSON:
+    case ZONE_CBOR: {
+        emit_t e;
+        emit_init(&e, (fmt == ZONE_JSON)? EMIT_JSON : EMIT_CBOR, zone_write, &o);
+        zone_emit(&e, data, flags);
+        emit_finish(&e);
+        break;
+    }
+    case ZONE_BIN:
+        zone_bin(&o, data);
+        break;
+    default:
+        return -1;
+    }
+    return o.len;
+}
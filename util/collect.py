@@ -21,6 +21,8 @@ parser.add_argument('--limit', dest='limit', action='store', default=2,
                     type=float, help='Limit of rotation in MB, 0 for no limit')
 parser.add_argument('--bind', dest='ip', action='store', default='0.0.0.0',
                     help='IP address to bind to')
+parser.add_argument('--fmt', dest='fmt', action='store', default=None,
+                    help='Format strings (logfmt.py) to render binary logs')
 args = parser.parse_args()
 print(args, file=sys.stderr)
 
@@ -33,11 +35,20 @@ sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
 sock.bind((args.ip, args.port))
 ips = {}
 rest = defaultdict(bytes)
+fmt = None
+if args.fmt is not None:
+    from logfmt import LogFormat
+    fmt = LogFormat(args.fmt)
+# binary record split between datagrams
+pending = defaultdict(bytes)
 while True:
     data, addr = sock.recvfrom(BUFSIZE)
     ip, _ = addr
     contd = False
 
+    if fmt is not None:
+        data, pending[ip] = fmt.decode(pending[ip] + data)
+
     if args.tee:
         # prevent splitting lines
         if ip in rest:
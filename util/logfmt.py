@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+# Format strings for binary network logging (log_binary in log.c)
+#
+# Device sends address of format string in flash instead of formatted text,
+# this extracts strings from ELF and renders records on host.
+#
+# logfmt.py build/espire.elf -o build/logfmt.json
+import argparse
+import bisect
+import hashlib
+import json
+import re
+import struct
+import sys
+
+MARK = 0xff
+# mark, length, level, format address
+HEADER = 1+1+1+4
+
+# same parsing as log_encode()
+CONV = re.compile(rb'%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d*))?(hh|ll|[hlzjtL])?(.)', re.S)
+
+
+def extract(elf):
+    from elftools.elf.elffile import ELFFile
+    from elftools.elf.constants import SH_FLAGS
+
+    strings = {}
+    with open(elf, 'rb') as f:
+        sha256 = hashlib.sha256(f.read()).hexdigest()
+        f.seek(0)
+        e = ELFFile(f)
+        for sec in e.iter_sections():
+            if sec['sh_type'] != 'SHT_PROGBITS' or not (sec['sh_flags'] & SH_FLAGS.SHF_ALLOC):
+                continue
+            if sec['sh_flags'] & SH_FLAGS.SHF_EXECINSTR:
+                continue
+            # esp_ptr_in_drom() on device
+            if not sec.name.startswith('.flash.rodata'):
+                continue
+            data = sec.data()
+            addr = sec['sh_addr']
+            start = 0
+            for m in re.finditer(rb'\x00', data):
+                s = data[start:m.start()]
+                if s:
+                    try:
+                        strings[addr + start] = s.decode('utf-8')
+                    except UnicodeDecodeError:
+                        pass
+                start = m.end()
+    return {'elf': elf, 'sha256': sha256, 'strings': {'%x' % k: v for k, v in strings.items()}}
+
+
+class LogFormat:
+    def __init__(self, path):
+        with open(path) as f:
+            table = json.load(f)
+        items = sorted((int(k, 16), v.encode('utf-8')) for k, v in table['strings'].items())
+        self.addrs = [a for a, _ in items]
+        self.strings = [s for _, s in items]
+
+    def string(self, addr):
+        # linker merges string suffixes, address can point inside
+        i = bisect.bisect_right(self.addrs, addr) - 1
+        if i < 0 or addr - self.addrs[i] >= len(self.strings[i]):
+            return None
+        return self.strings[i][addr - self.addrs[i]:]
+
+    def render(self, rec):
+        level = chr(rec[2])
+        addr, = struct.unpack_from('<I', rec, 3)
+        fmt = self.string(addr)
+        if fmt is None:
+            return ('%s (?) logfmt: unknown format 0x%08x\n' % (level, addr)).encode('ascii')
+
+        args = memoryview(rec)[HEADER:]
+        pos = 0
+
+        def take(n):
+            nonlocal pos
+            if pos + n > len(args):
+                raise ValueError('short record')
+            v = args[pos:pos+n]
+            pos += n
+            return bytes(v)
+
+        def conv(m):
+            flags, width, prec, length, c = m.groups()
+            if c == b'%':
+                return b'%'
+            if width == b'*':
+                width = b'%d' % struct.unpack('<i', take(4))
+            if prec == b'*':
+                prec = b'%d' % struct.unpack('<i', take(4))
+            spec = (b'%' + flags + (width or b'') + (b'.' + prec if prec is not None else b'')).decode()
+            c = chr(c[0])
+            if c in 'diuoxX':
+                wide = length in (b'll', b'j')
+                signed = c in 'di'
+                v, = struct.unpack(('<q' if signed else '<Q') if wide else ('<i' if signed else '<I'),
+                                   take(8 if wide else 4))
+                s = (spec + ('d' if c in 'iu' else c)) % v
+            elif c == 'c':
+                s = (spec + 'c') % take(1)[0]
+            elif c in 'fFeEgGaA':
+                v, = struct.unpack('<f', take(4))
+                s = (spec + ('f' if c in 'aA' else c)) % v
+            elif c == 'p':
+                v, = struct.unpack('<I', take(4))
+                s = '0x%x' % v
+            elif c == 's':
+                if pos < len(args) and args[pos] == MARK:
+                    take(1)
+                    a, = struct.unpack('<I', take(4))
+                    v = self.string(a) or b'?'
+                else:
+                    end = bytes(args[pos:]).find(b'\x00')
+                    if end < 0:
+                        raise ValueError('unterminated string')
+                    v = take(end + 1)[:-1]
+                s = (spec + 's') % v.decode('utf-8', 'replace')
+            else:
+                raise ValueError('unsupported conversion %s' % c)
+            return s.encode('utf-8')
+
+        try:
+            return CONV.sub(conv, fmt)
+        except (ValueError, struct.error, TypeError) as exc:
+            return ('%s (?) logfmt: broken record 0x%08x: %s\n' % (level, addr, exc)).encode('ascii')
+
+    def decode(self, data):
+        """Render binary records in data, returns (text, unfinished rest)."""
+        out = bytearray()
+        i = 0
+        while i < len(data):
+            if data[i] != MARK:
+                j = data.find(bytes([MARK]), i)
+                if j < 0:
+                    j = len(data)
+                out += data[i:j]
+                i = j
+                continue
+            if i + 2 > len(data):
+                break
+            n = data[i+1]
+            if n < HEADER:
+                # lost datagram, resynchronize
+                i += 1
+                continue
+            if i + n > len(data):
+                break
+            out += self.render(bytes(data[i:i+n]))
+            i += n
+        return bytes(out), bytes(data[i:])
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+    parser.add_argument('elf', help='Application ELF file')
+    parser.add_argument('-o', dest='output', default='-', help='Output JSON file')
+    args = parser.parse_args()
+
+    table = extract(args.elf)
+    if args.output == '-':
+        json.dump(table, sys.stdout)
+    else:
+        with open(args.output, 'w') as f:
+            json.dump(table, f)
@@ -7,7 +7,10 @@ import argparse
 import socket
 import struct
 import base64
+import time
+import uuid
 from cryptography.hazmat.primitives.ciphers import Cipher, algorithms, modes
+from cryptography.hazmat.primitives.ciphers.aead import AESGCM
 from cryptography.hazmat.primitives import padding
 
 
@@ -23,18 +26,69 @@ class ThUDP:
     # (1+member_size(heating_t, name)+member_size(heating_t, val)+member_size(heating_t, set))
     name_end = 1+10
     data_end = name_end+4+4
+    # '&' batch: cmd+version+count+flags+boot+since+gen, count*(name+float+float)
+    BATCH_VERSION = 2
+    BATCH_MORE = 0x01
+    BATCH_REPLY = 0x02
+    BATCH_HEADER = 16
+    BATCH_ENTRY = 10+4+4
+    BATCH_SIZE = 512
+    # AES-GCM: sender id (MAC) + 48-bit counter, 16 byte tag
+    NONCE_ID = 6
+    NONCE_SIZE = 12
+    TAG_SIZE = 16
 
     # all binary arguments
-    def __init__(self, secret, key, iv):
+    def __init__(self, secret, key, iv, aead=False, sender=None):
         self.secret = secret
         self.key = key
         self.iv = iv
+        self.aead = aead
         self.cipher = Cipher(algorithms.AES(key), modes.CBC(iv))
+        # locally administered MAC of this host, receivers keep epoch floor per sender
+        self.sender = sender or bytes([0x02]) + uuid.getnode().to_bytes(8, 'big')[-(self.NONCE_ID-1):]
+        # epoch is minutes since 2024 so every run after receiver reboot is fresh,
+        # sequence is milliseconds within the minute
+        ms = int(time.time() * 1000) - 1704067200000
+        self.counter = (ms // 60000) << 24 | (ms % 60000) << 8
+
+    def seal(self, msg):
+        if self.aead:
+            self.counter += 1
+            nonce = self.sender + self.counter.to_bytes(self.NONCE_SIZE-self.NONCE_ID, 'big')
+            return nonce + AESGCM(self.key).encrypt(nonce, bytes(msg), None), bytes(msg)
+
+        msg = bytes(msg) + self.secret + b'\x00'
+        # zero padded
+        #padder = padding.PKCS7(16*8).padder()
+        #padded = padder.update(msg) + padder.finalize()
+        padded = msg + bytes(AES_PADDED_SIZE(len(msg)) - len(msg))
+        enc = self.cipher.encryptor()
+        data = enc.update(padded) + enc.finalize()
+        return data, padded
+
+    # cleartext including secret for CBC
+    def open(self, data):
+        if self.aead:
+            nonce = data[:self.NONCE_SIZE]
+            return AESGCM(self.key).decrypt(nonce, data[self.NONCE_SIZE:], None)
+
+        dec = self.cipher.decryptor()
+        return dec.update(data) + dec.finalize()
+
+    def validate(self, rdec, offset, validate):
+        if self.aead:
+            # tag is checked by open
+            return self.secret
+        secret = rdec[offset:].split(b'\0')[0]
+        if validate and self.secret != secret:
+            raise ValueError('invalid secret')
+        return secret
 
     def prepare(self, cmd, zone, tval, tset):
-        # including padding
-        size = AES_PADDED_SIZE(HEATING_DGRAM_SIZE(self.data_end, self.secret))
-        msg = bytearray(size)
+        if cmd == '&':
+            return self.prepare_batch()
+        msg = bytearray(self.data_end)
 
         msg[0] = ord(cmd)
         msg[1:1+len(zone)] = zone.encode('ascii')
@@ -42,15 +96,12 @@ class ThUDP:
         if cmd == '!':
             msg[self.name_end:self.name_end+4] = struct.pack('f', tval)
             msg[self.name_end+4:self.name_end+4+4] = struct.pack('f', tset)
-        msg[self.data_end:self.data_end+len(self.secret)+1] = self.secret+b'\x00'
+        return self.seal(msg)
 
-        # zero padded
-        #padder = padding.PKCS7(16*8).padder()
-        #padded = padder.update(msg) + padder.finalize()
-        padded = msg
-        enc = self.cipher.encryptor()
-        data = enc.update(padded) + enc.finalize()
-        return data, bytes(padded)
+    def prepare_batch(self, boot=0, gen=0):
+        # request is batch without zones, boot and gen of 0 asks for all zones
+        msg = bytes([ord('&'), self.BATCH_VERSION, 0, 0]) + struct.pack('<III', boot, 0, gen)
+        return self.seal(msg)
 
     def bind(self, ip, port):
         self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
@@ -65,23 +116,39 @@ class ThUDP:
     def receive(self, validate=True):
         #BUFSIZE = self.data_end + len(self.secret)
         #BUFSIZE = ((BUFSIZE//32) + 1) * 32
-        BUFSIZE = AES_PADDED_SIZE(HEATING_DGRAM_SIZE(self.data_end, self.secret))
-        renc, addr = self.sock.recvfrom(BUFSIZE)
-        dec = self.cipher.decryptor()
-        rdec = dec.update(renc) + dec.finalize()
+        # batches are bigger than single zone
+        renc, addr = self.sock.recvfrom(self.BATCH_SIZE)
+        rdec = self.open(renc)
         #unpadder = padding.PKCS7(16*8).unpadder()
         #rdec = unpadder.update(rdec) + unpadder.finalize()
         print('received ', rdec)
+        if chr(rdec[0]) == '&':
+            return self.decode_batch(rdec, validate)
         val = struct.unpack('f', rdec[self.name_end:self.name_end+4])
         set = struct.unpack('f', rdec[self.name_end+4:self.name_end+4+4])
         cmd = chr(rdec[0])
         zone = rdec[1:self.name_end].split(b'\0')[0]
-        secret = rdec[self.data_end:].split(b'\0')[0]
-        if validate and self.secret != secret:
-            raise ValueError('invalid secret')
+        secret = self.validate(rdec, self.data_end, validate)
         print(cmd, zone, val, set, secret)
         return cmd, zone, val, set, secret
 
+    def decode_batch(self, rdec, validate=True):
+        version, count, flags = rdec[1], rdec[2], rdec[3]
+        if version != self.BATCH_VERSION:
+            raise ValueError('unsupported batch version %d' % version)
+        boot, since, gen = struct.unpack('<III', rdec[4:16])
+        print('& boot %08x since %d gen %d seq %d' % (boot, since, gen, flags >> 4))
+        zones = []
+        for i in range(count):
+            entry = rdec[self.BATCH_HEADER + i*self.BATCH_ENTRY:][:self.BATCH_ENTRY]
+            zone = entry[:10].split(b'\0')[0]
+            val, set = struct.unpack('<ff', entry[10:18])
+            zones.append((zone, val, set))
+            print('&', zone, val, set)
+        secret = self.validate(rdec, self.BATCH_HEADER + count*self.BATCH_ENTRY, validate)
+        more = bool(flags & self.BATCH_MORE)
+        return '&', zones, more, secret
+
 
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(
@@ -116,7 +183,14 @@ if __name__ == "__main__":
         help="Do not validate secret",
     )
     parser.add_argument(
-        "--type", dest="type", action="store", required=True, help="Message type: *?#!"
+        "--aead",
+        dest="aead",
+        action="store_true",
+        default=False,
+        help="AES-GCM (CONFIG_ESP_HEATING_UDP_AEAD) instead of AES-CBC with secret",
+    )
+    parser.add_argument(
+        "--type", dest="type", action="store", required=True, help="Message type: *?#!&"
     )
     parser.add_argument(
         "--zone", dest="zone", action="store", default="", help="Zone name"
@@ -161,14 +235,14 @@ if __name__ == "__main__":
     args.key = os.environ.get('UDP_KEY', args.key)
     args.iv = os.environ.get('UDP_IV', args.iv)
     if args.secret is None:
-        args.secret = os.environ['UDP_SECRET']
+        args.secret = os.environ.get('UDP_SECRET', '') if args.aead else os.environ['UDP_SECRET']
 
     secret = args.secret.encode('ascii')
     key = base64.b64decode(args.key)
     iv = base64.b64decode(args.iv)
     zone = args.zone
 
-    th = ThUDP(secret, key, iv)
+    th = ThUDP(secret, key, iv, aead=args.aead)
     data, padded = th.prepare(args.type, zone, args.val, args.set)
     print('cleartext', padded)
     print('encrypted', data)
@@ -184,3 +258,7 @@ if __name__ == "__main__":
     elif args.type == '*':
         while True:
             th.receive(validate=not args.insecure)
+    elif args.type == '&':
+        more = True
+        while more:
+            _, _, more, _ = th.receive(validate=not args.insecure)